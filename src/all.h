@@ -17,6 +17,8 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <limits.h>
 #include <malloc.h>
 #include <errno.h>
 #include <ctype.h>
@@ -44,6 +46,8 @@
 #define UNIX_TIME
 #define UNIX_SERIAL
 #define UNIX_SOCKETS
+#define UNIX_MMAP
+#define LINUX_SERIAL
 #endif
 
 #ifdef T_MINGW
@@ -61,6 +65,15 @@
 #endif
 
 
+// For code specialised by inlining with constant arguments
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(T_MSVC)
+#define ALWAYS_INLINE __forceinline
+#else
+#define ALWAYS_INLINE
+#endif
+
 // I really don't know if this is portable, but it works in GCC both
 // with and without optimisation (GCC precompiles it into a constant)
 #ifndef NAN
@@ -100,12 +113,21 @@
 #ifdef UNIX_SERIAL
  #include <termios.h>
  #include <sys/ioctl.h>
+ #include <poll.h>
+#endif
+
+#ifdef LINUX_SERIAL
+ #include <linux/serial.h>
 #endif
 
 #ifdef WIN_SERIAL
  #include <windows.h>
 #endif
 
+#ifdef UNIX_MMAP
+ #include <sys/mman.h>
+#endif
+
 // With HEADER defined, these C files just give their header info
 // (mainly structure-definitions).  Perhaps this is bit unusual --
 // people normally seem to use separate header files -- but at least
@@ -118,6 +140,8 @@
 #include "common/util.c"
 #include "audio.c"
 #include "clock.c"
+#include "rawdump.c"
+#include "synth.c"
 #include "settings.c"
 #include "device.c"
 #include "complex.c"
@@ -34,10 +34,10 @@ int sintab[SINTAB_SIZE];	// Sine table
 
 //
 //	Time handing.  'audio_clock.clock' provides the current time
-//	in ms/65536 according to the audio device output clock.  This
-//	wraps every ~65 seconds.  This is gently adjusted over periods
-//	of a second or more to correct for any relative drift between
-//	this clock and the computer's millisecond clock.  Every time
+//	in us/65536 according to the audio device output clock.  This
+//	is gently adjusted over periods of a second or more to correct
+//	for any relative drift between this clock and the computer's
+//	microsecond clock.  Every time
 //	the audio callback is made a sample of the computer clock is
 //	taken.  This may be late due to scheduling delays, but taking
 //	all the minimum values over a period allows a synchronisation
@@ -211,7 +211,7 @@ handle_audio_setup(Parse *pp) {
    // Setup timing
    clock_setup(&audio_clock, 
 	       audio_rate * 1.0 / audio_bufsz, 
-	       time_now_ms());
+	       time_now_us());
 
    // Setup sintab[] array
    for (a= 0; a<SINTAB_SIZE; a++)
@@ -229,13 +229,13 @@ handle_audio_setup(Parse *pp) {
 static void 
 audio_callback(void *vp, Uint8 *cdat, int clen) {
    AudioCB *p;
-   int now;
+   Sint64 now;
    short *dat= (short*)cdat;
    int len= clen / (2 * sizeof(short));
 
    // Calculate the current time only once, and share it with all
    // routines called to save any overhead connected with this.
-   now= time_now_ms();
+   now= time_now_us();
 
    // Sanity check
    if (len != audio_bufsz) 
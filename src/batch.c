@@ -0,0 +1,103 @@
+//
+//	Headless batch analysis ('-A')
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.
+//        Released under the GNU GPL version 2 as published by the
+//        Free Software Foundation.  See the file COPYING for details,
+//        or visit <http://www.gnu.org/copyleft/gpl.html>.
+//
+//	This loads "eegmir.cfg" as usual, but without any display or
+//	audio, and with the recording named on the command line
+//	replacing the configured input.  The recording is decoded as
+//	fast as possible, and every [F*] bands page runs its analysis
+//	over it, writing out rows of mag/magsm values (see
+//	p_bands_batch_init()).  Output is CSV if the file name ends in
+//	".csv", else binary.  With several bands pages, each gets its
+//	own file, with the page added to the name: 'scores-F2.csv',
+//	'scores-F3.csv' and so on.
+//
+
+#ifndef NO_ALL_H
+#include "all.h"
+#endif
+
+char *batch_in;		// Input recording in batch mode, else 0
+
+//
+//	Open the output file for the bands page on key 'fn' (0-11)
+//
+
+static FILE *
+batch_open(char *name, int fn, int multi) {
+   char fnam[256];
+   FILE *out;
+
+   if (!multi)
+      snprintf(fnam, sizeof(fnam), "%s", name);
+   else {
+      char *ext= strrchr(name, '.');
+      int pre= ext ? ext - name : strlen(name);
+      snprintf(fnam, sizeof(fnam), "%.*s-F%d%s", pre, name,
+	       fn+1, ext ? ext : "");
+   }
+
+   if (!(out= fopen(fnam, "wb")))
+      error("Unable to create output file: %s", fnam);
+   applog("Writing [F%d] analysis to %s", fn+1, fnam);
+   return out;
+}
+
+//
+//	Run the batch analysis of 'inp', writing the results to
+//	'outnam', and report the speed.
+//
+
+void
+batch_run(char *inp, char *outnam) {
+   FILE *out[12];
+   char *ext= strrchr(outnam, '.');
+   int csv= ext && 0 == strcmp(ext, ".csv");
+   int a, n_pg;
+   Sint64 now0, now;
+
+   batch_in= inp;
+   if (load_config("eegmir.cfg"))
+      error("Batch analysis abandoned due to configuration errors");
+
+   for (n_pg= 0, a= 0; a<12; a++)
+      if (p_fn[a] && p_bands_is(p_fn[a])) n_pg++;
+   if (!n_pg)
+      error("No bands pages are configured, so there is nothing to do");
+
+   for (a= 0; a<12; a++) {
+      out[a]= 0;
+      if (p_fn[a] && p_bands_is(p_fn[a])) {
+	 out[a]= batch_open(outnam, a, n_pg > 1);
+	 p_bands_batch_init(p_fn[a], out[a], csv);
+      }
+   }
+
+   // Analyse each block as it is decoded, so that the sample
+   // buffer never wraps
+   now0= time_now_us();
+   do {
+      for (a= 0; a<12; a++)
+	 if (out[a]) p_bands_batch_run(p_fn[a]);
+   } while (file_tick(dev));
+   for (a= 0; a<12; a++)
+      if (out[a]) p_bands_batch_run(p_fn[a]);
+   now= time_now_us();
+
+   for (a= 0; a<12; a++)
+      if (out[a] && (ferror(out[a]) || 0 != fclose(out[a])))
+	 error("Write error on output file for [F%d]", a+1);
+
+   printf("Analysed %.0f samples (%.1f seconds of data) on %d page%s in %.3f seconds\n"
+	  "  %.0f samples/s (%.1fx real-time at %g Hz)\n",
+	  (double)dev->wr, dev->wr / dev->rate, n_pg, n_pg > 1 ? "s" : "",
+	  (now-now0) * 1e-6,
+	  dev->wr / ((now-now0) * 1e-6),
+	  dev->wr / ((now-now0) * 1e-6) / dev->rate, dev->rate);
+}
+
+// END //
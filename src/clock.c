@@ -6,7 +6,7 @@
 //        Free Software Foundation.  See the file COPYING for details,
 //        or visit <http://www.gnu.org/copyleft/gpl.html>.
 //
-//	This provides a ms/65536 clock which runs at the given rate
+//	This provides a us/65536 clock which runs at the given rate
 //	but which receives hints on the correct time now and again.
 //	It uses these to gently adjust itself to keep in sync with the
 //	correct time by drifting towards it over periods of about a
@@ -15,26 +15,27 @@
 //	drift between the two clocks.
 //
 //	It is assumed that the provided 'correct' clock times in
-//	milliseconds may be late but never early.  Late ones are
-//	ignored.
+//	microseconds (from time_now_us()) may be late but never
+//	early.  Late ones are ignored.
 //
-//	Note that the clock value wraps every 65 seconds
-//	approximately.
+//	The clock is 64-bit, so it doesn't wrap.
 //
 
 #ifdef HEADER
 
 typedef struct Clock Clock;
 struct Clock {
-   int clock;         // Current ms/65536 time
-   int clockinc;      // Increment to 'clock' for each time unit
-   int targ;          // Target ms/65536 time, for calculating offset
-   int targinc;       // Target increment per time unit
-   int offset;        // Minimum offset encountered between correct time and target
+   Sint64 clock;      // Current us/65536 time
+   Sint64 clockinc;   // Increment to 'clock' for each time unit
+   Sint64 targ;       // Target us/65536 time, for calculating offset
+   Sint64 targinc;    // Target increment per time unit
+   Sint64 offset;     // Minimum offset encountered between correct time and target
    int cnt;           // Countdown to next targ/clock update
    int cntper;        // Period for countdown (roughly 1 sec)
 };
 
+#define CLOCK_OFFSET_MAX ((((Sint64)0x7FFFFFFF) << 32) | 0xFFFFFFFF)
+
 #else
 
 #ifndef NO_ALL_H
@@ -46,12 +47,12 @@ struct Clock {
 //
 
 void 
-clock_setup(Clock *ck, double rate, int now) {
+clock_setup(Clock *ck, double rate, Sint64 now) {
    ck->clock= now << 16;
-   ck->clockinc= (int)(65536000/rate);
+   ck->clockinc= (Sint64)(65536000000.0/rate);
    ck->targ= ck->clock;
    ck->targinc= ck->clockinc;
-   ck->offset= 0x7FFFFFFF;
+   ck->offset= CLOCK_OFFSET_MAX;
    ck->cntper= (int)rate;
    if (ck->cntper < 6) ck->cntper= 6;
    ck->cnt= ck->cntper;
@@ -60,13 +61,13 @@ clock_setup(Clock *ck, double rate, int now) {
 //
 //	Increment a clock by one time unit as defined by the original
 //	'rate' setup, and gently synchronize with the given measured
-//	time (ms), which may be late but never early.  Returns the
+//	time (us), which may be late but never early.  Returns the
 //	current clock time (ck->clock).
 //
 
-int 
-clock_inc(Clock *ck, int now) {
-   int off;
+Sint64 
+clock_inc(Clock *ck, Sint64 now) {
+   Sint64 off;
 
    ck->clock += ck->clockinc;
    ck->targ += ck->targinc;
@@ -83,9 +84,9 @@ clock_inc(Clock *ck, int now) {
       ck->clockinc= ck->targinc + (ck->targ-ck->clock) / ck->cntper;
 
       ck->cnt= ck->cntper;
-      ck->offset= 0x7FFFFFFF;
+      ck->offset= CLOCK_OFFSET_MAX;
 
-      //applog("%p timing adjust: %.2fms", ck, (ck->targ-ck->clock) / 65536.0);
+      //applog("%p timing adjust: %.3fms", ck, (ck->targ-ck->clock) / 65536000.0);
    }
 
    return ck->clock;
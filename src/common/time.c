@@ -1,3 +1,32 @@
+//
+//      Get the current time in microseconds from a monotonic clock
+//      (without any specific reference for '0' time, but never 0).
+//      This is used for sample timestamps.
+//
+
+#ifdef WIN_TIME
+Sint64 
+time_now_us() {
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER cnt;
+
+   if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&cnt);
+   return 1 + (cnt.QuadPart / freq.QuadPart) * 1000000 + 
+      (cnt.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+#endif
+
+#ifdef UNIX_TIME
+Sint64 
+time_now_us() {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return 1 + ts.tv_sec * (Sint64)1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
 //
 //      Get the current time in milliseconds (without any specific
 //      reference for '0' time)
@@ -13,15 +42,11 @@ time_now_ms() {
 #ifdef UNIX_TIME
 int 
 time_now_ms() {
-   static int start= 0;
-   int now;
-   struct timeval tv;
-
-   gettimeofday(&tv, NULL);
-   now= tv.tv_sec*1000+tv.tv_usec/1000;
+   static Sint64 start= 0;
+   Sint64 now= time_now_us() / 1000;
 
    if (!start) start= now;
-   return now-start;
+   return (int)(now-start);
 }
 #endif
 
@@ -149,6 +149,10 @@ load_config(void *vp) {
       p= q;
    }
    free(txt);
+   if (dev_start()) {
+      applog("Configuration FAILURE.");
+      return 1;
+   }
    applog("Configuration complete.");
    return 0;
 }
@@ -164,6 +168,12 @@ handle_sect(Parse *pp) {
 
    applog("  setting up [%s] ...", pp->sect);
 
+   // Start the devices running once all the [*-dev] sections are done
+   if (0 != strcmp(pp->sect, "unix-dev") &&
+       0 != strcmp(pp->sect, "win-dev") &&
+       dev_start())
+      return 1;
+
    if (1 == sscanf(pp->sect, "F%d %c", &ival, &dmy)) {
       if (ival < 1 || ival > 12)
 	 return line_error(pp, 0, "Bad config file section name: %s", pp->sect);
@@ -171,7 +181,7 @@ handle_sect(Parse *pp) {
    }
 
    if (0 == strcmp(pp->sect, "audio"))
-      return !server && handle_audio_setup(pp);
+      return !server && !batch_in && handle_audio_setup(pp);
 
 #ifdef UNIX_SERIAL
    if (0 == strcmp(pp->sect, "unix-dev"))
@@ -378,6 +388,9 @@ handle_page_setup(Parse *pp, int fn) {
       p_fn[fn]= p_bands_init(pp);
       return (p_fn[fn] == 0);
    }
+
+   if (batch_in) 
+      return 0;		// Only bands pages are used in batch mode
    
    if (parse(pp, "timing;")) {
       p_fn[fn]= p_timing_init(pp);
@@ -15,13 +15,35 @@
 
 typedef struct Sample Sample;
 struct Sample {
-   int stamp;		// Timestamp -- the time at which this sample actually arrived (ms)
-   int time;		// Estimated correct clock time for this sample (ms/65536)
+   Sint64 stamp;	// Timestamp -- the time at which this sample actually arrived (us)
+   Sint64 time;		// Estimated correct clock time for this sample (us/65536)
    short err;		// Error flag -- set if there was a sync error around this point
    short flags;		// Sampled flag values
    short val[2];	// Sampled data values (structure expanded to the correct number)
 };
 
+//
+//	Devices with more than 16 bits of resolution store their values
+//	32 bits wide, as Sample32, according to dev->width.  The header
+//	fields are laid out the same, so they can always be reached
+//	through a Sample*.  Loops over many samples should test
+//	dev->width once and then run code specialised for that layout,
+//	typically an ALWAYS_INLINE routine taking a constant 'w32'
+//	argument.  SAMPLE_VAL() is for odd accesses outside such loops.
+//
+
+typedef struct Sample32 Sample32;
+struct Sample32 {
+   Sint64 stamp;	// As for Sample
+   Sint64 time;
+   short err;
+   short flags;
+   int val[2];		// Sampled data values (structure expanded to the correct number)
+};
+
+#define SAMPLE_VAL(dd,ss,a) ((dd)->width == 4 ? ((Sample32*)(ss))->val[a] : (ss)->val[a])
+#define SAMPLE_VALP(dd,ss,a) ((char*)(ss)->val + (a) * (dd)->width)
+
 typedef struct Device Device;
 struct Device {
 #ifdef WIN_SERIAL
@@ -31,39 +53,156 @@ struct Device {
    FILE *file;		// Input file stream for 'file' command
    double file_cps;	// Incoming characters per second for 'file'
    double file_cc;	// Character counter
-   FILE *rawdump;	// Stream to dump incoming bytes to, or 0 if not required
+   int file_max;	// Replay 'file' as fast as possible ('file <name> max;')
+   int file_eof;	// Set when the end of the 'file' has been reached
+   char *file_map;	// mmap'd contents of 'file', or 0 if reading via stdio
+   long file_len;	// Length of file_map data
+   long file_pos;	// Number of bytes of 'file' handed over so far
+   Sint64 file_t0;	// Time (us) at which file replay started
+   double file_nsmp;	// Samples generated so far in 'max' mode
+   int file_last;	// Samples generated by the last block in 'max' mode
+   RawDump *rawdump;	// Capture of incoming bytes, or 0 if not required
+   Synth *synth;	// Synthetic signal generator for 'synth', else 0
 
    int init_complete;	// Set when initialisation of device is complete
    int audio;		// Handle serial input in audio callback rather than separate thread
+   int lowlat;		// Low-latency serial mode ('lowlat;'): wake on every byte
    
    char *ibuf;		// Circular buffer for incoming serial data
    int ilen, imask;	// Length of buffer (bytes) and mask for wrapping
    int ird, iwr;	// Buffer read/write circular offsets; ird==iwr means empty buffer
    int ierr;		// Input error count; number of bad bytes already absorbed from ird
+   int overflow;	// Overflow policy when ibuf fills: 0 block (drain via handler), 1 drop oldest
+   double in_bytes;	// Count of bytes received
+   double in_drop;	// Count of bytes dropped due to ibuf overflow
+   int in_peak;		// Peak fill level of ibuf seen so far (bytes)
 
-   void (*handler)();	// Protocol-specific handler; converts incoming data into samples
+   void (*handler)(Device *dev);	// Protocol-specific handler; converts incoming data into samples
    int n_chan;		// Number of input channels
    double rate;		// Sampling rate (theoretical)
    int min, max;	// Range for sample values; (min+max+1)/2 is taken as the 0-value
    int n_flag;		// Number of flag bits stored in ss->flags
+   int width;		// Bytes per stored value: 2 for Sample, 4 for Sample32
    
    int n_smp;		// Number of input samples stored in circular buffer (power of 2)
    int mask;		// Counter mask (n_smp-1)
    int s_smp;		// Size of the Sample structure
-   int wr;		// Current write-offset in circular buffer
+   Sint64 wr;		// Sequence number of next sample to write (see SAMPLE_PUBLISH)
    char *smp;		// Buffer itself, containing n_smp Sample structures, each 
    			//  s_smp bytes long
-
-   int now;		// Current time in ms for handler routines, or 0 if not known
-   Clock clock;		// ms/65536 clock for samples
+   double hist;		// Seconds of history to keep in the sample buffer ('history')
+   char *hist_file;	// StrDup'd name of file backing the history, or 0 for a temporary one
+   FILE *hist_fp;	// File backing the sample buffer and planes, or 0 if in memory
+   double hist_len;	// Bytes of hist_fp mapped so far
+   float *plane;	// Normalised channel planes (see DEV_PLANE), or 0 if not kept
+   char *plane_mem;	// Allocated memory for planes
+   int p_stride;	// Floats from one plane to the next
+   int p_mid;		// Mid-point value, subtracted before normalising
+   float p_mul;		// Multiplier to bring values into the range -1 to +1
+
+   Sint64 now;		// Current time in us for handler routines, or 0 if not known
+   Clock clock;		// us/65536 clock for samples
 
    int hdata[8];	// Private data for handler() call
+
+   // Multiple devices are read by one thread and merged into a
+   // single wide stream, which is what 'dev' then points to
+   Device *subs;	// Merged device: list of sub-devices, first is the master
+   Device *nxt;		// Sub-device: next in list
+   Device *merged;	// Sub-device: the merged device it feeds, or 0
+   int chan0;		// Sub-device: index of its first channel in the merged device
+   Sint64 mrd;		// Sub-device: merge read position in its own sample buffer
+   Sint64 mpick;	// Sub-device: sample chosen for the merged sample being built
+   int mstale;		// Sub-device: set if no sample could be chosen (device stalled)
+   Sint64 mlast;	// Sub-device: last sample used by the merge
+   int m_dup, m_drop;	// Sub-device: samples duplicated/dropped by the merge due to drift
+   int catchup;		// Default catch-up policy for cursors: CUR_SKIP or CUR_RESYNC
+};
+
+//
+//	Each consumer of the sample buffer reads it through a Cursor,
+//	which is registered centrally so that how far each one lags
+//	the writer can be shown live.  A cursor that falls more than
+//	the buffer length behind has been lapped, and its catch-up
+//	policy decides what happens next: CUR_SKIP jumps straight to
+//	the latest data, and CUR_RESYNC calls the consumer's resync()
+//	routine, which should reset its filters and set a new read
+//	position itself.
+//
+
+typedef struct Cursor Cursor;
+struct Cursor {
+   Cursor *nxt;		// Next in registry
+   char *name;		// Name for display (StrDup'd)
+   Sint64 rd;		// Sequence number of next sample to read
+   int lag;		// Samples behind the writer at the last cursor_check()
+   int lag_max;		// Peak lag seen
+   int lapped;		// Number of times this cursor has been lapped
+   int idle;		// Set whilst the consumer isn't reading (e.g. page hidden)
+   int policy;		// Catch-up policy: CUR_SKIP or CUR_RESYNC
+   void (*resync)(void *vp);	// Routine to resync the consumer for CUR_RESYNC, or 0
+   void *vp;		// Argument for resync()
 };
 
-#define SAMPLE(nn) (Sample*)(dev->smp + (nn) * dev->s_smp)
-#define SAMPLE_INC(nn) nn= (nn+1) & dev->mask
-#define SAMPLE_DEC(nn) nn= (nn-1) & dev->mask
-#define SAMPLE_WRAP(nn) nn &= dev->mask
+#define CUR_SKIP 0
+#define CUR_RESYNC 1
+
+//
+//	The sample buffer is a lock-free single-producer,
+//	multiple-consumer ring.  Samples are addressed by 64-bit
+//	sequence numbers which only ever increase; sample 'seq' lives
+//	in slot (seq & dev->mask).  The producer fills in sample
+//	dev->wr and then makes it visible with SAMPLE_PUBLISH(), a
+//	release store.  Consumers in other threads load dev->wr with
+//	DEV_WR(), an acquire load, after which all samples before it
+//	are fully written.
+//
+//	Consumers never hold up the producer, so a slow one may be
+//	lapped.  A consumer that has copied out sample 'seq' (or
+//	whatever it needs from it) can check SAMPLE_OK() afterwards to
+//	be sure that the slot wasn't overwritten whilst it was reading
+//	it.  Handlers may write one slot ahead of dev->wr before
+//	publishing (see nsd_line()), hence SAMPLE_GUARD.
+//
+
+#define DEV_SAMPLE(dd,nn) ((Sample*)((dd)->smp + (size_t)((nn) & (dd)->mask) * (dd)->s_smp))
+#define SAMPLE(nn) DEV_SAMPLE(dev, nn)
+#define SAMPLE_GUARD 2
+
+#ifdef T_MSVC
+// x86 is strongly ordered, so only the compiler needs restraining,
+// but a 64-bit value needs an interlocked operation to be atomic
+#define DEV_WR(dd) InterlockedCompareExchange64(&(dd)->wr, 0, 0)
+#define SAMPLE_PUBLISH(dd) ((dd)->plane ? sample_planes(dd, (dd)->wr) : (void)0, \
+			    InterlockedExchange64(&(dd)->wr, (dd)->wr + 1))
+#define SAMPLE_FENCE() MemoryBarrier()
+#else
+#define DEV_WR(dd) __atomic_load_n(&(dd)->wr, __ATOMIC_ACQUIRE)
+#define SAMPLE_PUBLISH(dd) ((dd)->plane ? sample_planes(dd, (dd)->wr) : (void)0, \
+			    __atomic_store_n(&(dd)->wr, (dd)->wr + 1, __ATOMIC_RELEASE), \
+			    __atomic_thread_fence(__ATOMIC_RELEASE))
+#define SAMPLE_FENCE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+#define SAMPLE_OK(dd,seq) (SAMPLE_FENCE(), \
+			   DEV_WR(dd) - (seq) <= (dd)->n_smp - SAMPLE_GUARD)
+
+//
+//	Alongside the sample buffer, the device that the pages read
+//	from also keeps the values of each channel normalised to the
+//	range -1 to +1 as floats, in one plane per channel.  Sample
+//	'seq' of channel 'a' is DEV_PLANE(dd,a)[seq & dd->mask], so
+//	consumers can run along a channel without striding through
+//	the Sample structures, and without repeating the conversion.
+//	The planes are filled in by SAMPLE_PUBLISH(), so they are valid
+//	and go stale in step with the samples themselves.  Each plane
+//	is aligned to a cache line, and they are spaced out by an extra
+//	cache line so that the same slot in different planes doesn't
+//	always land in the same cache set.
+//
+
+#define PLANE_ALIGN 64
+#define DEV_PLANE(dd,a) ((dd)->plane + (size_t)(a) * (dd)->p_stride)
 
 #else
 
@@ -71,7 +210,22 @@ struct Device {
 #include "all.h"
 #endif
 
-Device *dev= 0;		// Currently running serial device
+Device *dev= 0;		// Currently running serial device (or merged device)
+static Device *dev_list;	// Devices set up by [*-dev] sections, not yet started
+Cursor *cursors= 0;	// Registry of all sample buffer cursors
+
+#define MERGE_TIMEOUT 250000	// us to wait for a late sub-device before marking an error
+#define HIST_DEFAULT 10		// Seconds of history kept by default
+#define HIST_MAX (1<<30)	// Maximum samples in the sample buffer
+
+static char *setup_format(Device *dev, char *fmtname, int devtype);
+static void setup_buffers(Device *dev);
+static void setup_planes(Device *dev);
+static void *hist_alloc(Device *dev, double len);
+static void dev_merge(Device *dev, Sint64 now);
+#ifdef LINUX_SERIAL
+static int set_baud_other(int fd, int baud);
+#endif
 
 //
 //      Setup the device
@@ -81,12 +235,19 @@ int
 handle_dev_setup(Parse *pp) {
    char *devname;	// StrDup'd device name
    int devbaud;
-   int devtype;		// 0 unset, 1 serial port, 2 file, 3 socket
+   int devtype;		// 0 unset, 1 serial port, 2 file, 3 socket, 4 synth
    char *fmtname;	// StrDup'd format name
-   int a;
+   char *dumpname= 0;	// StrDup'd rawdump file name, or 0
+   int dumprot= 0;	// MB per rawdump file when rotating, or 0
+   char *cachename= 0;	// StrDup'd filter cache file name, or 0
+   int rawdump= 0;
+   Device *dev, **prvp;
+   int a, n_dev;
 
-   if (dev) return line_error(pp, pp->pos, "Duplicate [*-dev] section");
+   if (dev_started())
+      return line_error(pp, pp->pos, "[*-dev] sections must come before the pages");
 
+   for (n_dev= 0, prvp= &dev_list; *prvp; prvp= &(*prvp)->nxt) n_dev++;
    dev= ALLOC(Device);
 
    // Defaults
@@ -105,22 +266,56 @@ handle_dev_setup(Parse *pp) {
    while (1) {
       if (parse(pp, "port %T %d;", &devname, &devbaud)) {
 	 if (devtype) 
-	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file' and 'server' commands");
+	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file', 'server' and 'synth' commands");
 	 devtype= 1;
 	 continue;
       }
+      if (parse(pp, "file %T max;", &devname)) {
+	 if (devtype) 
+	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file', 'server' and 'synth' commands");
+	 devtype= 2;
+	 dev->file_max= 1;
+	 continue;
+      }
       if (parse(pp, "file %T %f;", &devname, &dev->file_cps)) {
 	 if (devtype) 
-	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file' and 'server' commands");
+	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file', 'server' and 'synth' commands");
 	 devtype= 2;
 	 continue;
       }
       if (parse(pp, "server %T;", &devname)) {
 	 if (devtype) 
-	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file' and 'server' commands");
+	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file', 'server' and 'synth' commands");
 	 devtype= 3;
 	 continue;
       }
+      if (parse(pp, "synth;")) {
+	 if (devtype) 
+	    return line_error(pp, pp->rew, "Duplicate or mixed 'port', 'file', 'server' and 'synth' commands");
+	 devtype= 4;
+	 continue;
+      }
+      {
+	 double freq, amp, per, dur;
+	 if (parse(pp, "synth-sine %f %f;", &freq, &amp)) {
+	    synth_add(dev, freq, amp, 0, 0);
+	    continue;
+	 }
+	 if (parse(pp, "synth-burst %f %f every %fs for %fs;", &freq, &amp, &per, &dur)) {
+	    if (per <= 0 || dur <= 0 || dur > per)
+	       return line_error(pp, pp->rew, "Bad 'synth-burst' timing");
+	    synth_add(dev, freq, amp, per, dur);
+	    continue;
+	 }
+	 if (parse(pp, "synth-noise %f;", &amp)) {
+	    synth_get(dev)->noise= amp;
+	    continue;
+	 }
+	 if (parse(pp, "synth-errors %f;", &freq)) {
+	    synth_get(dev)->errs= freq;
+	    continue;
+	 }
+      }
       if (parse(pp, "audio-sync;")) {
 	 if (!audio)
 	    applog("    \x98""audio-sync ignored as audio device is not active");
@@ -128,15 +323,57 @@ handle_dev_setup(Parse *pp) {
 	    dev->audio= 1;
 	 continue;
       }
-      if (parse(pp, "rawdump;")) {
-	 if (!(dev->rawdump= fopen("dump.raw", "wb"))) 
-	    applog("    \x98""rawdump ignored; failed to create 'dump.raw'");
+      if (parse(pp, "lowlat;")) { dev->lowlat= 1; continue; }
+      if (parse(pp, "rawdump %T %dMB;", &dumpname, &dumprot) ||
+	  parse(pp, "rawdump %T;", &dumpname) ||
+	  parse(pp, "rawdump;")) {
+	 if (dumprot < 0)
+	    return line_error(pp, pp->rew, "Bad 'rawdump' rotation size");
+	 rawdump= 1;
+	 continue;
+      }
+      if (parse(pp, "ibuf %d;", &dev->ilen)) {
+	 if (dev->ilen < 64 || dev->ilen > (1<<26))
+	    return line_error(pp, pp->rew, "Bad 'ibuf' size; expecting 64 to 64M bytes");
+	 continue;
+      }
+      if (parse(pp, "overflow block;")) { dev->overflow= 0; continue; }
+      if (parse(pp, "overflow drop;")) { dev->overflow= 1; continue; }
+      if (parse(pp, "catchup skip;")) { dev->catchup= CUR_SKIP; continue; }
+      if (parse(pp, "catchup resync;")) { dev->catchup= CUR_RESYNC; continue; }
+      {
+	 double hist;
+	 if (parse(pp, "history %fh;", &hist)) hist *= 3600;
+	 else if (parse(pp, "history %fmin;", &hist)) hist *= 60;
+	 else if (parse(pp, "history %fs;", &hist)) ;
+	 else hist= -1;
+	 if (hist >= 0) {
+	    if (n_dev)
+	       return line_error(pp, pp->rew, "'history' may only be given in the first [*-dev] section");
+	    if (hist <= 0)
+	       return line_error(pp, pp->rew, "Bad 'history' length");
+	    dev->hist= hist;
+	    continue;
+	 }
+      }
+      if (parse(pp, "history-file %T;", &dev->hist_file)) continue;
+      if (parse(pp, "filter-cache %T;", &cachename)) {
+	 int cnt;
+	 if (n_dev)
+	    return line_error(pp, pp->rew, "'filter-cache' may only be given in the first [*-dev] section");
+	 cnt= fid_cache_file(cachename);
+	 if (cnt < 0)
+	    return line_error(pp, pp->rew, "Unable to write filter cache file: %s", cachename);
+	 applog("    \x98""%d filter design%s loaded from %s", cnt, cnt == 1 ? "" : "s", cachename);
+	 free(cachename); cachename= 0;
 	 continue;
       }
       if (parse(pp, "fmt %T;", &fmtname)) continue;
       if (parse(pp, "rate %f;", &dev->rate)) continue;
       if (parse(pp, "chan %d;", &dev->n_chan)) continue;
       if (parse(pp, "flags %d;", &dev->n_flag)) continue;
+      if (parse(pp, "width 16;")) { dev->width= 2; continue; }
+      if (parse(pp, "width 32;")) { dev->width= 4; continue; }
       break;
    }
    
@@ -144,8 +381,41 @@ handle_dev_setup(Parse *pp) {
       return line_error(pp, pp->pos, "Unrecognised trailing [*-dev] section entries");
 
    if (devtype == 0) devtype= 1;
+   if (dev->synth && devtype != 4)
+      return line_error(pp, 0, "'synth-*' settings are only valid with 'synth'");
+
+   // In batch mode, the recording named on the command line replaces
+   // whatever input was configured, and is read as fast as possible
+   if (batch_in) {
+      if (n_dev)
+	 return line_error(pp, 0, "Batch mode only supports a single [*-dev] device");
+      if (devtype == 4)
+	 return line_error(pp, 0, "Batch mode can't be used with a 'synth' device");
+      free(devname);
+      devname= StrDup(batch_in);
+      devtype= 2;
+      dev->file_max= 1;
+      dev->audio= 0;
+   }
+
+   if (rawdump && devtype == 4) {
+      applog("    \x98""rawdump ignored for synth device");
+      rawdump= 0;
+   }
+   if (rawdump) {
+      // Second and later devices get 'dump2.raw' and so on by default
+      char tmp[32];
+      if (!dumpname) {
+	 if (n_dev) sprintf(tmp, "dump%d.raw", n_dev+1);
+	 else strcpy(tmp, "dump.raw");
+	 dumpname= StrDup(tmp);
+      }
+      if (!(dev->rawdump= rawdump_open(dumpname, dumprot)))
+	 applog("    \x98""rawdump ignored");
+      free(dumpname); dumpname= 0;
+   }
 
-   if (devtype == 3) {
+   if (devtype == 3 || devtype == 4) {
       free(fmtname);
       fmtname= 0;		// Format name not required
    }
@@ -156,44 +426,8 @@ handle_dev_setup(Parse *pp) {
    //
 
    if (fmtname) {
-      if (0 == strcmp(fmtname, "modEEGold") ||
-	  0 == strcmp(fmtname, "modEEG-P2")) {
-	 if (dev->n_chan <= 0 || dev->n_chan > 6) 
-	    dev->n_chan= 6;
-	 dev->rate= 256.0;
-	 dev->handler= modEEGold_handler;
-	 dev->min= 0;
-	 dev->max= 1023;
-	 if (dev->n_flag > 4) dev->n_flag= 4;
-	 if (dev->n_flag < 0) dev->n_flag= 0;
-      } else if (0 == strcmp(fmtname, "modEEG") ||
-		 0 == strcmp(fmtname, "modEEG-P3")) {
-	 if (dev->n_chan <= 0 || dev->n_chan > 6) 
-	    dev->n_chan= 6;
-	 dev->rate= 256.0;
-	 dev->handler= modEEG_handler;
-	 dev->min= 0;
-	 dev->max= 1023;
-	 dev->ierr= 1;		// Ignore the first partial packet
-	 if (dev->n_flag > 4) dev->n_flag= 4;
-	 if (dev->n_flag < 0) dev->n_flag= 0;
-      } else if (0 == strcmp(fmtname, "jim-m")) {
-	 if (dev->n_chan != 2 && dev->n_chan != 4)
-	    return line_error(pp, 0, "Expecting 2 or 4 channels for jim-m format type");
-	 if (!dev->rate) dev->rate= (dev->n_chan == 2) ? 140.0 : 130.0;
-	 dev->handler= jm_handler;
-	 dev->min= 0;
-	 dev->max= 255;
-	 dev->n_flag= 0;
-      } else if (0 == strcmp(fmtname, "auto")) {
-	 if (devtype != 3) 
-	    return line_error(pp, 0, "Format 'auto' only possible with a server connection");
-      } else if (0 == strcmp(fmtname, "jm2")) {
-	 return line_error(pp, 0, "Type 'jm2' deprecated; please use 'fmt jim-m; chan 2;'");
-      } else if (0 == strcmp(fmtname, "jm4")) {
-	 return line_error(pp, 0, "Type 'jm4' deprecated; please use 'fmt jim-m; chan 4;'");
-      } else  
-	 return line_error(pp, 0, "Serial format '%s' not known", fmtname);
+      char *msg= setup_format(dev, fmtname, devtype);
+      if (msg) return line_error(pp, 0, "%s", msg);
       free(fmtname); fmtname= 0;
    }
 
@@ -202,14 +436,33 @@ handle_dev_setup(Parse *pp) {
    //
 
    switch (devtype) {
+    case 4:	// synth
+       {
+	  char *msg= synth_setup(dev);
+	  if (msg) return line_error(pp, 0, "%s", msg);
+       }
+       break;
     case 3:	// socket
-       if (setup_server_connection(devname, 8336, pp))
+       if (setup_server_connection(dev, devname, 8336, pp))
 	  return 1;
        break;
     case 2:	// file
        dev->file= fopen(devname, "rb");
        if (!dev->file)
 	  return line_error(pp, 0, "Unable to open input file: %s", devname);
+#ifdef UNIX_MMAP
+       {
+	  struct stat st;
+	  void *map;
+	  if (0 == fstat(fileno(dev->file), &st) && st.st_size > 0 &&
+	      MAP_FAILED != (map= mmap(0, st.st_size, PROT_READ, MAP_PRIVATE,
+				       fileno(dev->file), 0))) {
+	     madvise(map, st.st_size, MADV_SEQUENTIAL);
+	     dev->file_map= map;
+	     dev->file_len= st.st_size;
+	  }
+       }
+#endif
        break;
     case 1:	// serial port
 #ifdef WIN_SERIAL
@@ -267,8 +520,16 @@ handle_dev_setup(Parse *pp) {
 	  tt.c_iflag= IGNBRK | IGNPAR;
 	  tt.c_oflag= 0;
 	  tt.c_lflag= 0;
+	  // Wake on every byte at the usual rates, or in low-latency
+	  // mode.  At high rates, wait for about a millisecond's worth
+	  // of bytes (or a 0.1s gap) to save on system calls.
 	  tt.c_cc[VMIN]= 1;
 	  tt.c_cc[VTIME]= 0;
+	  if (!dev->lowlat && devbaud > 230400) {
+	     a= devbaud / 10000;
+	     tt.c_cc[VMIN]= a > 255 ? 255 : a;
+	     tt.c_cc[VTIME]= 1;
+	  }
 	  
 	  if (0) {	// xon/xoff
 	     tt.c_iflag |= IXON | IXOFF;
@@ -295,13 +556,31 @@ handle_dev_setup(Parse *pp) {
 	   case 57600: a= B57600; break;
 	   case 115200: a= B115200; break;
 	   case 230400: a= B230400; break;
-	   default: error("Serial port baud rate %d not supported", devbaud);
+	   default: a= 0; break;	// Non-standard rate
 	  }
+#ifndef LINUX_SERIAL
+	  if (!a) error("Serial port baud rate %d not supported", devbaud);
+#endif
 	  
-	  if (cfsetispeed(&tt, a) ||
-	      cfsetospeed(&tt, a) ||
+	  if (cfsetispeed(&tt, a ? a : B38400) ||
+	      cfsetospeed(&tt, a ? a : B38400) ||
 	      tcsetattr(dev->fd, TCSAFLUSH, &tt))
 	     error("Problem setting up serial port using termios: %s", devname);
+
+#ifdef LINUX_SERIAL
+	  // Any other rate is set directly using termios2 and BOTHER,
+	  // as far as the driver can manage it
+	  if (!a && 0 != set_baud_other(dev->fd, devbaud))
+	     error("Serial port baud rate %d not supported by %s: %s", 
+		   devbaud, devname, strerror(errno));
+	  if (dev->lowlat) {
+	     struct serial_struct ser;
+	     if (0 != ioctl(dev->fd, TIOCGSERIAL, &ser) ||
+		 (ser.flags |= ASYNC_LOW_LATENCY, 
+		  0 != ioctl(dev->fd, TIOCSSERIAL, &ser)))
+		applog("    \x98""lowlat: device doesn't support ASYNC_LOW_LATENCY");
+	  }
+#endif
        }      
 #endif
        break;
@@ -313,67 +592,448 @@ handle_dev_setup(Parse *pp) {
    //	Setup the sample clock
    //	
    
-   clock_setup(&dev->clock, dev->rate, time_now_ms());
-   
+   clock_setup(&dev->clock, dev->rate, time_now_us());
+
    //
-   //	Setup the buffers
+   //	Open the file backing a long history.  The buffers are set
+   //	up in dev_start(), once it is known which device the pages
+   //	will read from.
    //
 
-   // Incoming buffer
-   dev->ilen= 1024;
+   if (dev->hist_file && !dev->hist)
+      return line_error(pp, 0, "'history-file' needs a 'history' length");
+   if (dev->hist * dev->rate > HIST_MAX)
+      return line_error(pp, 0, "'history' is too long; the limit is %d samples", HIST_MAX);
+   if (dev->hist) {
+#ifdef UNIX_MMAP
+      dev->hist_fp= dev->hist_file ? fopen(dev->hist_file, "w+b") : tmpfile();
+      if (!dev->hist_fp) 
+	 return line_error(pp, 0, "Unable to create history file: %s", 
+			   dev->hist_file ? dev->hist_file : strerror(errno));
+#else
+      applog("    \x98""history is kept in memory on this platform");
+#endif
+   }
+
+   // Add to the list; reading starts in dev_start() once all the
+   // [*-dev] sections have been seen
+   *prvp= dev;
+   return 0;
+}
+
+#ifdef LINUX_SERIAL
+//
+//	Set an arbitrary baud rate using the Linux termios2 interface.
+//	glibc doesn't provide struct termios2, and the kernel's
+//	<asm/termbits.h> clashes with <termios.h>, so the kernel
+//	structure is declared here.  Returns 0 on success.
+//
+
+struct termios2 {
+   tcflag_t c_iflag;
+   tcflag_t c_oflag;
+   tcflag_t c_cflag;
+   tcflag_t c_lflag;
+   cc_t c_line;
+   cc_t c_cc[19];	// Kernel NCCS
+   speed_t c_ispeed;
+   speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+static int 
+set_baud_other(int fd, int baud) {
+   struct termios2 t2;
+   
+   if (0 != ioctl(fd, TCGETS2, &t2)) return -1;
+   t2.c_cflag &= ~CBAUD;
+   t2.c_cflag |= BOTHER;
+   t2.c_ispeed= baud;
+   t2.c_ospeed= baud;
+   return ioctl(fd, TCSETS2, &t2);
+}
+#endif
+
+//
+//	Returns true if dev_start() has already been called
+//
+
+int 
+dev_started() {
+   return dev != 0;
+}
+
+//
+//	Start input running on the device or devices set up by the
+//	[*-dev] sections.  This is called before handling the first
+//	section which isn't a [*-dev] section, and again at the end of
+//	the config file, and only does anything the first time.
+//
+//	With a single device, it becomes 'dev', and a thread is started
+//	to handle its input as before (unless it is being handled from
+//	the audio callback).  With several, a merged device is created
+//	as 'dev' with all the channels of the sub-devices side by side,
+//	and one thread reads all the sub-devices and merges their
+//	samples.  Returns 0 on success, else 1 (after logging the
+//	error).
+//
+
+int 
+dev_start() {
+   Device *dd, *mm= dev_list;
+   Sint64 now;
+
+   if (dev || !mm) return 0;
+   now= time_now_us();
+   for (dd= mm; dd; dd= dd->nxt) {
+      if (dd->file) dd->file_t0= now;
+      if (dd->synth) dd->synth->t0= now;
+   }
+
+   if (!mm->nxt) {
+      dev= mm;
+      setup_buffers(dev);
+      if (!server) setup_planes(dev);
+      if (server) server_cur= cursor_new("server", CUR_SKIP, 0, 0);
+
+      // Start a thread to handle serial input from now on, unless we
+      // will be handling serial from the audio callback, or the
+      // batch code is driving the input itself.
+      if (batch_in) 
+	 ;
+      else if (dev->synth) {
+	 if (!SDL_CreateThread(synth_thread, dev))
+	    errorSDL("Problem starting synth thread off");
+      } else if (dev->file || !dev->audio) {
+	 if (!SDL_CreateThread(dev->file ? file_thread : serial_thread, dev))
+	    errorSDL("Problem starting serial thread off");
+      }
+      dev->init_complete= 1;
+      return 0;
+   }
+
+#ifndef UNIX_SERIAL
+   return applog("\x82 Multiple [*-dev] sections are only supported on UNIX");
+#else
+   // Merged device takes its rate, range and flags from the first
+   // device, which is also the master for timing
+   dev= ALLOC(Device);
+   dev->subs= mm;
+   dev->rate= mm->rate;
+   dev->min= mm->min;
+   dev->max= mm->max;
+   dev->n_flag= mm->n_flag;
+   dev->width= mm->width;
+   dev->catchup= mm->catchup;
+   dev->hist= mm->hist;		// Only the merged device needs a long history
+   dev->hist_fp= mm->hist_fp;
+   mm->hist= 0;
+   mm->hist_fp= 0;
+   for (dd= mm; dd; dd= dd->nxt) {
+      setup_buffers(dd);
+      if (fabs(dd->rate - mm->rate) > mm->rate * 0.001 ||
+	  dd->min != mm->min || dd->max != mm->max || dd->width != mm->width) 
+	 return applog("\x82 All [*-dev] devices must have the same sampling "
+		       "rate, value range and width to be merged");
+      if (dd->audio) {
+	 applog("    \x98""audio-sync ignored with multiple devices");
+	 dd->audio= 0;
+      }
+      // Reads must not wait for VMIN bytes on one device whilst
+      // the others are waiting
+      if (!dd->file && !dd->synth) 
+	 fcntl(dd->fd, F_SETFL, fcntl(dd->fd, F_GETFL) | O_NONBLOCK);
+      dd->merged= dev;
+      dd->chan0= dev->n_chan;
+      dev->n_chan += dd->n_chan;
+      dd->mrd= dd->mlast= dd->wr - 1;
+   }
+   mm->mrd= mm->wr;
+   clock_setup(&dev->clock, dev->rate, now);
+   setup_buffers(dev);
+   if (!server) setup_planes(dev);
+   if (server) server_cur= cursor_new("server", CUR_SKIP, 0, 0);
+   applog("    merging %d channels from several devices", dev->n_chan);
+
+   if (!SDL_CreateThread(merge_thread, dev))
+      errorSDL("Problem starting serial thread off");
+   for (dd= mm; dd; dd= dd->nxt) dd->init_complete= 1;
+   dev->init_complete= 1;
+   return 0;
+#endif
+}
+
+//
+//	Create a new cursor and add it to the registry.  It starts at
+//	the current write position.  'policy' is CUR_SKIP or
+//	CUR_RESYNC, or -1 to use the device's 'catchup' setting.  A
+//	cursor with no resync() routine can only skip.
+//
+
+Cursor *
+cursor_new(char *name, int policy, void (*resync)(void*), void *vp) {
+   Cursor *cc= ALLOC(Cursor), **prvp;
+
+   cc->name= StrDup(name);
+   cc->rd= DEV_WR(dev);
+   cc->policy= policy < 0 ? dev->catchup : policy;
+   cc->resync= resync;
+   cc->vp= vp;
+   if (!resync) cc->policy= CUR_SKIP;
+
+   for (prvp= &cursors; *prvp; prvp= &(*prvp)->nxt) ;
+   *prvp= cc;
+   return cc;
+}
+
+//
+//	Update the cursor's lag, and if it has been lapped, apply its
+//	catch-up policy.  Returns the write position, which the
+//	consumer may read up to.
+//
+
+Sint64 
+cursor_check(Cursor *cc) {
+   Sint64 wr= DEV_WR(dev);
+   int lag;
+
+   if (wr - cc->rd > dev->n_smp - SAMPLE_GUARD) {
+      cursor_lapped(cc);
+      wr= DEV_WR(dev);
+   }
+   lag= (int)(wr - cc->rd);
+   cc->lag= lag;
+   if (lag > cc->lag_max) cc->lag_max= lag;
+   return wr;
+}
+
+//
+//	Handle a cursor that has been lapped, either found by
+//	cursor_check() or by the consumer failing a SAMPLE_OK() check
+//	on a sample it has just read.
+//
+
+void 
+cursor_lapped(Cursor *cc) {
+   cc->lapped++;
+   if (cc->policy == CUR_RESYNC) 
+      cc->resync(cc->vp);
+   else 
+      cc->rd= DEV_WR(dev);
+}
+
+//
+//	Setup the format-handler for the given format name.  Returns 0
+//	on success, or an error message.
+//
+
+static char *
+setup_format(Device *dev, char *fmtname, int devtype) {
+   static char msg[160];
+
+   if (0 == strcmp(fmtname, "OpenBCI")) {
+      if (dev->n_chan <= 0 || dev->n_chan > 8) 
+	 dev->n_chan= 8;
+      if (!dev->rate) dev->rate= 250.0;
+      dev->handler= openbci_handler;
+      if (!dev->width) dev->width= 4;
+      dev->min= dev->width == 4 ? -0x800000 : -0x8000;
+      dev->max= dev->width == 4 ? 0x7FFFFF : 0x7FFF;
+      dev->n_flag= 0;
+      return 0;
+   }
+
+   // Other formats have no more than 16 bits
+   if (dev->width == 4 && 0 != strcmp(fmtname, "auto")) {
+      sprintf(msg, "Format '%.100s' only supports 'width 16'", fmtname);
+      return msg;
+   }
+
+   if (0 == strcmp(fmtname, "modEEGold") ||
+       0 == strcmp(fmtname, "modEEG-P2")) {
+      if (dev->n_chan <= 0 || dev->n_chan > 6) 
+	 dev->n_chan= 6;
+      dev->rate= 256.0;
+      dev->handler= modEEGold_handler;
+      dev->min= 0;
+      dev->max= 1023;
+      if (dev->n_flag > 4) dev->n_flag= 4;
+      if (dev->n_flag < 0) dev->n_flag= 0;
+   } else if (0 == strcmp(fmtname, "modEEG") ||
+	      0 == strcmp(fmtname, "modEEG-P3")) {
+      if (dev->n_chan <= 0 || dev->n_chan > 6) 
+	 dev->n_chan= 6;
+      dev->rate= 256.0;
+      dev->handler= modEEG_handler;
+      dev->min= 0;
+      dev->max= 1023;
+      dev->ierr= 1;		// Ignore the first partial packet
+      if (dev->n_flag > 4) dev->n_flag= 4;
+      if (dev->n_flag < 0) dev->n_flag= 0;
+   } else if (0 == strcmp(fmtname, "jim-m")) {
+      if (dev->n_chan != 2 && dev->n_chan != 4)
+	 return "Expecting 2 or 4 channels for jim-m format type";
+      if (!dev->rate) dev->rate= (dev->n_chan == 2) ? 140.0 : 130.0;
+      dev->handler= jm_handler;
+      dev->min= 0;
+      dev->max= 255;
+      dev->n_flag= 0;
+   } else if (0 == strcmp(fmtname, "auto")) {
+      if (devtype != 3) 
+	 return "Format 'auto' only possible with a server connection";
+   } else if (0 == strcmp(fmtname, "jm2")) {
+      return "Type 'jm2' deprecated; please use 'fmt jim-m; chan 2;'";
+   } else if (0 == strcmp(fmtname, "jm4")) {
+      return "Type 'jm4' deprecated; please use 'fmt jim-m; chan 4;'";
+   } else {
+      sprintf(msg, "Serial format '%.100s' not known", fmtname);
+      return msg;
+   }
+   return 0;
+}
+
+//
+//	Allocate the incoming byte buffer and the sample buffer, once
+//	the rate and channel count are known and the clock is set up
+//
+
+static void 
+setup_buffers(Device *dev) {
+   int a;
+
+   // Incoming buffer; default 1024, else rounded up to a power of two
+   if (dev->ilen <= 0) dev->ilen= 1024;
+   while (dev->ilen & (dev->ilen-1)) dev->ilen= (dev->ilen | (dev->ilen-1)) + 1;
    dev->imask= dev->ilen-1;
    dev->ibuf= Alloc(dev->ilen);
    dev->ird= dev->iwr= 0;
 
    // Sample buffer
    {
-      // Length is smallest power of two to contain 10 seconds' worth of data
-      int n_smp= (int)(dev->rate * 10);		// 10 seconds' worth of data
-      n_smp= n_smp*2-1; 
-      while (n_smp & (n_smp-1)) n_smp &= n_smp-1;
-
-      dev->s_smp= sizeof(Sample) 
-	 - 2 * sizeof(short)
-	 + sizeof(short) * ((dev->n_chan + 1) & ~1);
-      dev->s_smp= (dev->s_smp + (sizeof(int)-1)) & ~(sizeof(int)-1);
+      // Length is smallest power of two to contain the history,
+      // by default 10 seconds' worth of data
+      double want= dev->rate * (dev->hist ? dev->hist : HIST_DEFAULT);
+      int n_smp= 1;
+      if (want > HIST_MAX)
+	 error("'history' of %g seconds is too long; the limit is %d samples", 
+	       dev->hist, HIST_MAX);
+      while (n_smp < want) n_smp <<= 1;
+
+      if (!dev->width) dev->width= 2;
+      dev->s_smp= offsetof(Sample, val) 
+	 + dev->width * ((dev->n_chan + 1) & ~1);
+      dev->s_smp= (dev->s_smp + (sizeof(Sint64)-1)) & ~(sizeof(Sint64)-1);
       dev->n_smp= n_smp;
       dev->mask= n_smp-1;
-      dev->smp= Alloc(dev->n_smp * dev->s_smp);
+      dev->smp= hist_alloc(dev, (double)dev->n_smp * dev->s_smp);
       dev->wr= 0;
    }
 
-   // Fill in reasonable time values as a safety-net for searching code
-   for (a= 1; a<=dev->n_smp; a++) {
-      Sample *ss= SAMPLE(dev->n_smp-a);
+   // Fill in reasonable time values as a safety-net for searching
+   // code, as far back as a default-sized buffer would go.  (Doing
+   // the whole of a long history would write out all of its file.)
+   for (a= 1; a<=dev->n_smp && a <= dev->rate * HIST_DEFAULT; a++) {
+      Sample *ss= SAMPLE(dev->wr - a);
       ss->time= dev->clock.clock - a * dev->clock.clockinc;
    }
+}
 
-   //
-   //	Start a thread to handle serial input from now on, unless we
-   //	will be handling serial from the audio callback.
-   // 
+//
+//	Setup the normalised channel planes for the device that the
+//	pages will read from.  Not needed in server mode, which has no
+//	pages.
+//
 
-   if (dev->file || !dev->audio) {
-      if (!SDL_CreateThread(devtype == 2 ? file_thread : serial_thread, 0))
-	 errorSDL("Problem starting serial thread off");
+static void 
+setup_planes(Device *dev) {
+   size_t adj;
+   int a;
+
+   dev->p_stride= dev->n_smp + PLANE_ALIGN / sizeof(float);
+   dev->plane_mem= hist_alloc(dev, (double)dev->n_chan * dev->p_stride * sizeof(float) + PLANE_ALIGN);
+   adj= (size_t)dev->plane_mem & (PLANE_ALIGN-1);
+   dev->plane= (float*)(dev->plane_mem + (adj ? PLANE_ALIGN - adj : 0));
+   dev->p_mid= (dev->min + dev->max + 1) / 2;
+   dev->p_mul= (float)(2.0 / (dev->max + 1 - dev->min));
+
+   // Convert anything already in the buffer
+   for (a= 1; a<=dev->n_smp && a<=dev->wr; a++) 
+      sample_planes(dev, dev->wr - a);
+}
+
+//
+//	Allocate zeroed memory for the sample buffer or planes.  With a
+//	long history this is mapped from the next part of the history
+//	file, so that the kernel can page it out to disk as required
+//	instead of it all having to stay in RAM.
+//
+
+static void *
+hist_alloc(Device *dev, double len) {
+#ifdef UNIX_MMAP
+   if (dev->hist_fp) {
+      long pgsiz= sysconf(_SC_PAGESIZE);
+      off_t off= (off_t)dev->hist_len;
+      size_t siz= (size_t)((len + pgsiz - 1) / pgsiz) * pgsiz;
+      void *map;
+      if (0 != ftruncate(fileno(dev->hist_fp), off + siz))
+	 error("Unable to extend history file to %.0f bytes: %s", 
+	       (double)(off + siz), strerror(errno));
+      map= mmap(0, siz, PROT_READ | PROT_WRITE, MAP_SHARED, 
+		fileno(dev->hist_fp), off);
+      if (map == MAP_FAILED)
+	 error("Unable to map history file: %s", strerror(errno));
+      dev->hist_len += siz;
+      return map;
    }
+#endif
+   if (len > INT_MAX)
+      error("Not enough memory for %.0f bytes of history", len);
+   return Alloc((int)len);
+}
 
-   // All done
-   dev->init_complete= 1;
-   return 0;
+//
+//	Fill in the planes for sample 'seq'.  Called from
+//	SAMPLE_PUBLISH() just before the sample is published.
+//
+
+void 
+sample_planes(Device *dev, Sint64 seq) {
+   Sample *ss= SAMPLE(seq);
+   float *pp= dev->plane + (int)(seq & dev->mask);
+   int stride= dev->p_stride;
+   int mid= dev->p_mid;
+   float mul= dev->p_mul;
+   int a, n_chan= dev->n_chan;
+
+   if (dev->width == 4) {
+      int *sv= ((Sample32*)ss)->val;
+      for (a= 0; a<n_chan; a++, pp += stride)
+	 *pp= (float)(sv[a] - mid) * mul;
+   } else {
+      short *sv= ss->val;
+      for (a= 0; a<n_chan; a++, pp += stride)
+	 *pp= (float)(sv[a] - mid) * mul;
+   }
 }
 
 //
 //	Read and process all outstanding samples on the serial port.
-//	'now' is the current time, or 0 if a time_now_ms() call should
+//	'now' is the current time in us, or 0 if a time_now_us() call should
 //	be made.
 //
 
-static void process_input(char *buf, int len);
+static void process_input(Device *dev, char *buf, int len);
+static int input_room(Device *dev, int len);
+static void input_added(Device *dev, int cnt);
+static void input_done(Device *dev);
 
 #ifdef WIN_SERIAL
 static void 
-serial_read(int now) {
+serial_read(Device *dev, Sint64 now) {
    BYTE buf[512];
    BOOL rv;
    COMSTAT comStat;
@@ -397,21 +1057,37 @@ serial_read(int now) {
       }
    }
    
-   if (len) process_input(buf, len);
+   if (len) process_input(dev, buf, len);
 }
 #endif
 
 #ifdef UNIX_SERIAL
+//
+//	Read straight into the free space in ibuf, as much as is
+//	waiting (or at least one byte), rather than through a copy
+//
+
 static void 
-serial_read(int now) {
-   char buf[512];
-   int len;
+serial_read(Device *dev, Sint64 now) {
+   int want, cnt, len, iwr0;
 
    dev->now= now;
+
+   if (0 != ioctl(dev->fd, FIONREAD, &want) || want < 1) want= 1;
+   cnt= input_room(dev, want);
+   if (cnt > dev->ilen - dev->iwr) cnt= dev->ilen - dev->iwr;
    
-   len= read(dev->fd, buf, sizeof(buf));
+   iwr0= dev->iwr;
+   len= read(dev->fd, dev->ibuf + iwr0, cnt);
    if (len > 0) {
-      process_input(buf, len);
+      dev->in_bytes += len;
+      input_added(dev, len);
+      input_done(dev);
+      
+      // Raw dump from ibuf; the handler only moves ird on, so the
+      // bytes are still there
+      if (dev->rawdump) 
+	 rawdump_put(dev->rawdump, dev->ibuf + iwr0, len);
    } else if (len < 0) {
       if (errno != EAGAIN && errno != EINTR)
 	 error("Serial port read error: %s", strerror(errno));
@@ -426,6 +1102,7 @@ serial_read(int now) {
 
 int 
 serial_thread(void *vp) {
+   Device *dev= vp;
 
 #ifdef WIN_SERIAL
    while (1) {
@@ -434,7 +1111,7 @@ serial_thread(void *vp) {
       WaitCommEvent(dev->hPort, &dwEvtMask, NULL);
       
       if ((dwEvtMask & EV_RXCHAR) == EV_RXCHAR)
-	 serial_read(0);
+	 serial_read(dev, 0);
    }
 #endif
 
@@ -442,58 +1119,256 @@ serial_thread(void *vp) {
    // The device will have been set to blocking reads, so there is no
    // need to have separate wait/read code
    while (1) 
-      serial_read(0);
+      serial_read(dev, 0);
 #endif
    
    return 0;
 }
 
 //
-//	Main thread for file input
+//	Fetch up to 'len' bytes of file input, returning a pointer to
+//	them in *datp, and the count.  Data comes straight from the
+//	mapping if the file is mmap'd, else it is read in blocks into
+//	'buf' (which must be FILE_BLOCK bytes).  Returns 0 on EOF.
+//
+
+#define FILE_BLOCK 16384
+
+static int 
+file_fetch(Device *dev, char **datp, char *buf, long len) {
+   if (dev->file_map) {
+      if (len > dev->file_len - dev->file_pos) 
+	 len= dev->file_len - dev->file_pos;
+      *datp= dev->file_map + dev->file_pos;
+   } else {
+      if (len > FILE_BLOCK) len= FILE_BLOCK;
+      len= fread(buf, 1, len, dev->file);
+      *datp= buf;
+   }
+   if (len > 0) dev->file_pos += len;
+   return len < 0 ? 0 : len;
+}
+
+//
+//	Hand over the next tick's worth of file input.  Bytes are
+//	handed over all in one go, paced according to the time since
+//	the start so that errors don't accumulate.  In 'max' mode a
+//	block is handed over each call, and the timestamps are
+//	generated from the sample rate rather than the real time, as
+//	if it had been replayed at normal speed.  Returns 0 on EOF.
+//
+
+int 
+file_tick(Device *dev) {
+   char buf[FILE_BLOCK];
+   char *dat;
+   Sint64 wr, now;
+   long due, len;
+
+   if (dev->file_max) {
+      // Timestamp the block with the time its last sample would
+      // have arrived, estimated from the previous block
+      due= dev->file_pos + 1024;
+      dev->now= dev->file_t0 + 
+	 (Sint64)((dev->file_nsmp + dev->file_last) * 1e6 / dev->rate);
+      if (!dev->now) dev->now= 1;
+   } else {
+      now= time_now_us();
+      dev->file_cc= dev->file_cps * (now - dev->file_t0) * 1e-6;
+      due= (long)dev->file_cc;
+      dev->now= now;
+   }
+
+   wr= dev->wr;
+   while (dev->file_pos < due) {
+      if (!(len= file_fetch(dev, &dat, buf, due - dev->file_pos))) {
+	 now= time_now_us();
+	 applog("\x82 EOF \x86  Reached end of input file after %ld bytes, "
+		"%.1f seconds", dev->file_pos, (now - dev->file_t0) * 1e-6);
+	 dev->file_eof= 1;
+	 return 0;
+      }
+      process_input(dev, dat, len);
+   }
+   dev->file_last= (int)(dev->wr - wr);
+   dev->file_nsmp += dev->file_last;
+   return 1;
+}
+
+//
+//	Main thread for file input, ticking every 10ms
 //
 
 int 
 file_thread(void *vp) {
-   int then, now;
-   int cc0, cc1;
+   Device *dev= vp;
 
-   then= time_now_ms();
    while (1) {
-      SDL_Delay(10);
-      now= time_now_ms();
-      cc0= (int)dev->file_cc;
-      dev->file_cc += dev->file_cps * (now-then) * 0.001;
-      cc1= (int)dev->file_cc;
-      then= now;
-      dev->now= now;
+      if (!dev->file_max) SDL_Delay(10);
+      if (!file_tick(dev)) 
+	 return 0;		// EOF -- nothing more to do
+   }
+   
+   return 0;
+}
+
+#ifdef UNIX_SERIAL
 
-      for (; cc0 != cc1; cc0++) {
-	 char buf[1];
-	 int ch= fgetc(dev->file);
-	 if (ch < 0) {
-	    applog("\x82 EOF \x86  Reached end of input file");
-	    return 0;		// EOF -- nothing more to do
+//
+//	Thread that handles input for all the sub-devices of a merged
+//	device.  Serial ports and sockets are waited on together with
+//	poll(), and file input is ticked along at the same time, after
+//	which any new samples are merged.
+//
+
+int 
+merge_thread(void *vp) {
+   Device *dev= vp;
+   Device *dd;
+   Device **pdev;
+   struct pollfd *pfd;
+   int a, n, cnt, tmo;
+   Sint64 now;
+
+   for (cnt= 0, dd= dev->subs; dd; dd= dd->nxt) cnt++;
+   pdev= ALLOC_ARR(cnt, Device*);
+   pfd= ALLOC_ARR(cnt, struct pollfd);
+
+   while (1) {
+      n= 0; tmo= 10;
+      for (dd= dev->subs; dd; dd= dd->nxt) {
+	 if (dd->file) {
+	    if (dd->file_max && !dd->file_eof) tmo= 0;
+	    continue;
 	 }
-	 buf[0]= ch;
-	 process_input(buf, 1);
+	 if (dd->synth) {
+	    if (tmo > 1) tmo= 1;
+	    continue;
+	 }
+	 pfd[n].fd= dd->fd;
+	 pfd[n].events= POLLIN;
+	 pfd[n].revents= 0;
+	 pdev[n++]= dd;
       }
+
+      if (0 > poll(pfd, n, tmo) && errno != EINTR)
+	 error("poll() failed on input devices: %s", strerror(errno));
+      
+      now= time_now_us();
+      for (a= 0; a<n; a++) 
+	 if (pfd[a].revents) 
+	    serial_read(pdev[a], now);
+
+      for (dd= dev->subs; dd; dd= dd->nxt) 
+	 if (dd->file && !dd->file_eof) 
+	    file_tick(dd);
+	 else if (dd->synth)
+	    synth_tick(dd);
+
+      dev_merge(dev, time_now_us());
+
+      // Relay new data to client if in server mode
+      if (server_cur && dev->wr != server_cur->rd)
+	 server_handler();
    }
    
    return 0;
 }
 
+#endif
+
+//
+//	Merge new samples from the sub-devices into the merged device.
+//	Each sample from the master (first) device gives one merged
+//	sample, and from each of the other devices the sample nearest
+//	in clock time is taken.  A device whose clock runs slightly
+//	fast will occasionally have a sample dropped, and one that
+//	runs slow will have one duplicated, so drift between the
+//	devices is absorbed without the streams sliding apart.  If a
+//	device hasn't caught up after MERGE_TIMEOUT, its channels are
+//	filled with the mid-point value and marked with an error.
+//
+
+static void 
+dev_merge(Device *dev, Sint64 now) {
+   Device *mm= dev->subs;
+   Device *dd;
+   Sample *ms, *ss, *s1;
+   Sint64 c, nx, tt;
+   int late, a;
+   int mid= (dev->min + dev->max + 1) / 2;
+
+   while (mm->mrd != mm->wr) {
+      ms= DEV_SAMPLE(mm, mm->mrd);
+      tt= ms->time;
+      late= now - ms->stamp > MERGE_TIMEOUT;
+
+      // Choose a sample from each of the other devices
+      for (dd= mm->nxt; dd; dd= dd->nxt) {
+	 // Skip past samples that are no nearer than the following one
+	 c= dd->mrd;
+	 while ((nx= c+1) != dd->wr &&
+		DEV_SAMPLE(dd, nx)->time - tt <= 0)
+	    c= nx;
+	 dd->mrd= c;
+
+	 dd->mstale= 0;
+	 if (DEV_SAMPLE(dd, c)->time - tt >= 0) 
+	    dd->mpick= c;
+	 else if (nx != dd->wr) 
+	    dd->mpick= (tt - DEV_SAMPLE(dd, c)->time <= 
+			DEV_SAMPLE(dd, nx)->time - tt) ? c : nx;
+	 else if (late)
+	    dd->mstale= 1;
+	 else 
+	    return;		// Wait for more data to arrive
+      }
+
+      // Write out the merged sample
+      ss= SAMPLE(dev->wr);
+      memset(ss, 0, dev->s_smp);
+      ss->stamp= ms->stamp;
+      ss->time= ms->time;
+      ss->err= ms->err;
+      ss->flags= ms->flags;
+      memcpy(ss->val, ms->val, mm->n_chan * dev->width);
+      for (dd= mm->nxt; dd; dd= dd->nxt) {
+	 if (dd->mstale) {
+	    for (a= 0; a<dd->n_chan; a++) {
+	       if (dev->width == 4) 
+		  ((Sample32*)ss)->val[dd->chan0 + a]= mid;
+	       else 
+		  ss->val[dd->chan0 + a]= mid;
+	    }
+	    ss->err= 1;
+	    continue;
+	 }
+	 s1= DEV_SAMPLE(dd, dd->mpick);
+	 memcpy(SAMPLE_VALP(dev, ss, dd->chan0), s1->val, dd->n_chan * dev->width);
+	 if (s1->err) ss->err= 1;
+	 if (dd->mpick == dd->mlast) 
+	    dd->m_dup++;
+	 else 
+	    dd->m_drop += (int)(dd->mpick - dd->mlast) - 1;
+	 dd->mlast= dd->mpick;
+      }
+      SAMPLE_PUBLISH(dev);
+      mm->mrd++;
+   }
+}
+
 //
 //	Audio thread callback.  Does nothing if we have our own serial
 //	thread, otherwise fetches everything we can.
 //
 
 void 
-serial_audio_callback(int now) {
+serial_audio_callback(Sint64 now) {
    if (dev && 
        dev->init_complete && 
        dev->audio && 
        !dev->file)
-      serial_read(now);
+      serial_read(dev, now);
 }
 
 
@@ -502,42 +1377,122 @@ serial_audio_callback(int now) {
 //	buffer, and the format-type handler is given a chance to
 //	update its state.
 //
+//	If a burst arrives that won't fit in the buffer, then what
+//	happens depends on the overflow policy.  With 'block', the
+//	handler is run as often as necessary to make room, so nothing
+//	is lost.  With 'drop', the oldest undecoded bytes are thrown
+//	away to make room for the newest ones, keeping the work done
+//	per call bounded.  The handler sees the dropped bytes as a
+//	sync error.  Dropping also happens under 'block' if the
+//	handler is unable to make any room, rather than spinning.
+//
 
 static void 
-process_input(char *buf, int len) {
+drop_input(Device *dev, int cnt) {
+   dev->ird= (dev->ird + cnt) & dev->imask;
+   dev->in_drop += cnt;
+   dev->ierr += cnt;
+   if (dev->ierr > 255) dev->ierr= 255;	// Keep it within ss->err range
+}
+
+//
+//	Make room in ibuf for up to 'len' more bytes according to the
+//	overflow policy, and return the number of bytes free, which is
+//	at least 1.  With 'overflow block' the handler is run to decode
+//	what it can, and the caller may get less room than it asked
+//	for; with 'overflow drop' the oldest bytes are dropped.
+//
+
+static int 
+input_room(Device *dev, int len) {
+   int free= (dev->ird-1 - dev->iwr) & dev->imask;
+
+   if (len > dev->imask) len= dev->imask;
+   if (free >= len) return free;
+
+   if (dev->overflow) {
+      drop_input(dev, len - free);
+      return len;
+   }
+   
+   // Buffer full: let the handler decode what it can to make room
+   dev->handler(dev);
+   free= (dev->ird-1 - dev->iwr) & dev->imask;
+   if (free == 0) {
+      // Handler is stuck, so drop rather than spinning
+      drop_input(dev, len);
+      free= len;
+   }
+   return free;
+}
+
+//
+//	Account for 'cnt' bytes just written into ibuf at dev->iwr
+//
+
+static void 
+input_added(Device *dev, int cnt) {
+   int fill;
+   
+   dev->iwr += cnt;
+   dev->iwr &= dev->imask;
+   fill= (dev->iwr - dev->ird) & dev->imask;
+   if (fill > dev->in_peak) dev->in_peak= fill;
+}
+
+//
+//	Decode new input and pass on the results
+//
+
+static void 
+input_done(Device *dev) {
+   dev->handler(dev);
+
+   // Relay new data to client if in server mode
+   if (server_cur && !dev->merged && dev->wr != server_cur->rd)
+      server_handler();
+}
+
+static void 
+process_input(Device *dev, char *buf, int len) {
    char *buf0= buf;
    int len0= len;
+   int cnt;
+
+   dev->in_bytes += len;
+
+   // Drop policy: only the newest bytes of a burst bigger than the
+   // whole buffer can be kept
+   if (dev->overflow && len > dev->imask) {
+      cnt= len - dev->imask;
+      dev->in_drop += cnt;
+      dev->ierr= 255;
+      buf += cnt; len -= cnt;
+   }
+
    while (len > 0) {
-      int free= (dev->ird-1 - dev->iwr) & dev->imask;
-      int cnt= (dev->ilen-dev->iwr);
-      if (cnt > free) cnt= free;
+      cnt= input_room(dev, len);
+      if (cnt > dev->ilen - dev->iwr) cnt= dev->ilen - dev->iwr;
       if (cnt > len) cnt= len;
 
       memcpy(dev->ibuf+dev->iwr, buf, cnt);
-      dev->iwr += cnt;
-      dev->iwr &= dev->imask;
+      input_added(dev, cnt);
       buf += cnt;
       len -= cnt;
    }
-   dev->handler();
-
-   // Relay new data to client if in server mode
-   if (server && dev->wr != server_rd)
-      server_handler();
+   input_done(dev);
 
    // Leave raw dump output until the end for timing reasons
-   if (dev->rawdump) {
-      if (1 != fwrite(buf0, len0, 1, dev->rawdump))
-	 applog("Write error on 'dump.raw'");
-   }
+   if (dev->rawdump) 
+      rawdump_put(dev->rawdump, buf0, len0);
 }
 
 //
 //	Format handlers.  Note that format handlers should use the
 //	dev->now value for timestamps if it is non-0, else call
-//	time_now_ms() and fill dev->now themselves if/when they find
+//	time_now_us() and fill dev->now themselves if/when they find
 //	that they need a timestamp value.  This saves the overhead of
-//	multiple calls to time_now_ms() for long packets, and also
+//	multiple calls to time_now_us() for long packets, and also
 //	wasted single calls to it when only a couple of bytes have
 //	arrived.
 //
@@ -545,83 +1500,109 @@ process_input(char *buf, int len) {
 //
 //	Handler for old modularEEG data format (P2)
 //
+//	Packets are 17 bytes: A5 5A, version, counter, 6 big-endian
+//	10-bit channel values, and a flags byte.  To keep the cost per
+//	byte down at high baud rates, the sync byte is searched for
+//	with memchr() across whole linear spans of the circular
+//	buffer, and complete packets are decoded in place rather than
+//	being copied out byte by byte.  Only a packet that straddles
+//	the end of the buffer gets copied into 'tmp'.
+//
+
+static void 
+modEEGold_syncerr(Device *dev, int cnt) {
+   Sample *ss;
    
+   // Every 17 bytes scanned without finding anything gives a sync
+   // error.  That way if data is coming through but it is all bad,
+   // then something will at least appear on the screen, even though
+   // it is all marked with errors.
+   while (cnt > 0) {
+      int need= 17 - dev->ierr;
+      if (need < 1) need= 1;
+      if (need > cnt) { dev->ierr += cnt; break; }
+      cnt -= need;
+      ss= SAMPLE(dev->wr);
+      memset(ss, 0, dev->s_smp);
+      ss->stamp= dev->now;
+      ss->time= clock_inc(&dev->clock, dev->now);
+      ss->err= 1;
+      SAMPLE_PUBLISH(dev);
+      applog("\x82 Sync error \x86  Sync bytes missing from serial input stream");
+      dev->ierr= 0;
+   }
+}
+
 void 
-modEEGold_handler() {
-   int avail;
+modEEGold_handler(Device *dev) {
+   int avail, cnt;
    int rd= dev->ird;
    int wr= dev->iwr;
    char *buf= dev->ibuf;
    int mask= dev->imask;
-   int err= 0;
-   int err0;
+   int err, err0;
    int a;
    unsigned char tmp[15];
+   unsigned char *pkt;
+   char *p;
    Sample *ss;
 
-#define INC_rd { rd++; rd &= mask; }
-
-   while (rd != wr) { 
+   while (1) {
       avail= (wr-rd) & mask;
       if (avail < 17) return;
-      if (!dev->now) dev->now= time_now_ms();
+      if (!dev->now) dev->now= time_now_us();
 
       if (buf[rd] != '\xA5') {
-	 INC_rd; dev->ird= rd;		// Byte definitely read
-	 dev->ierr++; 
-	 if (dev->ierr >= 17) {	
-	    // If we've scanned 17 bytes and still not found anything,
-	    // write out a sync error.  That way if data is coming
-	    // through but it is all bad, then something will at least
-	    // appear on the screen, even though it is all marked with
-	    // errors.
-	    ss= SAMPLE(dev->wr);
-	    memset(ss, 0, dev->s_smp);
-	    ss->stamp= dev->now;
-	    ss->time= clock_inc(&dev->clock, dev->now);
-	    ss->err= 1;
-	    SAMPLE_INC(dev->wr);
-	    applog("\x82 Sync error \x86  Sync bytes missing from serial input stream");
-	    dev->ierr= 0;
-	 }
+	 // Skip to the next sync byte, or as far as we can whilst
+	 // still leaving room for a whole packet
+	 cnt= dev->ilen - rd;
+	 if (cnt > avail-16) cnt= avail-16;
+	 p= memchr(buf+rd, 0xA5, cnt);
+	 if (p) cnt= p - (buf+rd);
+	 rd= (rd + cnt) & mask;
+	 dev->ird= rd;		// Bytes definitely read
+	 modEEGold_syncerr(dev, cnt);
 	 continue;
       }
-      INC_rd;
 
-      if (buf[rd] != '\x5A') {
-	 INC_rd; dev->ird= rd;		// Bad bytes definitely read
+      if (buf[(rd+1) & mask] != '\x5A') {
+	 rd= (rd + 2) & mask; dev->ird= rd;	// Bad bytes definitely read
 	 dev->ierr += 2; 
 	 continue;
       }
-      INC_rd;
 
-      for (a= 0; a<15; a++) {
-	 tmp[a]= buf[rd];
-	 INC_rd;
+      // Decode in place if the packet is contiguous
+      if (rd + 17 <= dev->ilen) 
+	 pkt= (unsigned char*)buf + rd + 2;
+      else {
+	 for (a= 0; a<15; a++) 
+	    tmp[a]= buf[(rd+2+a) & mask];
+	 pkt= tmp;
       }
+      rd= (rd + 17) & mask;
       dev->ird= rd;	// We have definitely read these bytes now
       err0= err= dev->ierr;
       dev->ierr= 0;
 
-      // @@@ Check version number (tmp[0] == 2) ?
+      // @@@ Check version number (pkt[0] == 2) ?
 
       // Check for counter sync errors
-      if (dev->hdata[0] != tmp[1] && 
+      if (dev->hdata[0] != pkt[1] && 
 	  dev->hdata[1]) {
 	    applog("\x82 Sync error \x86  Packet counter indicates %d missing packets",
-		   (tmp[1] - dev->hdata[0]) & 255);
-	    while (dev->hdata[0] != tmp[1]) {
+		   (pkt[1] - dev->hdata[0]) & 255);
+	    while (dev->hdata[0] != pkt[1]) {
 	       ss= SAMPLE(dev->wr);
 	       memset(ss, 0, dev->s_smp);
 	       ss->stamp= dev->now;
 	       ss->time= clock_inc(&dev->clock, dev->now);
 	       ss->err= 1;
-	       SAMPLE_INC(dev->wr);
+	       SAMPLE_PUBLISH(dev);
 	       dev->hdata[0]++;
 	       dev->hdata[0] &= 255;
 	    }
       }
-      dev->hdata[0]= ++tmp[1];
+      dev->hdata[0]= (pkt[1] + 1) & 255;
 
       // Write a new Sample entry
       ss= SAMPLE(dev->wr);
@@ -631,13 +1612,13 @@ modEEGold_handler() {
 
       // Grab the channel data.  Bad data gives error marks
       for (a= 0; a<dev->n_chan; a++) {
-         int val= (tmp[2*a+2]<<8) + tmp[2*a+3];
-         if (val < 0 || val >= 1024) { err++; val= 512; }
+         int val= (pkt[2*a+2]<<8) + pkt[2*a+3];
+         if (val >= 1024) { err++; val= 512; }
          ss->val[a]= val;
       }
 
       // Grab the flags
-      ss->flags= buf[14] & 15;
+      ss->flags= pkt[14] & 15;
 
       // Close off
       if (!dev->hdata[1]) { 
@@ -645,14 +1626,11 @@ modEEGold_handler() {
 	 err= 0; dev->hdata[1]= 1; 
       }
       ss->err= err;
-      SAMPLE_INC(dev->wr);
+      SAMPLE_PUBLISH(dev);
       if (err) applog(err0 ? 
 		      "\x82 Sync error \x86  Serial data loss" :
 		      "\x82 Data error \x86  Serial data errors");
-      err= 0;
    }
-
-#undef INC_rd
 }      
 
 //
@@ -704,7 +1682,7 @@ modEEGold_handler() {
 //
    
 void 
-modEEG_handler() {
+modEEG_handler(Device *dev) {
    int rd= dev->ird;
    int wr= dev->iwr;
    char *buf= dev->ibuf;
@@ -729,7 +1707,7 @@ modEEG_handler() {
       // Incomplete packet, so give up for now
       if (!sync && len < 11) return;
 
-      if (!dev->now) dev->now= time_now_ms();
+      if (!dev->now) dev->now= time_now_us();
       dev->ird= rd;		// Bytes definitely read
 
       // If we've scanned 11 bytes and not found a sync bit, write
@@ -742,7 +1720,7 @@ modEEG_handler() {
 	 ss->stamp= dev->now;
 	 ss->time= clock_inc(&dev->clock, dev->now);
 	 ss->err= 1;
-	 SAMPLE_INC(dev->wr);
+	 SAMPLE_PUBLISH(dev);
 	 applog("\x82 Sync error \x86  Sync byte missing from serial input stream");
 	 dev->ierr= 1;
 	 dev->hdata[0]++;	// Expecting one after
@@ -764,7 +1742,7 @@ modEEG_handler() {
 	 ss->stamp= dev->now;
 	 ss->time= clock_inc(&dev->clock, dev->now);
 	 ss->err= 1;
-	 SAMPLE_INC(dev->wr);
+	 SAMPLE_PUBLISH(dev);
 	 applog("\x82 Data error \x86  Packet of bad length (%d)", len);
 	 dev->hdata[0]++;	// Expecting one after
 	 continue;
@@ -786,7 +1764,7 @@ modEEG_handler() {
 	    ss->stamp= dev->now;
 	    ss->time= clock_inc(&dev->clock, dev->now);
 	    ss->err= 1;
-	    SAMPLE_INC(dev->wr);
+	    SAMPLE_PUBLISH(dev);
 	 }
       }
       dev->hdata[0]= p_cnt + 1;		// Next expected value
@@ -813,7 +1791,7 @@ modEEG_handler() {
       // Close off
       dev->hdata[1]= 1; 	// (ignore errors before first one)
       ss->err= 0;
-      SAMPLE_INC(dev->wr);
+      SAMPLE_PUBLISH(dev);
    }
 
 #undef INC_rd
@@ -824,7 +1802,7 @@ modEEG_handler() {
 //
    
 void 
-jm_handler() {
+jm_handler(Device *dev) {
    int avail;
    int rd= dev->ird;
    int wr= dev->iwr;
@@ -839,7 +1817,7 @@ jm_handler() {
    while (rd != wr) { 
       avail= (wr-rd) & mask;
       if (avail < pktsiz) return;
-      if (!dev->now) dev->now= time_now_ms();
+      if (!dev->now) dev->now= time_now_us();
       
       if (buf[rd] != 3) {
 	 INC_rd; dev->ird= rd;		// Byte definitely read
@@ -852,7 +1830,7 @@ jm_handler() {
 	    ss->stamp= dev->now;
 	    ss->time= clock_inc(&dev->clock, dev->now);
 	    ss->err= dev->ierr;
-	    SAMPLE_INC(dev->wr);
+	    SAMPLE_PUBLISH(dev);
 	    applog("\x82 Sync error \x86  Sync bytes missing from serial input stream");
 	    dev->ierr= 0;
 	 }
@@ -875,7 +1853,7 @@ jm_handler() {
 
       // Close off
       ss->err= dev->ierr;
-      SAMPLE_INC(dev->wr);
+      SAMPLE_PUBLISH(dev);
       if (dev->ierr) applog("\x82 Sync error \x86  Serial data loss");
       dev->ierr= 0;
    }
@@ -883,6 +1861,180 @@ jm_handler() {
 #undef INC_rd
 }      
 
+//
+//	Handler for OpenBCI (Cyton, ADS1299) data:
+//
+//	A0			packet header
+//	nn			sample counter, 0-255
+//	xx xx xx  (x8)		channels 1-8, 24-bit signed, big-endian
+//	xx xx  (x3)		auxiliary (accelerometer) data, ignored
+//	Cn			packet footer, 0xC0 to 0xCF
+//
+//	Values are stored full width with 'width 32', which is the
+//	default, or as their top 16 bits with 'width 16'.  The decode
+//	loop is specialised for each width.
+//
+
+static ALWAYS_INLINE void 
+openbci_decode(Device *dev, int w32) {
+   int rd= dev->ird;
+   int wr= dev->iwr;
+   char *buf= dev->ibuf;
+   int mask= dev->imask;
+   int n_chan= dev->n_chan;
+   unsigned char tmp[33], *pkt, *q;
+   char *p;
+   int a, avail, cnt, err;
+   Sample *ss;
+
+   while (1) {
+      avail= (wr-rd) & mask;
+      if (avail < 33) return;
+      if (!dev->now) dev->now= time_now_us();
+
+      if (buf[rd] != '\xA0') {
+	 // Skip to the next header byte, leaving room for a packet
+	 cnt= dev->ilen - rd;
+	 if (cnt > avail-32) cnt= avail-32;
+	 p= memchr(buf+rd, 0xA0, cnt);
+	 if (p) cnt= p - (buf+rd);
+	 rd= (rd + cnt) & mask;
+	 dev->ird= rd;
+	 dev->ierr += cnt;
+	 continue;
+      }
+
+      if ((buf[(rd+32) & mask] & 0xF0) != 0xC0) {
+	 // Not a real header; skip it
+	 rd= (rd + 1) & mask; dev->ird= rd;
+	 dev->ierr++;
+	 continue;
+      }
+
+      // Decode in place if the packet is contiguous
+      if (rd + 33 <= dev->ilen) 
+	 pkt= (unsigned char*)buf + rd;
+      else {
+	 for (a= 0; a<33; a++) 
+	    tmp[a]= buf[(rd+a) & mask];
+	 pkt= tmp;
+      }
+      rd= (rd + 33) & mask;
+      dev->ird= rd;
+      err= dev->ierr;
+      dev->ierr= 0;
+
+      // Missing packets become error samples
+      if (dev->hdata[1] && dev->hdata[0] != pkt[1]) {
+	 applog("\x82 Sync error \x86  Sample counter indicates %d missing packets",
+		(pkt[1] - dev->hdata[0]) & 255);
+	 while (dev->hdata[0] != pkt[1]) {
+	    ss= SAMPLE(dev->wr);
+	    memset(ss, 0, dev->s_smp);
+	    ss->stamp= dev->now;
+	    ss->time= clock_inc(&dev->clock, dev->now);
+	    ss->err= 1;
+	    SAMPLE_PUBLISH(dev);
+	    dev->hdata[0]= (dev->hdata[0] + 1) & 255;
+	 }
+      }
+      dev->hdata[0]= (pkt[1] + 1) & 255;
+
+      ss= SAMPLE(dev->wr);
+      memset(ss, 0, dev->s_smp);
+      ss->stamp= dev->now;
+      ss->time= clock_inc(&dev->clock, dev->now);
+
+      q= pkt + 2;
+      if (w32) {
+	 int *vp= ((Sample32*)ss)->val;
+	 for (a= 0; a<n_chan; a++, q += 3) 
+	    vp[a]= ((int)(((Uint32)q[0]<<24) | (q[1]<<16) | (q[2]<<8))) >> 8;
+      } else {
+	 short *vp= ss->val;
+	 for (a= 0; a<n_chan; a++, q += 3) 
+	    vp[a]= (short)((q[0]<<8) | q[1]);
+      }
+
+      if (!dev->hdata[1]) {
+	 // Ignore errors before the very first packet
+	 err= 0; dev->hdata[1]= 1;
+      }
+      ss->err= err > 255 ? 255 : err;
+      SAMPLE_PUBLISH(dev);
+      if (err) applog("\x82 Sync error \x86  Serial data loss");
+   }
+}
+
+void 
+openbci_handler(Device *dev) {
+   if (dev->width == 4) 
+      openbci_decode(dev, 1);
+   else 
+      openbci_decode(dev, 0);
+}
+
+//
+//	Decoder throughput benchmark.  Replays a raw capture of
+//	incoming bytes (such as the 'dump.raw' written by the
+//	'rawdump;' option) through the given format handler
+//	repeatedly, in the same size chunks that serial_read() uses,
+//	and reports the bytes and samples decoded per second.
+//
+
+void 
+decode_benchmark(char *fmtname, char *fname) {
+   FILE *in;
+   char *data, *msg;
+   int len, off, cnt;
+   int now0, now;
+   double n_byte= 0, n_smp= 0;
+
+   dev= ALLOC(Device);
+   if ((msg= setup_format(dev, fmtname, 1)))
+      error("%s", msg);
+   if (!dev->handler)
+      error("Format '%s' can't be used for a decoder benchmark", fmtname);
+   clock_setup(&dev->clock, dev->rate, time_now_us());
+   setup_buffers(dev);
+   setup_planes(dev);
+
+   // Load the whole capture into memory
+   if (!(in= fopen(fname, "rb")))
+      error("Unable to open input file: %s", fname);
+   fseek(in, 0, SEEK_END);
+   len= ftell(in);
+   fseek(in, 0, SEEK_SET);
+   if (len <= 0) error("Input file is empty: %s", fname);
+   data= Alloc(len);
+   if (1 != fread(data, len, 1, in))
+      error("Read error on input file: %s", fname);
+   fclose(in);
+
+   // Run for at least two seconds
+   now0= time_now_ms();
+   do {
+      for (off= 0; off < len; off += cnt) {
+	 Sint64 wr0= dev->wr;
+	 cnt= len-off;
+	 if (cnt > 512) cnt= 512;
+	 dev->now= 0;
+	 process_input(dev, data + off, cnt);
+	 n_smp += dev->wr - wr0;
+      }
+      n_byte += len;
+      now= time_now_ms();
+   } while (now - now0 < 2000);
+
+   printf("Decoded %.0f bytes into %.0f samples in %.3f seconds\n"
+	  "  %.2f MB/s, %.0f samples/s (%.1fx real-time at %g Hz)\n",
+	  n_byte, n_smp, (now-now0) * 0.001,
+	  n_byte / ((now-now0) * 1000.0),
+	  n_smp / ((now-now0) * 0.001),
+	  n_smp / ((now-now0) * 0.001) / dev->rate, dev->rate);
+   free(data);
+}
+
 #endif
 
 // END //
@@ -0,0 +1,378 @@
+//
+//	Benchmark of the filter-running code
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.  This
+//        file is released under the GNU General Public License (GPL)
+//        version 2 as published by the Free Software Foundation.  See
+//        the file COPYING for details, or visit
+//        <http://www.gnu.org/copyleft/gpl.html>.
+//
+//	This runs noise through mixes of filters typical of real use,
+//	with 1 to 256 buffers for each filter, in each of the ways
+//	that the backend it is built with supports: one sample at a
+//	time through the FidFunc, in blocks, and through banks, in
+//	double and single precision.  The results are written as CSV
+//	to STDOUT, one line for each mix, mode and number of buffers:
+//
+//	  backend	RF_CMDLIST, RF_COMBINED or RF_JIT ("cmdlist", etc)
+//	  mix		Name of the mix of filters (see mixes[] below)
+//	  mode		step, block, bank, or the same with "-f" for float
+//	  n_buf		Number of buffers (streams) for each filter
+//	  n_filt	Number of filters in the mix
+//	  samples	Number of samples run through each buffer
+//	  ns_per_sample	Time per sample per buffer per filter, in ns
+//	  samples_per_sec  The same, as samples per second
+//	  footprint	Bytes of filter state and coefficients in use
+//
+//	Use mk-bench to build and run this for every backend.
+//
+
+// We're including it to make compiling different versions easier
+#include "fidlib.c"
+
+#ifdef T_LINUX
+#include <time.h>
+#endif
+
+#define NL "\n"
+
+#if defined(RF_JIT)
+#define BACKEND "jit"
+#elif defined(RF_CMDLIST)
+#define BACKEND "cmdlist"
+#else
+#define BACKEND "combined"
+#endif
+
+// Block, banks and float are only in the command-list code
+#if defined(RF_CMDLIST) || defined(RF_JIT)
+#define HAVE_BLOCK
+#endif
+
+#define BLK 256		// Block length for 'block' modes
+#define N_IN 4096	// Length of the noise input, a multiple of BLK, and more than
+			//   the number of buffers
+#define MAX_FILT 16	// Maximum filters in a mix
+
+typedef struct Mix {
+   char *name;
+   double rate;
+   char *spec[MAX_FILT+1];
+} Mix;
+
+static Mix mixes[]= {
+   // The [F2] Mind Mirror bars from eegmir.cfg
+   { "mindmirror", 256, {
+      "LpBu4/=5", "LpBu4/=4", "LpBu4/=4", "LpBu4/=3", "LpBu4/=3",
+      "LpBu4/=2", "LpBu4/=1", "LpBu4/=1", "LpBu4/=1", "LpBu4/=1",
+      "LpBu4/=1", "LpBu4/=1", "LpBu4/=0.5", 0 } },
+   // The [F3] smoothing filter
+   { "smooth", 256, { "LpBe2/1", 0 } },
+   // Long FIRs: 293, 73 and 17 taps
+   { "fir", 256, { "LpBl/1", "LpBl/4", "LpBl/16", 0 } },
+   // High-order Bessel filters
+   { "bessel", 256, { "LpBe10/20", "HpBe8/2", "BpBe8/8-12", 0 } },
+   { 0 }
+};
+
+static int buf_counts[]= { 1, 4, 16, 64, 256, 0 };
+
+static char *modes[]= {
+   "step",
+#ifdef HAVE_BLOCK
+   "block", "bank", "step-f", "block-f", "bank-f",
+#endif
+   0
+};
+
+static double min_time= 0.2;	// Minimum seconds for each measurement
+
+static double
+time_now() {
+#ifdef T_LINUX
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+   return clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+//
+//	The filters of a mix, ready to run in one mode with 'n_buf'
+//	buffers each
+//
+
+typedef struct Bench {
+   int n_filt, n_buf;
+   int flt;			// Single precision?
+   FidRun *run[MAX_FILT];
+   FidFunc *func[MAX_FILT];
+   FidFuncF *func_f[MAX_FILT];
+   void **buf[MAX_FILT];	// n_buf buffers for each filter, or 0
+   FidBank *bank[MAX_FILT];	// Bank of n_buf for each filter, or 0
+   long footprint;
+} Bench;
+
+static void
+bench_setup(Bench *bb, Mix *mix, char *mode, int n_buf) {
+   int a, b;
+#ifdef HAVE_BLOCK
+   int bank= strstr(mode, "bank") != 0;
+#endif
+
+   memset(bb, 0, sizeof(*bb));
+   bb->n_buf= n_buf;
+   bb->flt= strstr(mode, "-f") != 0;
+   for (a= 0; mix->spec[a]; a++) {
+      FidFilter *ff= fid_design(mix->spec[a], mix->rate, -1, -1, 0, 0);
+      Run *rr;
+#ifdef HAVE_BLOCK
+      if (bb->flt)
+	 bb->run[a]= fid_run_new_f(ff, &bb->func_f[a]);
+      else
+#endif
+	 bb->run[a]= fid_run_new(ff, &bb->func[a]);
+      free(ff);
+      rr= bb->run[a];
+
+      // Coefficients
+#ifdef HAVE_BLOCK
+      bb->footprint += rr->n_coef * RUN_ESIZ(rr);
+#else
+      bb->footprint += (rr->n_iir + rr->n_fir) * sizeof(double);
+#endif
+
+      // State
+#ifdef HAVE_BLOCK
+      if (bank) {
+	 RunBank *bk= bb->bank[a]= fid_bank_new(rr, n_buf);
+	 bb->footprint += (bk->siz + 3) * bk->n_pad * RUN_ESIZ(rr);
+	 continue;
+      }
+#endif
+      bb->buf[a]= ALLOC_ARR(n_buf, void*);
+      for (b= 0; b<n_buf; b++)
+	 bb->buf[a][b]= fid_run_newbuf(rr);
+      bb->footprint += n_buf * fid_run_bufsize(rr);
+   }
+   bb->n_filt= a;
+}
+
+static void
+bench_free(Bench *bb) {
+   int a, b;
+   for (a= 0; a<bb->n_filt; a++) {
+#ifdef HAVE_BLOCK
+      if (bb->bank[a]) fid_bank_free(bb->bank[a]);
+#endif
+      if (bb->buf[a]) {
+	 for (b= 0; b<bb->n_buf; b++)
+	    fid_run_freebuf(bb->buf[a][b]);
+	 free(bb->buf[a]);
+      }
+      fid_run_free(bb->run[a]);
+   }
+}
+
+//
+//	Run 'cnt' samples (a multiple of BLK) through every buffer of
+//	every filter.  Returns a sum of the outputs, so that nothing
+//	gets optimised away.
+//
+
+static double
+bench_run(Bench *bb, char *mode, double *in, float *in_f, int cnt) {
+   int n_buf= bb->n_buf;
+   double sum= 0;
+   int a, b, s;
+
+   if (0 == strcmp(mode, "step")) {
+      for (s= 0; s<cnt; s++) {
+	 double val= in[s % N_IN];
+	 for (a= 0; a<bb->n_filt; a++) {
+	    FidFunc *func= bb->func[a];
+	    void **buf= bb->buf[a];
+	    for (b= 0; b<n_buf; b++)
+	       sum += func(buf[b], val);
+	 }
+      }
+      return sum;
+   }
+
+#ifdef HAVE_BLOCK
+   if (0 == strcmp(mode, "step-f")) {
+      for (s= 0; s<cnt; s++) {
+	 float val= in_f[s % N_IN];
+	 for (a= 0; a<bb->n_filt; a++) {
+	    FidFuncF *func= bb->func_f[a];
+	    void **buf= bb->buf[a];
+	    for (b= 0; b<n_buf; b++)
+	       sum += func(buf[b], val);
+	 }
+      }
+      return sum;
+   }
+
+   if (0 == strcmp(mode, "block") || 0 == strcmp(mode, "block-f")) {
+      static double out[BLK];
+      static float out_f[BLK];
+      for (s= 0; s<cnt; s += BLK) {
+	 for (a= 0; a<bb->n_filt; a++) {
+	    for (b= 0; b<n_buf; b++) {
+	       if (bb->flt) {
+		  fid_run_block_f(bb->buf[a][b], in_f + s % N_IN, out_f, BLK);
+		  sum += out_f[BLK-1];
+	       } else {
+		  fid_run_block(bb->buf[a][b], in + s % N_IN, out, BLK);
+		  sum += out[BLK-1];
+	       }
+	    }
+	 }
+      }
+      return sum;
+   }
+
+   if (0 == strcmp(mode, "bank") || 0 == strcmp(mode, "bank-f")) {
+      double *bout= ALLOC_ARR(n_buf, double);
+      float *bout_f= ALLOC_ARR(n_buf, float);
+      for (s= 0; s<cnt; s++) {
+	 // Each stream gets the noise from a different offset
+	 int off= s % (N_IN - n_buf);
+	 for (a= 0; a<bb->n_filt; a++) {
+	    if (bb->flt) {
+	       fid_bank_run_f(bb->bank[a], in_f + off, bout_f);
+	       sum += bout_f[0];
+	    } else {
+	       fid_bank_run(bb->bank[a], in + off, bout);
+	       sum += bout[0];
+	    }
+	 }
+      }
+      free(bout); free(bout_f);
+      return sum;
+   }
+#endif
+
+   error("Internal error: unknown mode %s", mode);
+   return 0;
+}
+
+//
+//	Measure one mix/mode/n_buf combination, and write a CSV line
+//
+
+static void
+measure(Mix *mix, char *mode, int n_buf, double *in, float *in_f) {
+   Bench bb;
+   int cnt= BLK;
+   double t0, t1, ns;
+
+   bench_setup(&bb, mix, mode, n_buf);
+
+   // Warm up, then double the count until it takes long enough
+   bench_run(&bb, mode, in, in_f, cnt);
+   while (1) {
+      t0= time_now();
+      bench_run(&bb, mode, in, in_f, cnt);
+      t1= time_now();
+      if (t1 - t0 >= min_time) break;
+      cnt *= t1 - t0 < min_time / 8 ? 8 : 2;
+   }
+
+   ns= (t1 - t0) * 1e9 / ((double)cnt * n_buf * bb.n_filt);
+   printf("%s,%s,%s,%d,%d,%d,%.3f,%.0f,%ld\n",
+	  BACKEND, mix->name, mode, n_buf, bb.n_filt, cnt,
+	  ns, 1e9 / ns, bb.footprint);
+   fflush(stdout);
+   bench_free(&bb);
+}
+
+void
+usage() {
+   error(NL "bench-run: Benchmark of the filter-running code, with CSV output"
+	 NL
+	 NL "Usage:  bench-run [-h] [-t <sec>] [-m <mix>] [-b <n_buf>]"
+	 NL "Option '-h' omits the CSV header line"
+	 NL "Option '-t' sets the minimum time for each measurement (default 0.2)"
+	 NL "Option '-m' runs only the given mix: mindmirror, smooth, fir, bessel"
+	 NL "Option '-b' runs only the given number of buffers per filter"
+	 );
+}
+
+int
+main(int ac, char **av) {
+   char dmy;
+   int f_head= 1;
+   char *mixname= 0;
+   int only_buf= 0;
+   double in[N_IN];
+   float in_f[N_IN];
+   unsigned int seed= 1;
+   int *counts= buf_counts;
+   int one[2];
+   Mix *mix;
+   int a, b;
+
+   // Process arguments
+   ac--; av++;
+   while (ac > 0 && av[0][0] == '-' && av[0][1]) {
+      char ch, *p= *av++ + 1;
+      ac--;
+      while ((ch= *p++)) switch (ch) {
+       case 'h':
+	  f_head= 0;
+	  break;
+       case 't':
+	  if (ac < 1 || 1 != sscanf(av[0], "%lf %c", &min_time, &dmy) || min_time <= 0)
+	     usage();
+	  ac--; av++;
+	  break;
+       case 'm':
+	  if (ac < 1) usage();
+	  mixname= av[0];
+	  ac--; av++;
+	  break;
+       case 'b':
+	  if (ac < 1 || 1 != sscanf(av[0], "%d %c", &only_buf, &dmy) || only_buf < 1)
+	     usage();
+	  ac--; av++;
+	  break;
+       default:
+	  usage();
+      }
+   }
+   if (ac != 0) usage();
+   if (mixname) {
+      for (mix= mixes; mix->name && 0 != strcmp(mixname, mix->name); mix++) ;
+      if (!mix->name) usage();
+   }
+
+   // Uniform noise in -1..+1, which avoids denormals
+   for (a= 0; a<N_IN; a++) {
+      seed= seed * 1103515245 + 12345;
+      in[a]= (int)seed * (1.0 / 2147483648.0);
+      in_f[a]= in[a];
+   }
+
+   if (f_head)
+      printf("backend,mix,mode,n_buf,n_filt,samples,ns_per_sample,"
+	     "samples_per_sec,footprint\n");
+
+   if (only_buf) {
+      one[0]= only_buf;
+      one[1]= 0;
+      counts= one;
+   }
+
+   for (mix= mixes; mix->name; mix++) {
+      if (mixname && 0 != strcmp(mixname, mix->name)) continue;
+      for (a= 0; modes[a]; a++)
+	 for (b= 0; counts[b]; b++)
+	    measure(mix, modes[a], counts[b], in, in_f);
+   }
+
+   return 0;
+}
+
+// END //
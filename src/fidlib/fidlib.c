@@ -54,6 +54,7 @@
 //	char *desc;
 //	FidRun *run;
 //	FidFunc *funcp;
+//	FidFuncF *funcpf;
 //	void *fbuf1, *fbuf2;
 //
 //	// Design a filter, and optionally get its long description
@@ -84,6 +85,34 @@
 //	fid_run_freebuf(fbuf1);
 //	fid_run_free(run);
 //
+//	// Where the input arrives in blocks, a whole block can be run
+//	// through at once, which is faster (RF_CMDLIST or RF_JIT;
+//	// RF_COMBINED just steps through the block).  The results are
+//	// the same as calling funcp() for each value, and in[] and
+//	// out[] may be the same array.  Long FIR filters are done by
+//	// FFT this way, which is much faster again, but then the
+//	// results only agree to within rounding errors.
+//	fid_run_block(fbuf1, in, out, n);
+//
+//	// If only every dec-th output is wanted, for example from a
+//	// narrow low-pass filter, the block can be decimated as it goes.
+//	// The outputs are packed at the start of out[], and their number
+//	// returned.  'phase' is the count of samples since the last
+//	// output, and advances by n (modulo dec) for each block.
+//	cnt= fid_run_block_dec(fbuf1, in, out, n, dec, phase);
+//	phase= (phase + n) % dec;
+//
+//	// A filter may instead be run in single precision, with float
+//	// buffers and float banks (RF_CMDLIST or RF_JIT).  This halves
+//	// the memory used and doubles the SIMD width of a bank, but is
+//	// less accurate; see test-accuracy.c to measure how much.
+//	run= fid_run_new_f(filt, &funcpf);
+//	fbuf1= fid_run_newbuf(run);
+//	out_f= funcpf(fbuf1, in_f);
+//	fid_run_block_f(fbuf1, in_f_arr, out_f_arr, n);
+//	bank= fid_bank_new(run, n_stream);
+//	fid_bank_run_f(bank, in_f_arr, out_f_arr);
+//
 //	// If you need to allocate your own buffers separately for some 
 //	// reason, then do it this way:
 //	run= fid_run_new(filt, &funcp);
@@ -99,6 +128,30 @@
 //	free(fbuf2);
 //	free(fbuf1);
 //	fid_run_free(run);
+//
+//	// To run many streams through the same filter, a bank is faster
+//	// than separate buffers, as the streams are done together using
+//	// SSE2/AVX where possible (RF_CMDLIST or RF_JIT; RF_COMBINED just
+//	// runs them one at a time).  in[] and out[] have one value for
+//	// each stream.
+//	run= fid_run_new(filt, &funcp);
+//	bank= fid_bank_new(run, n_stream);
+//	while (...) {
+//	   fid_bank_run(bank, in, out);
+//	   if (restart_required) fid_bank_zap(bank);
+//	   ...
+//	}
+//	fid_bank_free(bank);
+//	fid_run_free(run);
+//	
+//	// All the buffers for a set of filters may be placed together in
+//	// one block of memory, in the order they are used, to make better
+//	// use of the cache.  Add up the space first.
+//	size= fid_arena_bufsize(run1) * n1 + fid_arena_bufsize(run2) * n2;
+//	arena= fid_arena_new(size);
+//	fbuf1= fid_arena_newbuf(arena, run1);
+//	...
+//	fid_arena_free(arena);	// Releases all the buffers
 //	
 //
 //	// Convert an arbitrary filter into a new filter which is a single 
@@ -141,6 +194,26 @@
 //	// if the first argument is 1)
 //	filt= fid_cat(0, filt1, filt2, filt3, filt4, 0);
 //
+//	// Designs are cached in memory, so designing the same filter
+//	// again costs nothing.  They can also be kept in a file for next
+//	// time.  Returns the number of designs loaded, or -1 if the file
+//	// can't be written.  fid_cache_free() empties the cache.
+//	n= fid_cache_file("filters.cache");
+//
+//	// The routines above that design filters are not thread-safe,
+//	// and fid_design() exits on a bad spec.  For designing from
+//	// several threads at once, give each thread its own context,
+//	// and use the _r versions.  These return errors rather than
+//	// exiting: fid_design_r() returns 0, with the message from
+//	// fid_ctx_error(), and fid_parse_r() returns the message as
+//	// fid_parse() does.  Each context has its own design cache.
+//	ctx= fid_ctx_new();
+//	n= fid_cache_file_r(ctx, "filters-1.cache");	// Optional
+//	filt= fid_design_r(ctx, spec, rate, freq0, freq1, adj, &desc);
+//	if (!filt) printf("%s\n", fid_ctx_error(ctx));
+//	err= fid_parse_r(ctx, rate, &p, &filt);
+//	fid_ctx_free(ctx);
+//
 //
 //
 //	Format of returned filter
@@ -207,7 +280,8 @@
 //
 //	  RF_COMBINED -- easy to understand code, lower accuracy
 //	  RF_CMDLIST  -- faster pre-compiled code
-//	  RF_JIT      -- fastest JIT run-time generated code (no longer supported)
+//	  RF_JIT      -- fastest JIT run-time generated code (x86-64;
+//			   elsewhere this is the same as RF_CMDLIST)
 //
 
 #ifndef RF_COMBINED
@@ -228,6 +302,7 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
@@ -621,6 +696,24 @@ fid_response(FidFilter *filt, double freq) {
 
 #include "fidmkf.c"
 
+//
+//	Report an error in a design.  The message is kept in the
+//	context, and control jumps back to design_catch(), so that the
+//	caller gets the error back instead of the process exiting.
+//
+
+static void 
+ctx_error(Ctx *cx, char *fmt, ...) {
+   va_list ap;
+   char buf[1024];
+   va_start(ap, fmt);
+   vsnprintf(buf, sizeof(buf), fmt, ap);
+   va_end(ap);
+   free(cx->err);
+   cx->err= strdupf("%s", buf);
+   longjmp(cx->jmp, 1);
+}
+
 
 //
 //	Stack a number of identical filters, generating the required
@@ -714,41 +807,41 @@ search_peak(FidFilter *ff, double f0, double f3) {
 #define MZ 1
 
 static FidFilter*
-do_lowpass(int mz, double freq) {
+do_lowpass(Ctx *cx, int mz, double freq) {
    FidFilter *rv;
-   lowpass(prewarp(freq));
-   if (mz) s2z_matchedZ(); else s2z_bilinear();
-   rv= z2fidfilter(1.0, ~0);	// FIR is constant
+   lowpass(cx, prewarp(freq));
+   if (mz) s2z_matchedZ(cx); else s2z_bilinear(cx);
+   rv= z2fidfilter(cx, 1.0, ~0);	// FIR is constant
    rv->val[0]= 1.0 / fid_response(rv, 0.0);
    return rv;
 }   
 
 static FidFilter*
-do_highpass(int mz, double freq) {
+do_highpass(Ctx *cx, int mz, double freq) {
    FidFilter *rv;
-   highpass(prewarp(freq));
-   if (mz) s2z_matchedZ(); else s2z_bilinear();
-   rv= z2fidfilter(1.0, ~0);	// FIR is constant
+   highpass(cx, prewarp(freq));
+   if (mz) s2z_matchedZ(cx); else s2z_bilinear(cx);
+   rv= z2fidfilter(cx, 1.0, ~0);	// FIR is constant
    rv->val[0]= 1.0 / fid_response(rv, 0.5);
    return rv;
 }
 
 static FidFilter*
-do_bandpass(int mz, double f0, double f1) {
+do_bandpass(Ctx *cx, int mz, double f0, double f1) {
    FidFilter *rv;
-   bandpass(prewarp(f0), prewarp(f1));
-   if (mz) s2z_matchedZ(); else s2z_bilinear();
-   rv= z2fidfilter(1.0, ~0);	// FIR is constant
+   bandpass(cx, prewarp(f0), prewarp(f1));
+   if (mz) s2z_matchedZ(cx); else s2z_bilinear(cx);
+   rv= z2fidfilter(cx, 1.0, ~0);	// FIR is constant
    rv->val[0]= 1.0 / fid_response(rv, search_peak(rv, f0, f1));
    return rv;
 }
 
 static FidFilter*
-do_bandstop(int mz, double f0, double f1) {
+do_bandstop(Ctx *cx, int mz, double f0, double f1) {
    FidFilter *rv;
-   bandstop(prewarp(f0), prewarp(f1));
-   if (mz) s2z_matchedZ(); else s2z_bilinear();
-   rv= z2fidfilter(1.0, 5);	// FIR second coefficient is *non-const* for bandstop
+   bandstop(cx, prewarp(f0), prewarp(f1));
+   if (mz) s2z_matchedZ(cx); else s2z_bilinear(cx);
+   rv= z2fidfilter(cx, 1.0, 5);	// FIR second coefficient is *non-const* for bandstop
    rv->val[0]= 1.0 / fid_response(rv, 0.0);	// Use 0Hz response as reference
    return rv;
 }   
@@ -757,9 +850,10 @@ do_bandstop(int mz, double f0, double f1) {
 //
 //	Information passed to individual filter design routines:
 //
-//	  double* rout(double rate, double f0, double f1, 
+//	  double* rout(Ctx *cx, double rate, double f0, double f1, 
 //		       int order, int n_arg, double *arg);
 //
+//	'cx' is the design context, for the pole/zero lists and errors
 //	'rate' is the sampling rate, or 1 if not set
 //	'f0' and 'f1' give the frequency or frequency range as a 
 //	 	proportion of the sampling rate
@@ -780,194 +874,194 @@ do_bandstop(int mz, double f0, double f1) {
 //
 
 static FidFilter*
-des_bpre(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bandpass_res(f0, arg[0]);
-   return z2fidfilter(1.0, ~0);	// FIR constant
+des_bpre(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bandpass_res(cx, f0, arg[0]);
+   return z2fidfilter(cx, 1.0, ~0);	// FIR constant
 }
 
 static FidFilter*
-des_bsre(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bandstop_res(f0, arg[0]);
-   return z2fidfilter(1.0, 0);	// FIR not constant, depends on freq
+des_bsre(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bandstop_res(cx, f0, arg[0]);
+   return z2fidfilter(cx, 1.0, 0);	// FIR not constant, depends on freq
 }
 
 static FidFilter*
-des_apre(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   allpass_res(f0, arg[0]);
-   return z2fidfilter(1.0, 0);	// FIR not constant, depends on freq
+des_apre(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   allpass_res(cx, f0, arg[0]);
+   return z2fidfilter(cx, 1.0, 0);	// FIR not constant, depends on freq
 }
 
 static FidFilter*
-des_pi(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   prop_integral(prewarp(f0));
-   s2z_bilinear();
-   return z2fidfilter(1.0, 0);	// FIR not constant, depends on freq
+des_pi(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   prop_integral(cx, prewarp(f0));
+   s2z_bilinear(cx);
+   return z2fidfilter(cx, 1.0, 0);	// FIR not constant, depends on freq
 }
 
 static FidFilter*
-des_piz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   prop_integral(prewarp(f0));
-   s2z_matchedZ();
-   return z2fidfilter(1.0, 0);	// FIR not constant, depends on freq
+des_piz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   prop_integral(cx, prewarp(f0));
+   s2z_matchedZ(cx);
+   return z2fidfilter(cx, 1.0, 0);	// FIR not constant, depends on freq
 }
 
 static FidFilter*
-des_lpbe(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_lowpass(BL, f0);
+des_lpbe(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_lowpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_hpbe(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_highpass(BL, f0);
+des_hpbe(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_highpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_bpbe(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_bandpass(BL, f0, f1);
+des_bpbe(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_bandpass(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_bsbe(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_bandstop(BL, f0, f1);
+des_bsbe(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_bandstop(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_lpbez(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_lowpass(MZ, f0);
+des_lpbez(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_lowpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_hpbez(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_highpass(MZ, f0);
+des_hpbez(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_highpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_bpbez(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_bandpass(MZ, f0, f1);
+des_bpbez(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_bandpass(cx, MZ, f0, f1);
 }
 
 static FidFilter*
-des_bsbez(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   bessel(order);
-   return do_bandstop(MZ, f0, f1);
+des_bsbez(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   bessel(cx, order);
+   return do_bandstop(cx, MZ, f0, f1);
 }
 
 static FidFilter*	// Butterworth-Bessel cross
-des_lpbube(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_lpbube(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double tmp[MAXPZ];
    int a;
-   bessel(order); memcpy(tmp, pol, order * sizeof(double));
-   butterworth(order); 
-   for (a= 0; a<order; a++) pol[a] += (tmp[a]-pol[a]) * 0.01 * arg[0];
-   //for (a= 1; a<order; a+=2) pol[a] += arg[1] * 0.01;
-   return do_lowpass(BL, f0);
+   bessel(cx, order); memcpy(tmp, cx->pol, order * sizeof(double));
+   butterworth(cx, order); 
+   for (a= 0; a<order; a++) cx->pol[a] += (tmp[a]-cx->pol[a]) * 0.01 * arg[0];
+   //for (a= 1; a<order; a+=2) cx->pol[a] += arg[1] * 0.01;
+   return do_lowpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_lpbu(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_lowpass(BL, f0);
+des_lpbu(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_lowpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_hpbu(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_highpass(BL, f0);
+des_hpbu(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_highpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_bpbu(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_bandpass(BL, f0, f1);
+des_bpbu(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_bandpass(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_bsbu(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_bandstop(BL, f0, f1);
+des_bsbu(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_bandstop(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_lpbuz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_lowpass(MZ, f0);
+des_lpbuz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_lowpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_hpbuz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_highpass(MZ, f0);
+des_hpbuz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_highpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_bpbuz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_bandpass(MZ, f0, f1);
+des_bpbuz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_bandpass(cx, MZ, f0, f1);
 }
 
 static FidFilter*
-des_bsbuz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   butterworth(order);
-   return do_bandstop(MZ, f0, f1);
+des_bsbuz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   butterworth(cx, order);
+   return do_bandstop(cx, MZ, f0, f1);
 }
 
 static FidFilter*
-des_lpch(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_lowpass(BL, f0);
+des_lpch(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_lowpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_hpch(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_highpass(BL, f0);
+des_hpch(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_highpass(cx, BL, f0);
 }
 
 static FidFilter*
-des_bpch(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_bandpass(BL, f0, f1);
+des_bpch(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_bandpass(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_bsch(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_bandstop(BL, f0, f1);
+des_bsch(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_bandstop(cx, BL, f0, f1);
 }
 
 static FidFilter*
-des_lpchz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_lowpass(MZ, f0);
+des_lpchz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_lowpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_hpchz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_highpass(MZ, f0);
+des_hpchz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_highpass(cx, MZ, f0);
 }
 
 static FidFilter*
-des_bpchz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_bandpass(MZ, f0, f1);
+des_bpchz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_bandpass(cx, MZ, f0, f1);
 }
 
 static FidFilter*
-des_bschz(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   chebyshev(order, arg[0]);
-   return do_bandstop(MZ, f0, f1);
+des_bschz(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   chebyshev(cx, order, arg[0]);
+   return do_bandstop(cx, MZ, f0, f1);
 }
 
 static FidFilter*
-des_lpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_lpbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -978,7 +1072,7 @@ des_lpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_hpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_hpbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -989,7 +1083,7 @@ des_hpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_bpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_bpbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -1000,7 +1094,7 @@ des_bpbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_bsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_bsbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -1010,7 +1104,7 @@ des_bsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_apbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_apbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -1020,7 +1114,7 @@ des_apbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_pkbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_pkbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double alpha= sin(omega) / 2 / arg[0];
@@ -1031,7 +1125,7 @@ des_pkbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_lsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_lsbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double sinv= sin(omega);
@@ -1049,7 +1143,7 @@ des_lsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_hsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_hsbq(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double omega= 2 * M_PI * f0;
    double cosv= cos(omega);
    double sinv= sin(omega);
@@ -1067,7 +1161,7 @@ des_hsbq(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_lpbl(double rate, double f0, double f1, int order, int n_arg, double *arg) {
+des_lpbl(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
    double wid= 0.574695/f0;
    double tot, adj;
    int max= (int)floor(wid);
@@ -1091,14 +1185,14 @@ des_lpbl(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 }
 
 static FidFilter*
-des_lphm(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   error("Not yet implemented");
+des_lphm(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   ctx_error(cx, "Not yet implemented");
    return 0;
 }
 
 static FidFilter*
-des_lphn(double rate, double f0, double f1, int order, int n_arg, double *arg) {
-   error("Not yet implemented");
+des_lphn(Ctx *cx, double rate, double f0, double f1, int order, int n_arg, double *arg) {
+   ctx_error(cx, "Not yet implemented");
    return 0;
 }
 
@@ -1108,7 +1202,7 @@ des_lphn(double rate, double f0, double f1, int order, int n_arg, double *arg) {
 //
 
 static struct {
-   FidFilter *(*rout)(double,double,double,int,int,double*); // Designer routine address
+   FidFilter *(*rout)(Ctx*,double,double,double,int,int,double*); // Designer routine address
    char *fmt;	// Format for spec-string
    char *txt;	// Human-readable description of filter
 } filter[]= {
@@ -1231,8 +1325,8 @@ static struct {
 
 typedef struct Spec Spec;
 static char* parse_spec(Spec*);   
-static FidFilter *auto_adjust_single(Spec *sp, double rate, double f0);
-static FidFilter *auto_adjust_dual(Spec *sp, double rate, double f0, double f1);
+static FidFilter *auto_adjust_single(Ctx *cx, Spec *sp, double rate, double f0);
+static FidFilter *auto_adjust_dual(Ctx *cx, Spec *sp, double rate, double f0, double f1);
 struct Spec {
 #define MAXARG 10
    char *spec;
@@ -1248,39 +1342,344 @@ struct Spec {
    int fi;		// Filter index (filter[fi])
 };
 
+//
+//	Design contexts.  The fid_*_r() routines do all their work in
+//	the context passed to them, from fid_ctx_new(), and share
+//	nothing else, so several threads can design filters at once so
+//	long as each has its own context.  The older routines without
+//	the _r suffix all use the one built-in context below, so they
+//	should only be called from one thread at a time.
+//
+
+static Ctx ctx_def= { .magic= 0x64966328 };
+
+FidCtx *
+fid_ctx_new() {
+   Ctx *cx= ALLOC(Ctx);
+   cx->magic= 0x64966328;
+   return cx;
+}
+
+//
+//	Return the error message for the last call using this context
+//	that failed, or 0.  This remains valid until the next call.
+//
+
+char *
+fid_ctx_error(FidCtx *ctx) {
+   Ctx *cx= ctx;
+   if (cx->magic != 0x64966328)
+      error("Bad handle passed to fid_ctx_error()");
+   return cx->err;
+}
+
+//
+//	Design cache.  Every predefined filter designed by fid_design()
+//	or fid_parse() is remembered in the context, keyed by the filter type, order,
+//	arguments and frequencies as parsed from the spec, plus the
+//	sampling rate.  Designing the same filter again then just
+//	copies the saved result.  This matters most for '=' specs,
+//	where auto_adjust_*() has to design the filter many times over
+//	to search for the right frequencies.
+//
+//	With fid_cache_file(), designs are also appended to a file as
+//	they are made, and the designs already in that file are loaded,
+//	so that unchanged filters cost nothing on the next run either.
+//	The file is plain text, one design per line.  Delete it to force
+//	everything to be designed again (e.g. after changing the design
+//	code).
+//
+//	Each context has its own cache, so no locking is needed when
+//	designing from several threads, but then each context should be
+//	given its own cache file, if any.
+//
+
+#define CACHE_HASH 256
+
+struct CacheEnt {
+   CacheEnt *nxt;
+   char *key;
+   int len;		// Length of ff in bytes, excluding termination
+   FidFilter *ff;
+};
+
+static unsigned int 
+cache_hash(char *key) {
+   unsigned int hh= 0;
+   while (*key) hh= hh * 31 + (unsigned char)*key++;
+   return hh % CACHE_HASH;
+}
+
+static CacheEnt *
+cache_find(Ctx *cx, char *key) {
+   CacheEnt *ce;
+   if (!cx->cache_tab) return 0;
+   for (ce= cx->cache_tab[cache_hash(key)]; ce; ce= ce->nxt)
+      if (0 == strcmp(ce->key, key)) return ce;
+   return 0;
+}
+
+// Add a copy of 'ff' to the cache under the given key
+static CacheEnt *
+cache_add(Ctx *cx, char *key, FidFilter *ff) {
+   CacheEnt *ce= Alloc(sizeof(CacheEnt));
+   unsigned int hh= cache_hash(key);
+   FidFilter *ff1;
+
+   for (ff1= ff; ff1->typ; ff1= FFNEXT(ff1)) ;
+   ce->len= (char*)ff1 - (char*)ff;
+   ce->ff= Alloc(ce->len + FFCSIZE(0,0));
+   memcpy(ce->ff, ff, ce->len);
+   ce->key= strdupf("%s", key);
+   if (!cx->cache_tab) cx->cache_tab= ALLOC_ARR(CACHE_HASH, CacheEnt*);
+   ce->nxt= cx->cache_tab[hh];
+   cx->cache_tab[hh]= ce;
+   return ce;
+}
+
+// Write out a cache entry as a line of the cache file.  %.17g
+// is enough to read back each double exactly.
+static void 
+cache_write(FILE *out, CacheEnt *ce) {
+   FidFilter *ff;
+   int a;
+
+   fprintf(out, "%s :", ce->key);
+   for (ff= ce->ff; ff->typ; ff= FFNEXT(ff)) {
+      fprintf(out, " %c %d %d", ff->typ, ff->cbm, ff->len);
+      for (a= 0; a<ff->len; a++)
+	 fprintf(out, " %.17g", ff->val[a]);
+   }
+   fprintf(out, " .\n");
+}
+
+// Read a line of the cache file into the cache.  Returns 1 on
+// success, 0 if the line is not understood.
+static int 
+cache_read(Ctx *cx, char *line) {
+   char *p= strstr(line, " :");
+   char *q;
+   FidFilter *rv, *ff;
+   int n_head= 0, n_val= 0;
+   char typ;
+   int cbm, len, a;
+
+   if (!p) return 0;
+   *p= 0; p += 2;
+
+   // Count up first, then fill in
+   for (q= p; 1; ) {
+      while (*q == ' ') q++;
+      if (*q == '.') break;
+      if (3 != sscanf(q, "%c %d %d", &typ, &cbm, &len)) return 0;
+      if ((typ != 'I' && typ != 'F') || len < 0) return 0;
+      q++; strtol(q, &q, 10); strtol(q, &q, 10);
+      for (a= 0; a<len; a++) {
+	 char *q0= q;
+	 strtod(q, &q);
+	 if (q == q0) return 0;
+      }
+      n_head++; n_val += len;
+   }
+
+   ff= rv= FFALLOC(n_head, n_val);
+   for (q= p; n_head-- > 0; ff= FFNEXT(ff)) {
+      while (*q == ' ') q++;
+      ff->typ= *q++;
+      ff->cbm= strtol(q, &q, 10);
+      ff->len= strtol(q, &q, 10);
+      for (a= 0; a<ff->len; a++)
+	 ff->val[a]= strtod(q, &q);
+   }
+   if (!cache_find(cx, line)) cache_add(cx, line, rv);
+   free(rv);
+   return 1;
+}
+
+//
+//	Load the designs from the given cache file, if it exists, into
+//	the context's cache, and append new designs to it from now on.
+//	Returns the number of designs loaded, or -1 if the file can't be
+//	opened for writing.  Lines that can't be understood are ignored.
+//
+
+int 
+fid_cache_file_r(FidCtx *ctx, char *fnam) {
+   Ctx *cx= ctx;
+   FILE *in;
+   char *line= 0;
+   int max= 0, len, ch;
+   int cnt= 0;
+
+   if (cx->magic != 0x64966328)
+      error("Bad handle passed to fid_cache_file_r()");
+
+   if ((in= fopen(fnam, "r"))) {
+      do {
+	 len= 0;
+	 while ((ch= fgetc(in)) != EOF && ch != '\n') {
+	    if (len+1 >= max) {
+	       max= max ? max * 2 : 1024;
+	       if (!(line= realloc(line, max))) error("Out of memory");
+	    }
+	    line[len++]= ch;
+	 }
+	 if (len) {
+	    line[len]= 0;
+	    cnt += cache_read(cx, line);
+	 }
+      } while (ch != EOF);
+      free(line);
+      fclose(in);
+   }
+
+   if (cx->cache_out) fclose(cx->cache_out);
+   if (!(cx->cache_out= fopen(fnam, "a"))) return -1;
+   return cnt;
+}
+
+int 
+fid_cache_file(char *fnam) {
+   return fid_cache_file_r(&ctx_def, fnam);
+}
+
+//
+//	Empty the context's design cache, and stop writing to any cache
+//	file
+//
+
+static void 
+cache_free(Ctx *cx) {
+   CacheEnt *ce;
+   int a;
+
+   if (cx->cache_tab) {
+      for (a= 0; a<CACHE_HASH; a++) {
+	 while ((ce= cx->cache_tab[a])) {
+	    cx->cache_tab[a]= ce->nxt;
+	    free(ce->key);
+	    free(ce->ff);
+	    free(ce);
+	 }
+      }
+      free(cx->cache_tab);
+      cx->cache_tab= 0;
+   }
+   if (cx->cache_out) fclose(cx->cache_out);
+   cx->cache_out= 0;
+}
+
+void 
+fid_cache_free() {
+   cache_free(&ctx_def);
+}
+
+//
+//	Release a context, along with its cache
+//
+
+void 
+fid_ctx_free(FidCtx *ctx) {
+   Ctx *cx= ctx;
+   if (cx->magic != 0x64966328)
+      error("Bad handle passed to fid_ctx_free()");
+   cache_free(cx);
+   free(cx->err);
+   cx->magic= 0;
+   free(cx);
+}
+
+//
+//	Design the filter from a parsed spec, with frequencies 'f0'
+//	and 'f1' already divided by the rate, going via the cache.
+//	Returns a newly allocated filter.
+//
+
+static FidFilter *
+design_spec(Ctx *cx, Spec *sp, double rate, double f0, double f1) {
+   char key[80 + MAXARG * 25], *p= key;
+   CacheEnt *ce;
+   FidFilter *rv;
+   int a;
+
+   p += sprintf(p, "%s %d %d %.17g %.17g %.17g", filter[sp->fi].fmt, 
+		sp->order, sp->adj, rate, f0, f1);
+   for (a= 0; a<sp->n_arg; a++)
+      p += sprintf(p, " %.17g", sp->argarr[a]);
+
+   if (!(ce= cache_find(cx, key))) {
+      if (!sp->adj)
+	 rv= filter[sp->fi].rout(cx, rate, f0, f1, sp->order, sp->n_arg, sp->argarr);
+      else if (strstr(filter[sp->fi].fmt, "#R"))
+	 rv= auto_adjust_dual(cx, sp, rate, f0, f1);
+      else 
+	 rv= auto_adjust_single(cx, sp, rate, f0);
+      ce= cache_add(cx, key, rv);
+      if (cx->cache_out) {
+	 cache_write(cx->cache_out, ce);
+	 fflush(cx->cache_out);
+      }
+      return rv;
+   }
+
+   rv= Alloc(ce->len + FFCSIZE(0,0));
+   memcpy(rv, ce->ff, ce->len);
+   return rv;
+}
+
+//
+//	Call design_spec(), catching any error in the design.  Returns
+//	0 on error, with the message in cx->err.
+//
+
+static FidFilter *
+design_catch(Ctx *cx, Spec *sp, double rate, double f0, double f1) {
+   if (setjmp(cx->jmp)) return 0;
+   return design_spec(cx, sp, rate, f0, f1);
+}
+
+//
+//	Design a filter using the given context.  Returns 0 on error,
+//	with the message available from fid_ctx_error().
+//
+
 FidFilter *
-fid_design(char *spec, double rate, double freq0, double freq1, int f_adj, char **descp) {
+fid_design_r(FidCtx *ctx, char *spec, double rate, double freq0, double freq1, 
+	     int f_adj, char **descp) {
+   Ctx *cx= ctx;
    FidFilter *rv;
    Spec sp;
    double f0, f1;
    char *err;
 
+   if (cx->magic != 0x64966328)
+      error("Bad handle passed to fid_design_r()");
+   free(cx->err); cx->err= 0;
+
    // Parse the filter-spec
    sp.spec= spec;
    sp.in_f0= freq0;
    sp.in_f1= freq1;
    sp.in_adj= f_adj;
    err= parse_spec(&sp);
-   if (err) error("%s", err);
+   if (err) { cx->err= err; return 0; }
    f0= sp.f0;
    f1= sp.f1;
 
    // Adjust frequencies to range 0-0.5, and check them
    f0 /= rate;
-   if (f0 > 0.5) error("Frequency of %gHz out of range with sampling rate of %gHz", f0*rate, rate);
    f1 /= rate;
-   if (f1 > 0.5) error("Frequency of %gHz out of range with sampling rate of %gHz", f1*rate, rate);
+   if (f0 > 0.5 || f1 > 0.5) {
+      cx->err= strdupf("Frequency of %gHz out of range with sampling rate of %gHz", 
+		       (f0 > 0.5 ? f0 : f1)*rate, rate);
+      return 0;
+   }
 
    // Okay we now have a successful spec-match to filter[sp.fi], and sp.n_arg
    // args are now in sp.argarr[]
 
    // Generate the filter
-   if (!sp.adj)
-      rv= filter[sp.fi].rout(rate, f0, f1, sp.order, sp.n_arg, sp.argarr);
-   else if (strstr(filter[sp.fi].fmt, "#R"))
-      rv= auto_adjust_dual(&sp, rate, f0, f1);
-   else 
-      rv= auto_adjust_single(&sp, rate, f0);
+   if (!(rv= design_catch(cx, &sp, rate, f0, f1))) return 0;
    
    // Generate a long description if required
    if (descp) {
@@ -1327,21 +1726,28 @@ fid_design(char *spec, double rate, double freq0, double freq1, int f_adj, char
    return rv;
 }
 
+FidFilter *
+fid_design(char *spec, double rate, double freq0, double freq1, int f_adj, char **descp) {
+   FidFilter *rv= fid_design_r(&ctx_def, spec, rate, freq0, freq1, f_adj, descp);
+   if (!rv) error("%s", ctx_def.err);
+   return rv;
+}
+
 //
 //	Auto-adjust input frequency to give correct 50% point to 6 figures
 //
 
 static FidFilter *
-auto_adjust_single(Spec *sp, double rate, double f0) {
+auto_adjust_single(Ctx *cx, Spec *sp, double rate, double f0) {
    double a0, a1, a2;
-   FidFilter *(*design)(double,double,double,int,int,double*)= filter[sp->fi].rout;
+   FidFilter *(*design)(Ctx*,double,double,double,int,int,double*)= filter[sp->fi].rout;
    FidFilter *rv= 0;
    double resp;
    double r0, r2;
    int incr;		// Increasing (1) or decreasing (0)
    int a;
 
-#define DESIGN(aa) design(rate, aa, aa, sp->order, sp->n_arg, sp->argarr)
+#define DESIGN(aa) design(cx, rate, aa, aa, sp->order, sp->n_arg, sp->argarr)
 #define TEST(aa) { if (rv) {free(rv);rv= 0;} rv= DESIGN(aa); resp= fid_response(rv, f0); }
 
    // Try and establish a range within which we can find the point
@@ -1351,8 +1757,10 @@ auto_adjust_single(Spec *sp, double rate, double f0) {
       if ((r0 < 0.5) != (r2 < 0.5)) break;
       a2= 0.5-((0.5-f0)/a); TEST(a2); r2= resp;
       if ((r0 < 0.5) != (r2 < 0.5)) break;
-      if (a == 32) 	// No success
-	 error("auto_adjust_single internal error -- can't establish enclosing range");
+      if (a == 32) { 	// No success
+	 free(rv);
+	 ctx_error(cx, "auto_adjust_single internal error -- can't establish enclosing range");
+      }
    }
 
    incr= r2 > r0;
@@ -1386,10 +1794,10 @@ auto_adjust_single(Spec *sp, double rate, double f0) {
 //
 
 FidFilter *
-auto_adjust_dual(Spec *sp, double rate, double f0, double f1) {
+auto_adjust_dual(Ctx *cx, Spec *sp, double rate, double f0, double f1) {
    double mid= 0.5 * (f0+f1);
    double wid= 0.5 * fabs(f1-f0);
-   FidFilter *(*design)(double,double,double,int,int,double*)= filter[sp->fi].rout;
+   FidFilter *(*design)(Ctx*,double,double,double,int,int,double*)= filter[sp->fi].rout;
    FidFilter *rv= 0;
    int bpass= -1;
    double delta;
@@ -1401,7 +1809,7 @@ auto_adjust_dual(Spec *sp, double rate, double f0, double f1) {
    int cnt_design= 0;
 
 #define DESIGN(mm,ww) { if (rv) {free(rv);rv= 0;} \
-   rv= design(rate, mm-ww, mm+ww, sp->order, sp->n_arg, sp->argarr); \
+   rv= design(cx, rate, mm-ww, mm+ww, sp->order, sp->n_arg, sp->argarr); \
    r0= fid_response(rv, f0); r1= fid_response(rv, f1); \
    err0= fabs(0.5-r0); err1= fabs(0.5-r1); cnt_design++; }
 
@@ -1442,8 +1850,10 @@ auto_adjust_dual(Spec *sp, double rate, double f0, double f1) {
 	 if (PERR < perr) { perr= PERR; mid= mid1; wid= wid1; }
       }
 
-      if (cnt > 1000)
-	 error("auto_adjust_dual -- design not converging");
+      if (cnt > 1000) {
+	 free(rv);
+	 ctx_error(cx, "auto_adjust_dual -- design not converging");
+      }
    }
 
 #undef INC_WID
@@ -1998,7 +2408,9 @@ grabWord(char **pp, char *buf, int buflen) {
 //	Parse an entire filter specification, perhaps consisting of
 //	several FIR, IIR and predefined filters.  Stops at the first
 //	,; or unmatched )]}.  Returns either 0 on success, or else a
-//	strdup'd error string.
+//	strdup'd error string.  Predefined filters are designed using
+//	the given context, and errors in their design are returned in
+//	the same way.
 //
 //	This duplicates code from Fiview filter.c, I know, but this
 //	may have to expand in the future to handle '+' operations, and
@@ -2008,7 +2420,8 @@ grabWord(char **pp, char *buf, int buflen) {
 //
 
 char *
-fid_parse(double rate, char **pp, FidFilter **ffp) {
+fid_parse_r(FidCtx *ctx, double rate, char **pp, FidFilter **ffp) {
+   Ctx *cx= ctx;
    char buf[128];
    char *p= *pp, *rew;
 #define INIT_LEN 128
@@ -2023,7 +2436,10 @@ fid_parse(double rate, char **pp, FidFilter **ffp) {
    double val;
    char dmy;
 
-#define ERR(ptr, msg) { *pp= ptr; *ffp= 0; return msg; }
+   if (cx->magic != 0x64966328)
+      error("Bad handle passed to fid_parse_r()");
+
+#define ERR(ptr, msg) { free(rv); *pp= ptr; *ffp= 0; return msg; }
 #define INCBUF { tmp= realloc(rv, (rvend-rv) * 2); if (!tmp) error("Out of memory"); \
  rvend= (rvend-rv) * 2 + tmp; rvp= (rvp-rv) + tmp; \
  curr= (void*)(((char*)curr) - rv + tmp); rv= tmp; }
@@ -2094,12 +2510,10 @@ fid_parse(double rate, char **pp, FidFilter **ffp) {
 	 // args are now in sp.argarr[]
 	 
 	 // Generate the filter
-	 if (!sp.adj)
-	    ff= filter[sp.fi].rout(rate, f0, f1, sp.order, sp.n_arg, sp.argarr);
-	 else if (strstr(filter[sp.fi].fmt, "#R"))
-	    ff= auto_adjust_dual(&sp, rate, f0, f1);
-	 else 
-	    ff= auto_adjust_single(&sp, rate, f0);
+	 if (!(ff= design_catch(cx, &sp, rate, f0, f1))) {
+	    err= cx->err; cx->err= 0;
+	    ERR(rew, err);
+	 }
 
 	 // Append it to our FidFilter to return
 	 for (ff1= ff; ff1->typ; ff1= FFNEXT(ff1)) ;
@@ -2147,6 +2561,11 @@ fid_parse(double rate, char **pp, FidFilter **ffp) {
    return strdupf("Internal error, shouldn't reach here");
 }
 
+char *
+fid_parse(double rate, char **pp, FidFilter **ffp) {
+   return fid_parse_r(&ctx_def, rate, pp, ffp);
+}
+
 
 //
 //	Filter-running code
@@ -2156,7 +2575,8 @@ fid_parse(double rate, char **pp, FidFilter **ffp) {
 #include "rf_combined.c"
 #endif
 
-#ifdef RF_CMDLIST
+// RF_JIT compiles the command lists of RF_CMDLIST
+#if defined(RF_CMDLIST) || defined(RF_JIT)
 #include "rf_cmdlist.c"
 #endif
 
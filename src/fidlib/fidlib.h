@@ -30,6 +30,10 @@ struct FidFilter {
 // These are so you can use easier names to refer to running filters
 typedef void FidRun;
 typedef double (FidFunc)(void*, double);
+typedef float (FidFuncF)(void*, float);
+typedef void FidBank;
+typedef void FidArena;
+typedef void FidCtx;
 
 
 //
@@ -57,5 +61,34 @@ extern FidFilter * fid_cat(int freeme, ...) ;
 extern char * fid_parse(double rate, char **pp, FidFilter **ffp) ;
 extern void fid_run_initbuf(void *run, void *buf);
 extern int fid_run_bufsize(void *run);
+// RF_COMBINED steps through blocks one sample at a time, and has no
+// _f versions; those are RF_CMDLIST or RF_JIT only.
+extern void fid_run_block(void *runbuf, const double *in, double *out, int n);
+extern FidRun *fid_run_new_f(FidFilter *filt, FidFuncF **funcpp);
+extern void fid_run_block_f(void *runbuf, const float *in, float *out, int n);
+extern int fid_run_block_dec(void *runbuf, const double *in, double *out, int n, 
+			     int dec, int phase);
+extern int fid_run_block_dec_f(void *runbuf, const float *in, float *out, int n, 
+			       int dec, int phase);
+// Banks use vector code with RF_CMDLIST or RF_JIT.  RF_COMBINED steps
+// the streams one at a time, and has no fid_bank_run_f().
+extern FidBank *fid_bank_new(FidRun *run, int n_buf);
+extern void fid_bank_run(FidBank *bank, double *in, double *out);
+extern void fid_bank_run_f(FidBank *bank, float *in, float *out);
+extern void fid_bank_zap(FidBank *bank);
+extern void fid_bank_free(FidBank *bank);
+extern int fid_arena_bufsize(FidRun *run);
+extern FidArena *fid_arena_new(int size);
+extern void *fid_arena_newbuf(FidArena *arena, FidRun *run);
+extern void fid_arena_free(FidArena *arena);
+extern int fid_cache_file(char *fnam);
+extern void fid_cache_free(void);
+extern FidCtx *fid_ctx_new(void);
+extern void fid_ctx_free(FidCtx *ctx);
+extern char *fid_ctx_error(FidCtx *ctx);
+extern FidFilter *fid_design_r(FidCtx *ctx, char *spec, double rate, double freq0, 
+			       double freq1, int f_adj, char **descp);
+extern char *fid_parse_r(FidCtx *ctx, double rate, char **pp, FidFilter **ffp);
+extern int fid_cache_file_r(FidCtx *ctx, char *fnam);
 
 
@@ -194,15 +194,33 @@ cexp(double *aa) {
 //	complex pole.  The second value of the pair has an entry of 0
 //	attached.  (Similarly for zeros in zertyp[])
 //
+//	These lists are kept in a design context, along with anything
+//	else that the design of one filter needs to keep track of, so
+//	that several filters can be designed at once from different
+//	threads, each with its own context.  Errors in the design are
+//	reported through the context with ctx_error(), which jumps back
+//	to the entry point rather than exiting.
+//
 
 #define MAXPZ 64 
 
-static int n_pol;		// Number of poles
-static double pol[MAXPZ];	// Pole values (see above)
-static char poltyp[MAXPZ];	// Pole value types: 1 real, 2 first of complex pair, 0 second
-static int n_zer;		// Same for zeros ...
-static double zer[MAXPZ];
-static char zertyp[MAXPZ];	
+typedef struct CacheEnt CacheEnt;
+typedef struct Ctx Ctx;
+struct Ctx {
+   int magic;		// Magic: 0x64966328
+   int n_pol;		// Number of poles
+   double pol[MAXPZ];	// Pole values (see above)
+   char poltyp[MAXPZ];	// Pole value types: 1 real, 2 first of complex pair, 0 second
+   int n_zer;		// Same for zeros ...
+   double zer[MAXPZ];
+   char zertyp[MAXPZ];	
+   jmp_buf jmp;		// Where ctx_error() jumps to
+   char *err;		// Error message from the last call that failed, or 0
+   CacheEnt **cache_tab;	// Design cache hash table, or 0 if nothing cached yet
+   FILE *cache_out;	// Cache file being appended to, or 0
+};
+
+static void ctx_error(Ctx *cx, char *fmt, ...);
 
 
 //
@@ -290,19 +308,19 @@ static double *bessel_poles[10]= {
 //
 
 static void 
-bessel(int order) {
+bessel(Ctx *cx, int order) {
    int a;
 
-   if (order > 10) error("Maximum Bessel order is 10");
-   n_pol= order;
-   memcpy(pol, bessel_poles[order-1], n_pol * sizeof(double));
+   if (order > 10) ctx_error(cx, "Maximum Bessel order is 10");
+   cx->n_pol= order;
+   memcpy(cx->pol, bessel_poles[order-1], cx->n_pol * sizeof(double));
 
    for (a= 0; a<order-1; ) {
-      poltyp[a++]= 2;
-      poltyp[a++]= 0;
+      cx->poltyp[a++]= 2;
+      cx->poltyp[a++]= 0;
    }
    if (a < order) 
-      poltyp[a++]= 1;
+      cx->poltyp[a++]= 1;
 }
 
 //
@@ -312,19 +330,19 @@ bessel(int order) {
 //
 
 static void 
-butterworth(int order) {
+butterworth(Ctx *cx, int order) {
    int a;
    if (order > MAXPZ) 
-      error("Maximum butterworth/chebyshev order is %d", MAXPZ);
-   n_pol= order;
+      ctx_error(cx, "Maximum butterworth/chebyshev order is %d", MAXPZ);
+   cx->n_pol= order;
    for (a= 0; a<order-1; a += 2) {
-      poltyp[a]= 2;
-      poltyp[a+1]= 0;
-      cexpj(pol+a, M_PI - (order-a-1) * 0.5 * M_PI / order);
+      cx->poltyp[a]= 2;
+      cx->poltyp[a+1]= 0;
+      cexpj(cx->pol+a, M_PI - (order-a-1) * 0.5 * M_PI / order);
    }
    if (a < order) {
-      poltyp[a]= 1;
-      pol[a]= -1.0;
+      cx->poltyp[a]= 1;
+      cx->pol[a]= -1.0;
    }
 }
 
@@ -333,26 +351,26 @@ butterworth(int order) {
 //
 
 static void 
-chebyshev(int order, double ripple) {
+chebyshev(Ctx *cx, int order, double ripple) {
    double eps, y;
    double sh, ch;
    int a;
 
-   butterworth(order);
-   if (ripple >= 0.0) error("Chebyshev ripple in dB should be -ve");
+   butterworth(cx, order);
+   if (ripple >= 0.0) ctx_error(cx, "Chebyshev ripple in dB should be -ve");
 
    eps= sqrt(-1.0 + pow(10.0, -0.1 * ripple));
    y= asinh(1.0 / eps) / order;
-   if (y <= 0.0) error("Internal error; chebyshev y-value <= 0.0: %g", y);
+   if (y <= 0.0) ctx_error(cx, "Internal error; chebyshev y-value <= 0.0: %g", y);
    sh= sinh(y);
    ch= cosh(y);
 
-   for (a= 0; a<n_pol; ) {
-      if (poltyp[a] == 1)
-	 pol[a++] *= sh;
+   for (a= 0; a<cx->n_pol; ) {
+      if (cx->poltyp[a] == 1)
+	 cx->pol[a++] *= sh;
       else {
-	 pol[a++] *= sh;
-	 pol[a++] *= ch;
+	 cx->pol[a++] *= sh;
+	 cx->pol[a++] *= ch;
       }
    }
 }
@@ -363,19 +381,19 @@ chebyshev(int order, double ripple) {
 //
 
 static void 
-lowpass(double freq) {
+lowpass(Ctx *cx, double freq) {
    int a;
 
    // Adjust poles
    freq *= TWOPI;
-   for (a= 0; a<n_pol; a++)
-      pol[a] *= freq;
+   for (a= 0; a<cx->n_pol; a++)
+      cx->pol[a] *= freq;
 
    // Add zeros
-   n_zer= n_pol;
-   for (a= 0; a<n_zer; a++) {
-      zer[a]= -INF;
-      zertyp[a]= 1;
+   cx->n_zer= cx->n_pol;
+   for (a= 0; a<cx->n_zer; a++) {
+      cx->zer[a]= -INF;
+      cx->zertyp[a]= 1;
    }
 }
 
@@ -384,27 +402,27 @@ lowpass(double freq) {
 //
 
 static void 
-highpass(double freq) {
+highpass(Ctx *cx, double freq) {
    int a;
 
    // Adjust poles
    freq *= TWOPI;
-   for (a= 0; a<n_pol; ) {
-      if (poltyp[a] == 1) {
-	 pol[a]= freq / pol[a];
+   for (a= 0; a<cx->n_pol; ) {
+      if (cx->poltyp[a] == 1) {
+	 cx->pol[a]= freq / cx->pol[a];
 	 a++;
       } else {
-	 crecip(pol + a);
-	 pol[a++] *= freq;
-	 pol[a++] *= freq;
+	 crecip(cx->pol + a);
+	 cx->pol[a++] *= freq;
+	 cx->pol[a++] *= freq;
       }
    }
 
    // Add zeros
-   n_zer= n_pol;
-   for (a= 0; a<n_zer; a++) {
-      zer[a]= 0.0;
-      zertyp[a]= 1;
+   cx->n_zer= cx->n_pol;
+   for (a= 0; a<cx->n_zer; a++) {
+      cx->zer[a]= 0.0;
+      cx->zertyp[a]= 1;
    }
 }
 
@@ -414,58 +432,58 @@ highpass(double freq) {
 //
 
 static void 
-bandpass(double freq1, double freq2) {
+bandpass(Ctx *cx, double freq1, double freq2) {
    double w0= TWOPI * sqrt(freq1*freq2);
    double bw= 0.5 * TWOPI * (freq2-freq1);
    int a, b;
 
-   if (n_pol * 2 > MAXPZ) 
-      error("Maximum order for bandpass filters is %d", MAXPZ/2);
+   if (cx->n_pol * 2 > MAXPZ) 
+      ctx_error(cx, "Maximum order for bandpass filters is %d", MAXPZ/2);
    
    // Run through the list backwards, expanding as we go
-   for (a= n_pol, b= n_pol*2; a>0; ) {
+   for (a= cx->n_pol, b= cx->n_pol*2; a>0; ) {
       // hba= pole * bw;
       // temp= csqrt(1.0 - square(w0 / hba));
       // pole1= hba * (1.0 + temp);
       // pole2= hba * (1.0 - temp);
 
-      if (poltyp[a-1] == 1) {
+      if (cx->poltyp[a-1] == 1) {
 	 double hba;
 	 a--; b -= 2;
-	 poltyp[b]= 2; poltyp[b+1]= 0;
-	 hba= pol[a] * bw;
-	 cassz(pol+b, 1.0 - (w0 / hba) * (w0 / hba), 0.0);
-	 csqrt(pol+b);
-	 caddz(pol+b, 1.0, 0.0);
-	 cmulr(pol+b, hba);
+	 cx->poltyp[b]= 2; cx->poltyp[b+1]= 0;
+	 hba= cx->pol[a] * bw;
+	 cassz(cx->pol+b, 1.0 - (w0 / hba) * (w0 / hba), 0.0);
+	 csqrt(cx->pol+b);
+	 caddz(cx->pol+b, 1.0, 0.0);
+	 cmulr(cx->pol+b, hba);
       } else {		// Assume poltyp[] data is valid
 	 double hba[2];
 	 a -= 2; b -= 4;
-	 poltyp[b]= 2; poltyp[b+1]= 0;
-	 poltyp[b+2]= 2; poltyp[b+3]= 0;
-	 cass(hba, pol+a);
+	 cx->poltyp[b]= 2; cx->poltyp[b+1]= 0;
+	 cx->poltyp[b+2]= 2; cx->poltyp[b+3]= 0;
+	 cass(hba, cx->pol+a);
 	 cmulr(hba, bw);
-	 cass(pol+b, hba);
-	 crecip(pol+b);
-	 cmulr(pol+b, w0);
-	 csqu(pol+b);
-	 cneg(pol+b);
-	 caddz(pol+b, 1.0, 0.0);
-	 csqrt(pol+b);
-	 cmul(pol+b, hba);
-	 cass(pol+b+2, pol+b);
-	 cneg(pol+b+2);
-	 cadd(pol+b, hba);
-	 cadd(pol+b+2, hba);
+	 cass(cx->pol+b, hba);
+	 crecip(cx->pol+b);
+	 cmulr(cx->pol+b, w0);
+	 csqu(cx->pol+b);
+	 cneg(cx->pol+b);
+	 caddz(cx->pol+b, 1.0, 0.0);
+	 csqrt(cx->pol+b);
+	 cmul(cx->pol+b, hba);
+	 cass(cx->pol+b+2, cx->pol+b);
+	 cneg(cx->pol+b+2);
+	 cadd(cx->pol+b, hba);
+	 cadd(cx->pol+b+2, hba);
       } 
    }
-   n_pol *= 2;
+   cx->n_pol *= 2;
    
    // Add zeros
-   n_zer= n_pol; 
-   for (a= 0; a<n_zer; a++) {
-      zertyp[a]= 1;
-      zer[a]= (a<n_zer/2) ? 0.0 : -INF;
+   cx->n_zer= cx->n_pol; 
+   for (a= 0; a<cx->n_zer; a++) {
+      cx->zertyp[a]= 1;
+      cx->zer[a]= (a<cx->n_zer/2) ? 0.0 : -INF;
    }
 }
 
@@ -475,59 +493,59 @@ bandpass(double freq1, double freq2) {
 //
 
 static void 
-bandstop(double freq1, double freq2) {
+bandstop(Ctx *cx, double freq1, double freq2) {
    double w0= TWOPI * sqrt(freq1*freq2);
    double bw= 0.5 * TWOPI * (freq2-freq1);
    int a, b;
 
-   if (n_pol * 2 > MAXPZ) 
-      error("Maximum order for bandstop filters is %d", MAXPZ/2);
+   if (cx->n_pol * 2 > MAXPZ) 
+      ctx_error(cx, "Maximum order for bandstop filters is %d", MAXPZ/2);
 
    // Run through the list backwards, expanding as we go
-   for (a= n_pol, b= n_pol*2; a>0; ) {
+   for (a= cx->n_pol, b= cx->n_pol*2; a>0; ) {
       // hba= bw / pole;
       // temp= csqrt(1.0 - square(w0 / hba));
       // pole1= hba * (1.0 + temp);
       // pole2= hba * (1.0 - temp);
 
-      if (poltyp[a-1] == 1) {
+      if (cx->poltyp[a-1] == 1) {
 	 double hba;
 	 a--; b -= 2;
-	 poltyp[b]= 2; poltyp[b+1]= 0;
-	 hba= bw / pol[a];
-	 cassz(pol+b, 1.0 - (w0 / hba) * (w0 / hba), 0.0);
-	 csqrt(pol+b);
-	 caddz(pol+b, 1.0, 0.0);
-	 cmulr(pol+b, hba);
+	 cx->poltyp[b]= 2; cx->poltyp[b+1]= 0;
+	 hba= bw / cx->pol[a];
+	 cassz(cx->pol+b, 1.0 - (w0 / hba) * (w0 / hba), 0.0);
+	 csqrt(cx->pol+b);
+	 caddz(cx->pol+b, 1.0, 0.0);
+	 cmulr(cx->pol+b, hba);
       } else {		// Assume poltyp[] data is valid
 	 double hba[2];
 	 a -= 2; b -= 4;
-	 poltyp[b]= 2; poltyp[b+1]= 0;
-	 poltyp[b+2]= 2; poltyp[b+3]= 0;
-	 cass(hba, pol+a);
+	 cx->poltyp[b]= 2; cx->poltyp[b+1]= 0;
+	 cx->poltyp[b+2]= 2; cx->poltyp[b+3]= 0;
+	 cass(hba, cx->pol+a);
 	 crecip(hba);
 	 cmulr(hba, bw);
-	 cass(pol+b, hba);
-	 crecip(pol+b);
-	 cmulr(pol+b, w0);
-	 csqu(pol+b);
-	 cneg(pol+b);
-	 caddz(pol+b, 1.0, 0.0);
-	 csqrt(pol+b);
-	 cmul(pol+b, hba);
-	 cass(pol+b+2, pol+b);
-	 cneg(pol+b+2);
-	 cadd(pol+b, hba);
-	 cadd(pol+b+2, hba);
+	 cass(cx->pol+b, hba);
+	 crecip(cx->pol+b);
+	 cmulr(cx->pol+b, w0);
+	 csqu(cx->pol+b);
+	 cneg(cx->pol+b);
+	 caddz(cx->pol+b, 1.0, 0.0);
+	 csqrt(cx->pol+b);
+	 cmul(cx->pol+b, hba);
+	 cass(cx->pol+b+2, cx->pol+b);
+	 cneg(cx->pol+b+2);
+	 cadd(cx->pol+b, hba);
+	 cadd(cx->pol+b+2, hba);
       } 
    }
-   n_pol *= 2;
+   cx->n_pol *= 2;
    
    // Add zeros
-   n_zer= n_pol; 
-   for (a= 0; a<n_zer; a+=2) {
-      zertyp[a]= 2; zertyp[a+1]= 0;
-      zer[a]= 0.0; zer[a+1]= w0;
+   cx->n_zer= cx->n_pol; 
+   for (a= 0; a<cx->n_zer; a+=2) {
+      cx->zertyp[a]= 2; cx->zertyp[a+1]= 0;
+      cx->zer[a]= 0.0; cx->zer[a+1]= w0;
    }
 }
 
@@ -537,41 +555,41 @@ bandstop(double freq1, double freq2) {
 //
 
 static void 
-s2z_bilinear() {
+s2z_bilinear(Ctx *cx) {
    int a;
-   for (a= 0; a<n_pol; ) {
+   for (a= 0; a<cx->n_pol; ) {
       // Calculate (2 + val) / (2 - val)
-      if (poltyp[a] == 1) {
-	 if (pol[a] == -INF) 
-	    pol[a]= -1.0;
+      if (cx->poltyp[a] == 1) {
+	 if (cx->pol[a] == -INF) 
+	    cx->pol[a]= -1.0;
 	 else 
-	    pol[a]= (2 + pol[a]) / (2 - pol[a]);
+	    cx->pol[a]= (2 + cx->pol[a]) / (2 - cx->pol[a]);
 	 a++;
       } else {
 	 double val[2];
-	 cass(val, pol+a);
+	 cass(val, cx->pol+a);
 	 cneg(val);
 	 caddz(val, 2, 0);
-	 caddz(pol+a, 2, 0);
-	 cdiv(pol+a, val);
+	 caddz(cx->pol+a, 2, 0);
+	 cdiv(cx->pol+a, val);
 	 a += 2;
       }
    }
-   for (a= 0; a<n_zer; ) {
+   for (a= 0; a<cx->n_zer; ) {
       // Calculate (2 + val) / (2 - val)
-      if (zertyp[a] == 1) {
-	 if (zer[a] == -INF) 
-	    zer[a]= -1.0;
+      if (cx->zertyp[a] == 1) {
+	 if (cx->zer[a] == -INF) 
+	    cx->zer[a]= -1.0;
 	 else 
-	    zer[a]= (2 + zer[a]) / (2 - zer[a]);
+	    cx->zer[a]= (2 + cx->zer[a]) / (2 - cx->zer[a]);
 	 a++;
       } else {
 	 double val[2];
-	 cass(val, zer+a);
+	 cass(val, cx->zer+a);
 	 cneg(val);
 	 caddz(val, 2, 0);
-	 caddz(zer+a, 2, 0);
-	 cdiv(zer+a, val);
+	 caddz(cx->zer+a, 2, 0);
+	 cdiv(cx->zer+a, val);
 	 a += 2;
       }
    }
@@ -582,33 +600,33 @@ s2z_bilinear() {
 //
     
 static void 
-s2z_matchedZ() {
+s2z_matchedZ(Ctx *cx) {
    int a;
    
-   for (a= 0; a<n_pol; ) {
+   for (a= 0; a<cx->n_pol; ) {
       // Calculate cexp(val)
-      if (poltyp[a] == 1) {
-	 if (pol[a] == -INF) 
-	    pol[a]= 0.0;
+      if (cx->poltyp[a] == 1) {
+	 if (cx->pol[a] == -INF) 
+	    cx->pol[a]= 0.0;
 	 else 
-	    pol[a]= exp(pol[a]);
+	    cx->pol[a]= exp(cx->pol[a]);
 	 a++;
       } else {
-	 cexp(pol+a);
+	 cexp(cx->pol+a);
 	 a += 2;
       }
    }
 
-   for (a= 0; a<n_zer; ) {
+   for (a= 0; a<cx->n_zer; ) {
       // Calculate cexp(val)
-      if (zertyp[a] == 1) {
-	 if (zer[a] == -INF) 
-	    zer[a]= 0.0;
+      if (cx->zertyp[a] == 1) {
+	 if (cx->zer[a] == -INF) 
+	    cx->zer[a]= 0.0;
 	 else 
-	    zer[a]= exp(zer[a]);
+	    cx->zer[a]= exp(cx->zer[a]);
 	 a++;
       } else {
-	 cexp(zer+a);
+	 cexp(cx->zer+a);
 	 a += 2;
       }
    }
@@ -632,14 +650,14 @@ s2z_matchedZ() {
 //
 
 static FidFilter*
-z2fidfilter(double gain, int cbm) {
+z2fidfilter(Ctx *cx, double gain, int cbm) {
    int n_head, n_val;
    int a;
    FidFilter *rv;
    FidFilter *ff;
 
-   n_head= 1 + n_pol + n_zer;	 // Worst case: gain + 2-element IIR/FIR
-   n_val= 1 + 2 * (n_pol+n_zer); //   for each pole/zero
+   n_head= 1 + cx->n_pol + cx->n_zer;	 // Worst case: gain + 2-element IIR/FIR
+   n_val= 1 + 2 * (cx->n_pol+cx->n_zer); //   for each pole/zero
 
    rv= ff= FFALLOC(n_head, n_val);
 
@@ -649,78 +667,88 @@ z2fidfilter(double gain, int cbm) {
    ff= FFNEXT(ff);
 
    // Output as much as possible as 2x2 IIR/FIR filters
-   for (a= 0; a <= n_pol-2 && a <= n_zer-2; a += 2) {
+   for (a= 0; a <= cx->n_pol-2 && a <= cx->n_zer-2; a += 2) {
       // Look for a pair of values for an IIR
-      if (poltyp[a] == 1 && poltyp[a+1] == 1) {
+      if (cx->poltyp[a] == 1 && cx->poltyp[a+1] == 1) {
 	 // Two real values
          ff->typ= 'I';
          ff->len= 3;
          ff->val[0]= 1;
-         ff->val[1]= -(pol[a] + pol[a+1]);
-         ff->val[2]= pol[a] * pol[a+1];
+         ff->val[1]= -(cx->pol[a] + cx->pol[a+1]);
+         ff->val[2]= cx->pol[a] * cx->pol[a+1];
 	 ff= FFNEXT(ff); 
-      } else if (poltyp[a] == 2) {
+      } else if (cx->poltyp[a] == 2) {
 	 // A complex value and its conjugate pair
          ff->typ= 'I';
          ff->len= 3;
          ff->val[0]= 1;
-         ff->val[1]= -2 * pol[a];
-         ff->val[2]= pol[a] * pol[a] + pol[a+1] * pol[a+1];
+         ff->val[1]= -2 * cx->pol[a];
+         ff->val[2]= cx->pol[a] * cx->pol[a] + cx->pol[a+1] * cx->pol[a+1];
 	 ff= FFNEXT(ff); 
-      } else error("Internal error -- bad poltyp[] values for z2fidfilter()");	 
+      } else {
+	 free(rv);
+	 ctx_error(cx, "Internal error -- bad poltyp[] values for z2fidfilter()");
+      }
 
       // Look for a pair of values for an FIR
-      if (zertyp[a] == 1 && zertyp[a+1] == 1) {
+      if (cx->zertyp[a] == 1 && cx->zertyp[a+1] == 1) {
 	 // Two real values
 	 // Skip if constant and 0/0
-	 if (!cbm || zer[a] != 0.0 || zer[a+1] != 0.0) {
+	 if (!cbm || cx->zer[a] != 0.0 || cx->zer[a+1] != 0.0) {
 	    ff->typ= 'F';
 	    ff->cbm= cbm;
 	    ff->len= 3;
 	    ff->val[0]= 1;
-	    ff->val[1]= -(zer[a] + zer[a+1]);
-	    ff->val[2]= zer[a] * zer[a+1];
+	    ff->val[1]= -(cx->zer[a] + cx->zer[a+1]);
+	    ff->val[2]= cx->zer[a] * cx->zer[a+1];
 	    ff= FFNEXT(ff); 
 	 }
-      } else if (zertyp[a] == 2) {
+      } else if (cx->zertyp[a] == 2) {
 	 // A complex value and its conjugate pair
 	 // Skip if constant and 0/0
-	 if (!cbm || zer[a] != 0.0 || zer[a+1] != 0.0) {
+	 if (!cbm || cx->zer[a] != 0.0 || cx->zer[a+1] != 0.0) {
 	    ff->typ= 'F';
 	    ff->cbm= cbm;
 	    ff->len= 3;
 	    ff->val[0]= 1;
-	    ff->val[1]= -2 * zer[a];
-	    ff->val[2]= zer[a] * zer[a] + zer[a+1] * zer[a+1];
+	    ff->val[1]= -2 * cx->zer[a];
+	    ff->val[2]= cx->zer[a] * cx->zer[a] + cx->zer[a+1] * cx->zer[a+1];
 	    ff= FFNEXT(ff); 
 	 }
-      } else error("Internal error -- bad zertyp[] values");	 
+      } else {
+	 free(rv);
+	 ctx_error(cx, "Internal error -- bad zertyp[] values");
+      }
    }
 
    // Clear up any remaining bits and pieces.  Should only be a 1x1
    // IIR/FIR.
-   if (n_pol-a == 0 && n_zer-a == 0) 
+   if (cx->n_pol-a == 0 && cx->n_zer-a == 0) 
       ;
-   else if (n_pol-a == 1 && n_zer-a == 1) {
-      if (poltyp[a] != 1 || zertyp[a] != 1) 
-	 error("Internal error; bad poltyp or zertyp for final pole/zero");
+   else if (cx->n_pol-a == 1 && cx->n_zer-a == 1) {
+      if (cx->poltyp[a] != 1 || cx->zertyp[a] != 1) {
+	 free(rv);
+	 ctx_error(cx, "Internal error; bad poltyp or zertyp for final pole/zero");
+      }
       ff->typ= 'I';
       ff->len= 2;
       ff->val[0]= 1;
-      ff->val[1]= -pol[a];
+      ff->val[1]= -cx->pol[a];
       ff= FFNEXT(ff); 
 
       // Skip FIR if it is constant and zero
-      if (!cbm || zer[a] != 0.0) {
+      if (!cbm || cx->zer[a] != 0.0) {
 	 ff->typ= 'F';
 	 ff->cbm= cbm;
 	 ff->len= 2;
 	 ff->val[0]= 1;
-	 ff->val[1]= -zer[a];
+	 ff->val[1]= -cx->zer[a];
 	 ff= FFNEXT(ff); 
       }
-   } else 
-      error("Internal error: unexpected poles/zeros at end of list");
+   } else {
+      free(rv);
+      ctx_error(cx, "Internal error: unexpected poles/zeros at end of list");
+   }
 
    // End of list
    ff->typ= 0;
@@ -739,7 +767,7 @@ z2fidfilter(double gain, int cbm) {
 //
 
 static void 
-bandpass_res(double freq, double qfact) {
+bandpass_res(Ctx *cx, double freq, double qfact) {
    double mag;
    double th0, th1, th2;
    double theta= freq * TWOPI;
@@ -747,14 +775,14 @@ bandpass_res(double freq, double qfact) {
    double tmp1[2], tmp2[2], tmp3[2], tmp4[2];
    int cnt;
 
-   n_pol= 2;
-   poltyp[0]= 2; poltyp[1]= 0;
-   n_zer= 2;
-   zertyp[0]= 1; zertyp[1]= 1;
-   zer[0]= 1; zer[1]= -1;
+   cx->n_pol= 2;
+   cx->poltyp[0]= 2; cx->poltyp[1]= 0;
+   cx->n_zer= 2;
+   cx->zertyp[0]= 1; cx->zertyp[1]= 1;
+   cx->zer[0]= 1; cx->zer[1]= -1;
 
    if (qfact == 0.0) {
-      cexpj(pol, theta);
+      cexpj(cx->pol, theta);
       return;
    }
 
@@ -764,8 +792,8 @@ bandpass_res(double freq, double qfact) {
    th0= 0; th2= M_PI;
    for (cnt= 60; cnt > 0; cnt--) {
       th1= 0.5 * (th0 + th2);
-      cexpj(pol, th1);
-      cmulr(pol, mag);
+      cexpj(cx->pol, th1);
+      cmulr(cx->pol, mag);
       
       // Evaluate response of filter for Z= val
       memcpy(tmp1, val, 2*sizeof(double));
@@ -775,8 +803,8 @@ bandpass_res(double freq, double qfact) {
       csubz(tmp1, 1, 0);
       csubz(tmp2, -1, 0);
       cmul(tmp1, tmp2);
-      csub(tmp3, pol); cconj(pol);
-      csub(tmp4, pol); cconj(pol);
+      csub(tmp3, cx->pol); cconj(cx->pol);
+      csub(tmp4, cx->pol); cconj(cx->pol);
       cmul(tmp3, tmp4);
       cdiv(tmp1, tmp3);
       
@@ -796,10 +824,10 @@ bandpass_res(double freq, double qfact) {
 //
 
 static void 
-bandstop_res(double freq, double qfact) {
-   bandpass_res(freq, qfact);
-   zertyp[0]= 2; zertyp[1]= 0;
-   cexpj(zer, TWOPI * freq);
+bandstop_res(Ctx *cx, double freq, double qfact) {
+   bandpass_res(cx, freq, qfact);
+   cx->zertyp[0]= 2; cx->zertyp[1]= 0;
+   cexpj(cx->zer, TWOPI * freq);
 }
 
 //
@@ -807,11 +835,11 @@ bandstop_res(double freq, double qfact) {
 //
 
 static void 
-allpass_res(double freq, double qfact) {
-   bandpass_res(freq, qfact);
-   zertyp[0]= 2; zertyp[1]= 0;
-   memcpy(zer, pol, 2*sizeof(double));
-   cmulr(zer, 1.0 / (zer[0]*zer[0] + zer[1]*zer[1]));
+allpass_res(Ctx *cx, double freq, double qfact) {
+   bandpass_res(cx, freq, qfact);
+   cx->zertyp[0]= 2; cx->zertyp[1]= 0;
+   memcpy(cx->zer, cx->pol, 2*sizeof(double));
+   cmulr(cx->zer, 1.0 / (cx->zer[0]*cx->zer[0] + cx->zer[1]*cx->zer[1]));
 }
 
 //
@@ -819,13 +847,13 @@ allpass_res(double freq, double qfact) {
 //
 
 static void 
-prop_integral(double freq) {
-   n_pol= 1;
-   poltyp[0]= 1;
-   pol[0]= 0.0;
-   n_zer= 1;
-   zertyp[0]= 1;
-   zer[0]= -TWOPI * freq;
+prop_integral(Ctx *cx, double freq) {
+   cx->n_pol= 1;
+   cx->poltyp[0]= 1;
+   cx->pol[0]= 0.0;
+   cx->n_zer= 1;
+   cx->zertyp[0]= 1;
+   cx->zer[0]= -TWOPI * freq;
 }
    
 // END //
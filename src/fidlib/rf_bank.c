@@ -0,0 +1,153 @@
+//
+//	Filter-bank step routine for the command-list code.
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.  This
+//        file is released under the GNU Lesser General Public License
+//        (LGPL) version 2.1 as published by the Free Software
+//        Foundation.  See the file COPYING_LIB for details, or visit
+//        <http://www.fsf.org/licenses/licenses.html>.
+//
+//	This is included several times by rf_cmdlist.c to generate a
+//	version for each vector width.  It works through the same
+//	command list as filter_step(), but on BANK_W streams at once,
+//	using these macros to do the arithmetic:
+//
+//	  BANK_STEP	Name of routine to generate
+//	  BANK_ATTR	Attributes for the routine (e.g. target CPU)
+//	  BANK_T	Type of values: double or float
+//	  BANK_W	Number of streams handled in each vector
+//	  V		Vector type
+//	  V_LD(p)	Load a vector from p[0..BANK_W-1]
+//	  V_ST(p,v)	Store a vector to p[0..BANK_W-1]
+//	  V_SET1(x)	Vector with x in every element
+//	  V_ZERO	Vector of zeros
+//	  V_ADD, V_SUB, V_MUL	Arithmetic
+//
+//	The operations are done in the same order as filter_step(),
+//	and never fused, so each stream gives exactly the same results
+//	as it would running alone.
+//
+
+BANK_ATTR static void
+BANK_STEP(RunBank *bk) {
+   int n_pad= bk->n_pad;
+   BANK_T *buf= (BANK_T*)bk->buf;
+   BANK_T *row0= (BANK_T*)bk->row0;
+   BANK_T *in= (BANK_T*)bk->in;
+   BANK_T *out= (BANK_T*)bk->out;
+   int j;
+
+   // Keep the first row, then shift the rest down a row, as
+   // filter_step() does for a single buffer
+   memcpy(row0, buf, n_pad * sizeof(BANK_T));
+   memmove(buf, buf + n_pad, bk->mov_cnt);
+
+   for (j= 0; j<n_pad; j += BANK_W) {
+      BANK_T *coef= (BANK_T*)bk->coef;
+      uchar *cmd= bk->cmd;
+      BANK_T *bp= buf + j;
+      V iir= V_LD(in + j);
+      V fir= V_ZERO;
+      V tmp= V_LD(row0 + j);
+      uchar ch;
+      int cnt;
+
+#define IIR \
+       iir= V_SUB(iir, V_MUL(V_SET1(*coef), tmp)); coef++; \
+       tmp= V_LD(bp); bp += n_pad;
+#define FIR \
+       fir= V_ADD(fir, V_MUL(V_SET1(*coef), tmp)); coef++; \
+       tmp= V_LD(bp); bp += n_pad;
+#define BOTH \
+       iir= V_SUB(iir, V_MUL(V_SET1(coef[0]), tmp)); \
+       fir= V_ADD(fir, V_MUL(V_SET1(coef[1]), tmp)); coef += 2; \
+       tmp= V_LD(bp); bp += n_pad;
+#define ENDIIR \
+       iir= V_SUB(iir, V_MUL(V_SET1(*coef), tmp)); coef++; \
+       tmp= V_LD(bp); V_ST(bp, iir); bp += n_pad;
+#define ENDFIR \
+       fir= V_ADD(fir, V_MUL(V_SET1(*coef), tmp)); coef++; \
+       tmp= V_LD(bp); V_ST(bp, iir); bp += n_pad; \
+       iir= V_ADD(fir, V_MUL(V_SET1(*coef), iir)); coef++; \
+       fir= V_ZERO;
+#define ENDBOTH \
+       iir= V_SUB(iir, V_MUL(V_SET1(coef[0]), tmp)); \
+       fir= V_ADD(fir, V_MUL(V_SET1(coef[1]), tmp)); coef += 2; \
+       tmp= V_LD(bp); V_ST(bp, iir); bp += n_pad; \
+       iir= V_ADD(fir, V_MUL(V_SET1(*coef), iir)); coef++; \
+       fir= V_ZERO;
+#define GAIN \
+       iir= V_MUL(iir, V_SET1(*coef)); coef++;
+
+      while ((ch= *cmd++)) switch (ch) {
+       case 1:
+	  IIR; break;
+       case 2:
+	  IIR; IIR; break;
+       case 3:
+	  IIR; IIR; IIR; break;
+       case 4:
+	  cnt= *cmd++;
+	  do { IIR; IIR; IIR; IIR; } while (--cnt > 0);
+	  break;
+       case 5:
+	  FIR; break;
+       case 6:
+	  FIR; FIR; break;
+       case 7:
+	  FIR; FIR; FIR; break;
+       case 8:
+	  cnt= *cmd++;
+	  do { FIR; FIR; FIR; FIR; } while (--cnt > 0);
+	  break;
+       case 9:
+	  BOTH; break;
+       case 10:
+	  BOTH; BOTH; break;
+       case 11:
+	  BOTH; BOTH; BOTH; break;
+       case 12:
+	  cnt= *cmd++;
+	  do { BOTH; BOTH; BOTH; BOTH; } while (--cnt > 0);
+	  break;
+       case 13:
+	  ENDIIR; break;
+       case 14:
+	  ENDFIR; break;
+       case 15:
+	  ENDBOTH; break;
+       case 16:
+	  IIR; ENDIIR; break;
+       case 17:
+	  FIR; ENDFIR; break;
+       case 18:
+	  BOTH; ENDBOTH; break;
+       case 19:
+	  cnt= *cmd++;
+	  do { IIR; ENDIIR; } while (--cnt > 0);
+	  break;
+       case 20:
+	  cnt= *cmd++;
+	  do { FIR; ENDFIR; } while (--cnt > 0);
+	  break;
+       case 21:
+	  cnt= *cmd++;
+	  do { BOTH; ENDBOTH; } while (--cnt > 0);
+	  break;
+       case 22:
+	  GAIN; break;
+      }
+
+#undef IIR
+#undef FIR
+#undef BOTH
+#undef ENDIIR
+#undef ENDFIR
+#undef ENDBOTH
+#undef GAIN
+
+      V_ST(out + j, iir);
+   }
+}
+
+// END //
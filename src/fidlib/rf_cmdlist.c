@@ -17,20 +17,61 @@
 //	portable (unlike the JIT option).
 //
 
+#include "rf_fft.c"
+
 typedef struct Run {
    int magic;		// Magic: 0x64966325
    int buf_size;	// Length of working buffer required in doubles	
    double *coef;	// Coefficient list
    char *cmd;		// Command list
+   void *jit;		// Compiled routine if built with RF_JIT (see rf_jit.c), or 0
+   int n_coef;		// Number of coefficients
+   float *coef_f;	// Single-precision coefficients if made by fid_run_new_f(), else 0
+   RunFft *fft;		// Long FIR stages to do by FFT in blocks (see rf_fft.c), or 0
+   int fft_tmp;		// Doubles of scratch space each buffer needs for 'fft', or 0
 } Run;
 
+//
+//	A buffer holds the filter state in buf[], and if the filter
+//	has FFT stages, the scratch space for them after that, so
+//	that running a block needs no allocations.
+//
+
 typedef struct RunBuf {
    double *coef;
    char *cmd;
+   RunFft *fft;
+   double *tmp;		// Scratch space for the FFT stages, or 0
    int mov_cnt;		// Number of bytes to memmove
+   int len;		// Length of buf[] in bytes
    double buf[0];
 } RunBuf;
 
+// Buffer for a single-precision filter; the same apart from the types
+typedef struct RunBufF {
+   float *coef;
+   char *cmd;
+   RunFft *fft;
+   double *tmp;
+   int mov_cnt;
+   int len;
+   float buf[0];
+} RunBufF;
+
+// Size of each buffer element for the given Run
+#define RUN_ESIZ(rr) ((rr)->coef_f ? sizeof(float) : sizeof(double))
+
+// Number of elements in buf[] for the given Run (minimum one element
+// to avoid problems), and the offset of the FFT scratch space after it
+#define RUN_SIZ(rr) ((rr)->buf_size ? (rr)->buf_size : 1)
+#define RUN_TMPOFF(rr) ((sizeof(RunBuf) + RUN_SIZ(rr) * RUN_ESIZ(rr) + \
+			 sizeof(double)-1) & ~(sizeof(double)-1))
+
+#ifdef RF_JIT
+static void jit_new(Run *rr, FidFunc **funcpp);
+static void jit_free(Run *rr);
+#endif
+
 
 //
 //	Filter processing routine.  This is designed to avoid too many
@@ -67,125 +108,29 @@ typedef struct RunBuf {
 //
 //	Most filters are made up of 2x2 IIR/FIR pairs, which means a
 //	list of command 18 bytes.  The other big job would be long FIR
-//	filters.  These have to be handled with a list of 7,6,5
-//	commands, plus a 13 command.
+//	filters.  These have to be handled with a list of 8,7,6,5
+//	commands, plus a 14 command, although in blocks they are done
+//	by FFT instead (see rf_fft.c).
 //
 
 typedef unsigned char uchar;
 
-static double 
-filter_step(void *fbuf, double iir) {
-   double *coef= ((RunBuf*)fbuf)->coef;
-   uchar *cmd= ((RunBuf*)fbuf)->cmd;
-   double *buf= &((RunBuf*)fbuf)->buf[0];
-   uchar ch;
-   double fir= 0;
-   double tmp= buf[0];
-   int cnt;
-
-   // Using a memmove first is faster on gcc -O6 / ix86 than moving
-   // the values whilst working through the buffers.
-   memmove(buf, buf+1, ((RunBuf*)fbuf)->mov_cnt);
-
-#define IIR \
-       iir -= *coef++ * tmp; \
-       tmp= *buf++;
-#define FIR \
-       fir += *coef++ * tmp; \
-       tmp= *buf++;
-#define BOTH \
-       iir -= *coef++ * tmp; \
-       fir += *coef++ * tmp; \
-       tmp= *buf++;
-#define ENDIIR \
-       iir -= *coef++ * tmp; \
-       tmp= *buf++; \
-       buf[-1]= iir;
-#define ENDFIR \
-       fir += *coef++ * tmp; \
-       tmp= *buf++; \
-       buf[-1]= iir; \
-       iir= fir + *coef++ * iir; \
-       fir= 0
-#define ENDBOTH \
-       iir -= *coef++ * tmp; \
-       fir += *coef++ * tmp; \
-       tmp= *buf++; \
-       buf[-1]= iir; \
-       iir= fir + *coef++ * iir; \
-       fir= 0
-#define GAIN \
-       iir *= *coef++
-
-   while ((ch= *cmd++)) switch (ch) {
-    case 1:
-       IIR; break;
-    case 2:
-       IIR; IIR; break;
-    case 3:
-       IIR; IIR; IIR; break;
-    case 4:
-       cnt= *cmd++; 
-       do { IIR; IIR; IIR; IIR; } while (--cnt > 0);
-       break;
-    case 5:
-       FIR; break;
-    case 6:
-       FIR; FIR; break;
-    case 7:
-       FIR; FIR; FIR; break;
-    case 8:
-       cnt= *cmd++; 
-       do { FIR; FIR; FIR; FIR; } while (--cnt > 0);
-       break;
-    case 9:
-       BOTH; break;
-    case 10:
-       BOTH; BOTH; break;
-    case 11:
-       BOTH; BOTH; BOTH; break;
-    case 12:
-       cnt= *cmd++; 
-       do { BOTH; BOTH; BOTH; BOTH; } while (--cnt > 0);
-       break;
-    case 13:
-       ENDIIR; break;
-    case 14:
-       ENDFIR; break;
-    case 15:
-       ENDBOTH; break;
-    case 16:
-       IIR; ENDIIR; break;
-    case 17:
-       FIR; ENDFIR; break;
-    case 18:
-       BOTH; ENDBOTH; break;
-    case 19:
-       cnt= *cmd++; 
-       do { IIR; ENDIIR; } while (--cnt > 0);
-       break;
-    case 20:
-       cnt= *cmd++; 
-       do { FIR; ENDFIR; } while (--cnt > 0);
-       break;
-    case 21:
-       cnt= *cmd++; 
-       do { BOTH; ENDBOTH; } while (--cnt > 0);
-       break;
-    case 22:
-       GAIN; break;
-   }
-
-#undef IIR
-#undef FIR
-#undef BOTH
-#undef ENDIIR
-#undef ENDFIR
-#undef ENDBOTH
-#undef GAIN
+// The step and block routines, in double and single precision
+#define RT double
+#define RTBUF RunBuf
+#define RFN(name) name
+#include "rf_step.c"
+#undef RT
+#undef RTBUF
+#undef RFN
 
-   return iir;
-}
+#define RT float
+#define RTBUF RunBufF
+#define RFN(name) name##_f
+#include "rf_step.c"
+#undef RT
+#undef RTBUF
+#undef RFN
 
 
 //
@@ -221,6 +166,7 @@ fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
    int coef_cnt, coef_max;
    int cmd_cnt, cmd_max;
    int filt_cnt= 0;
+   RunFft *fft= 0, **fftp= &fft;
    Run *rr;
 
    for (ff= filt; ff->len; ff= FFNEXT(ff))
@@ -292,6 +238,11 @@ fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
 	 *dp++= iir[1]*adj;
       } else {
 	 prev= 0;	// Just cancel 'prev' as we only use it for 16-18,19-21
+	 if (!n_iir && RUN_FFT_MIN && n_fir >= RUN_FFT_MIN) {
+	    *fftp= fft_new(fir, n_fir);
+	    (*fftp)->pos= cp - cmd_tmp;
+	    fftp= &(*fftp)->nxt;
+	 }
 	 if (cnt > n_fir) {
 	    a= 0; 
 	    while (cnt > n_fir && cnt > 2) {
@@ -360,8 +311,12 @@ fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
 		   cmd_cnt*sizeof(char));
    rr->magic= 0x64966325;
    rr->buf_size= buf_size;
+   rr->n_coef= coef_cnt;
    rr->coef= (double*)(rr+1);
    rr->cmd= (char*)(rr->coef + coef_cnt);
+   rr->fft= fft;
+   for (; fft; fft= fft->nxt)
+      if (fft->n_tmp > rr->fft_tmp) rr->fft_tmp= fft->n_tmp;
    memcpy(rr->coef, coef_tmp, coef_cnt*sizeof(double));
    memcpy(rr->cmd, cmd_tmp, cmd_cnt*sizeof(char));
 
@@ -377,6 +332,40 @@ fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
    free(cmd_tmp);
 
    *funcpp= filter_step;
+#ifdef RF_JIT
+   jit_new(rr, funcpp);
+#endif
+   return rr;
+}
+
+//
+//	Create a single-precision version of a filter.  This is just
+//	like fid_run_new(), except that the function returned works
+//	in floats, and so do the buffers created from the returned
+//	handle with fid_run_newbuf() or fid_run_initbuf(), and the
+//	banks made with fid_bank_new().  This halves the memory used
+//	for the buffers, and doubles the number of streams a bank can
+//	process in each vector, but loses accuracy, especially for
+//	high-order filters and filters with a low cutoff relative to
+//	the sampling rate.  Use test-accuracy to see how much.
+//
+
+void *
+fid_run_new_f(FidFilter *filt, FidFuncF **funcpp) {
+   FidFunc *dmy;
+   Run *rr= fid_run_new(filt, &dmy);
+   int a;
+
+#ifdef RF_JIT
+   // The JIT only generates double-precision code
+   jit_free(rr);
+   rr->jit= 0;
+#endif
+   rr->coef_f= ALLOC_ARR(rr->n_coef ? rr->n_coef : 1, float);
+   for (a= 0; a<rr->n_coef; a++)
+      rr->coef_f[a]= (float)rr->coef[a];
+
+   *funcpp= filter_step_f;
    return rr;
 }
 
@@ -387,19 +376,13 @@ fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
 void *
 fid_run_newbuf(void *run) {
    Run *rr= run;
-   RunBuf *rb;
-   int siz;
+   void *rb;
 
    if (rr->magic != 0x64966325)
       error("Bad handle passed to fid_run_newbuf()");
    
-   siz= rr->buf_size ? rr->buf_size : 1;   // Minimum one element to avoid problems
-   rb= Alloc(sizeof(RunBuf) + siz * sizeof(double));
-   rb->coef= rr->coef;
-   rb->cmd= rr->cmd;
-   rb->mov_cnt= (siz-1) * sizeof(double);
-   // rb->buf[] already zerod
-
+   rb= Alloc(fid_run_bufsize(run));
+   fid_run_initbuf(run, rb);
    return rb;
 }
 
@@ -410,13 +393,11 @@ fid_run_newbuf(void *run) {
 int 
 fid_run_bufsize(void *run) {
    Run *rr= run;
-   int siz;
 
    if (rr->magic != 0x64966325)
       error("Bad handle passed to fid_run_bufsize()");
    
-   siz= rr->buf_size ? rr->buf_size : 1;   // Minimum one element to avoid problems
-   return sizeof(RunBuf) + siz * sizeof(double);
+   return RUN_TMPOFF(rr) + rr->fft_tmp * sizeof(double);
 }
 
 //
@@ -432,16 +413,17 @@ void
 fid_run_initbuf(void *run, void *buf) {
    Run *rr= run;
    RunBuf *rb= buf;
-   int siz;
 
    if (rr->magic != 0x64966325)
       error("Bad handle passed to fid_run_initbuf()");
    
-   siz= rr->buf_size ? rr->buf_size : 1;   // Minimum one element to avoid problems
-   rb->coef= rr->coef;
+   rb->coef= rr->coef_f ? (double*)rr->coef_f : rr->coef;
    rb->cmd= rr->cmd;
-   rb->mov_cnt= (siz-1) * sizeof(double);
-   memset(rb->buf, 0, rb->mov_cnt + sizeof(double));
+   rb->fft= rr->fft;
+   rb->tmp= rr->fft_tmp ? (double*)((char*)rb + RUN_TMPOFF(rr)) : 0;
+   rb->len= RUN_SIZ(rr) * RUN_ESIZ(rr);
+   rb->mov_cnt= rb->len - RUN_ESIZ(rr);
+   memset(rb->buf, 0, rb->len);
 }
 
 //
@@ -454,7 +436,7 @@ fid_run_initbuf(void *run, void *buf) {
 void 
 fid_run_zapbuf(void *buf) {
    RunBuf *rb= buf;
-   memset(rb->buf, 0, rb->mov_cnt + sizeof(double));
+   memset(rb->buf, 0, rb->len);
 }   
    
 
@@ -473,7 +455,406 @@ fid_run_freebuf(void *runbuf) {
 
 void 
 fid_run_free(void *run) {
+   RunFft *ft;
+#ifdef RF_JIT
+   jit_free(run);
+#endif
+   while ((ft= ((Run*)run)->fft)) {
+      ((Run*)run)->fft= ft->nxt;
+      free(ft);
+   }
+   free(((Run*)run)->coef_f);
    free(run);
 }
 
+//
+//	Arenas.  Instead of each buffer being a separate allocation,
+//	the buffers for a whole set of filters can be placed one after
+//	another in a single aligned block of memory.  If they are made
+//	in the order they will be run, then running through them
+//	streams through the cache instead of hopping about the heap.
+//	The size needed is found first by adding up fid_arena_bufsize()
+//	for every buffer that will be made.  Buffers made this way
+//	work just like any others, except that they are released all
+//	together with fid_arena_free(), not with fid_run_freebuf().
+//
+
+typedef struct RunArena {
+   int magic;		// Magic: 0x64966327
+   char *mem;		// Allocated memory, for free()
+   char *pos;		// Where the next buffer goes
+   char *end;		// End of the space
+} RunArena;
+
+#define ARENA_ALIGN 64		// Alignment of the arena (a cache line)
+#define ARENA_BUF_ALIGN 16	// Alignment of each buffer within it
+
+//
+//	Return the space one buffer of the given filter takes in an
+//	arena
+//
+
+int 
+fid_arena_bufsize(void *run) {
+   return (fid_run_bufsize(run) + ARENA_BUF_ALIGN-1) & ~(ARENA_BUF_ALIGN-1);
+}
+
+//
+//	Create an arena with room for 'size' bytes of buffers
+//
+
+void *
+fid_arena_new(int size) {
+   RunArena *ar= ALLOC(RunArena);
+   size_t adj;
+
+   ar->magic= 0x64966327;
+   ar->mem= Alloc(size + ARENA_ALIGN);
+   adj= (size_t)ar->mem & (ARENA_ALIGN-1);
+   ar->pos= ar->mem + (adj ? ARENA_ALIGN - adj : 0);
+   ar->end= ar->pos + size;
+   return ar;
+}
+
+//
+//	Create a new instance of the given filter in the arena
+//
+
+void *
+fid_arena_newbuf(void *arena, void *run) {
+   RunArena *ar= arena;
+   int siz= fid_arena_bufsize(run);
+   void *rv;
+
+   if (ar->magic != 0x64966327)
+      error("Bad handle passed to fid_arena_newbuf()");
+   if (ar->pos + siz > ar->end)
+      error("fid_arena_newbuf(): arena is full");
+
+   rv= ar->pos;
+   ar->pos += siz;
+   fid_run_initbuf(run, rv);
+   return rv;
+}
+
+//
+//	Delete an arena, along with all the buffers in it
+//
+
+void 
+fid_arena_free(void *arena) {
+   RunArena *ar= arena;
+   free(ar->mem);
+   free(ar);
+}
+
+//
+//	Filter banks: a number of independent streams run through the
+//	same filter in a single call, one value in and one out for
+//	each.  The filter state is kept as a matrix, with one row for
+//	each element of a RunBuf's buf[] and one column for each
+//	stream, padded up to a multiple of the widest vector.  That
+//	way the same command list can be interpreted once for a whole
+//	vector of streams, using SSE2 or AVX where available.  AVX is
+//	used only if the CPU running the code supports it, so the same
+//	binary still runs on older machines.  A bank of a filter made
+//	with fid_run_new_f() works in floats, with twice as many
+//	streams in each vector.
+//
+
+typedef struct RunBank {
+   int magic;		// Magic: 0x64966326
+   int n_buf;		// Number of streams
+   int n_pad;		// Number of streams padded up to a multiple of the widest vector
+   int flt;		// Single precision: the arrays below (and coef) are really float
+   int mov_cnt;		// Number of bytes to memmove
+   double *coef;	// Coefficient list (from the Run)
+   uchar *cmd;		// Command list (from the Run)
+   void (*step)(struct RunBank *);	// Step routine for this CPU
+   double *in, *out;	// Input and output values for the step (n_pad each)
+   double *row0;	// Copy of the first row of buf[] during the step
+   double *buf;		// Filter state, siz rows of n_pad values
+   int siz;		// Number of rows in buf[]
+   char *mem;		// Allocated memory, for free()
+} RunBank;
+
+#define BANK_ALIGN 32		// Alignment of arrays, to suit AVX
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BANK_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+   (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BANK_AVX
+#include <immintrin.h>
+#endif
+
+// Plain C versions, one stream at a time, in double and float
+#define BANK_STEP bank_step_c
+#define BANK_ATTR
+#define BANK_T double
+#define BANK_W 1
+#define V double
+#define V_LD(p) (*(p))
+#define V_ST(p,v) (*(p)= (v))
+#define V_SET1(x) (x)
+#define V_ZERO 0.0
+#define V_ADD(a,b) ((a) + (b))
+#define V_SUB(a,b) ((a) - (b))
+#define V_MUL(a,b) ((a) * (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+
+#define BANK_STEP bank_step_c_f
+#define BANK_ATTR
+#define BANK_T float
+#define BANK_W 1
+#define V float
+#define V_LD(p) (*(p))
+#define V_ST(p,v) (*(p)= (v))
+#define V_SET1(x) (x)
+#define V_ZERO 0.0f
+#define V_ADD(a,b) ((a) + (b))
+#define V_SUB(a,b) ((a) - (b))
+#define V_MUL(a,b) ((a) * (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+
+#ifdef BANK_SSE2
+#define BANK_STEP bank_step_sse2
+#define BANK_ATTR
+#define BANK_T double
+#define BANK_W 2
+#define V __m128d
+#define V_LD(p) _mm_loadu_pd(p)
+#define V_ST(p,v) _mm_storeu_pd((p), (v))
+#define V_SET1(x) _mm_set1_pd(x)
+#define V_ZERO _mm_setzero_pd()
+#define V_ADD(a,b) _mm_add_pd((a), (b))
+#define V_SUB(a,b) _mm_sub_pd((a), (b))
+#define V_MUL(a,b) _mm_mul_pd((a), (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+
+#define BANK_STEP bank_step_sse_f
+#define BANK_ATTR
+#define BANK_T float
+#define BANK_W 4
+#define V __m128
+#define V_LD(p) _mm_loadu_ps(p)
+#define V_ST(p,v) _mm_storeu_ps((p), (v))
+#define V_SET1(x) _mm_set1_ps(x)
+#define V_ZERO _mm_setzero_ps()
+#define V_ADD(a,b) _mm_add_ps((a), (b))
+#define V_SUB(a,b) _mm_sub_ps((a), (b))
+#define V_MUL(a,b) _mm_mul_ps((a), (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#endif
+
+#ifdef BANK_AVX
+#define BANK_STEP bank_step_avx
+#define BANK_ATTR __attribute__((target("avx")))
+#define BANK_T double
+#define BANK_W 4
+#define V __m256d
+#define V_LD(p) _mm256_loadu_pd(p)
+#define V_ST(p,v) _mm256_storeu_pd((p), (v))
+#define V_SET1(x) _mm256_set1_pd(x)
+#define V_ZERO _mm256_setzero_pd()
+#define V_ADD(a,b) _mm256_add_pd((a), (b))
+#define V_SUB(a,b) _mm256_sub_pd((a), (b))
+#define V_MUL(a,b) _mm256_mul_pd((a), (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+
+#define BANK_STEP bank_step_avx_f
+#define BANK_ATTR __attribute__((target("avx")))
+#define BANK_T float
+#define BANK_W 8
+#define V __m256
+#define V_LD(p) _mm256_loadu_ps(p)
+#define V_ST(p,v) _mm256_storeu_ps((p), (v))
+#define V_SET1(x) _mm256_set1_ps(x)
+#define V_ZERO _mm256_setzero_ps()
+#define V_ADD(a,b) _mm256_add_ps((a), (b))
+#define V_SUB(a,b) _mm256_sub_ps((a), (b))
+#define V_MUL(a,b) _mm256_mul_ps((a), (b))
+#include "rf_bank.c"
+#undef BANK_STEP
+#undef BANK_ATTR
+#undef BANK_T
+#undef BANK_W
+#undef V
+#undef V_LD
+#undef V_ST
+#undef V_SET1
+#undef V_ZERO
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#endif
+
+//
+//	Create a bank of 'n_buf' streams running the given filter.
+//	The bank refers to the Run's coefficients, so the Run must not
+//	be freed before the bank.
+//
+
+void *
+fid_bank_new(void *run, int n_buf) {
+   Run *rr= run;
+   RunBank *bk;
+   int n_pad, siz, esiz, wid;
+   size_t adj;
+   char *cp;
+
+   if (rr->magic != 0x64966325)
+      error("Bad handle passed to fid_bank_new()");
+   if (n_buf < 1)
+      error("fid_bank_new() needs at least one stream");
+
+   siz= rr->buf_size ? rr->buf_size : 1;   // Minimum one element to avoid problems
+   esiz= RUN_ESIZ(rr);
+   wid= BANK_ALIGN / esiz;	// Streams in widest vector
+   n_pad= (n_buf + wid-1) / wid * wid;
+
+   bk= ALLOC(RunBank);
+   bk->magic= 0x64966326;
+   bk->n_buf= n_buf;
+   bk->n_pad= n_pad;
+   bk->flt= rr->coef_f != 0;
+   bk->siz= siz;
+   bk->mov_cnt= (siz-1) * n_pad * esiz;
+   bk->coef= bk->flt ? (double*)rr->coef_f : rr->coef;
+   bk->cmd= (uchar*)rr->cmd;
+
+   // in[], out[], row0[] and buf[] all together, aligned
+   bk->mem= Alloc((3 + siz) * n_pad * esiz + BANK_ALIGN);
+   adj= (size_t)bk->mem & (BANK_ALIGN-1);
+   cp= bk->mem + (adj ? BANK_ALIGN - adj : 0);
+   bk->in= (double*)cp; cp += n_pad * esiz;
+   bk->out= (double*)cp; cp += n_pad * esiz;
+   bk->row0= (double*)cp; cp += n_pad * esiz;
+   bk->buf= (double*)cp;
+
+   bk->step= bk->flt ? bank_step_c_f : bank_step_c;
+#ifdef BANK_SSE2
+   bk->step= bk->flt ? bank_step_sse_f : bank_step_sse2;
+#endif
+#ifdef BANK_AVX
+   if (__builtin_cpu_supports("avx"))
+      bk->step= bk->flt ? bank_step_avx_f : bank_step_avx;
+#endif
+   return bk;
+}
+
+//
+//	Run one value from each stream through the filter: in[] and
+//	out[] both have one value for each stream.  They may be the
+//	same array.
+//
+
+void
+fid_bank_run(void *bank, double *in, double *out) {
+   RunBank *bk= bank;
+
+   if (bk->flt)
+      error("fid_bank_run() called on a single-precision bank; use fid_bank_run_f()");
+   memcpy(bk->in, in, bk->n_buf * sizeof(double));
+   bk->step(bk);
+   memcpy(out, bk->out, bk->n_buf * sizeof(double));
+}
+
+// The same for a bank of a filter made with fid_run_new_f()
+void
+fid_bank_run_f(void *bank, float *in, float *out) {
+   RunBank *bk= bank;
+
+   if (!bk->flt)
+      error("fid_bank_run_f() called on a double-precision bank; use fid_bank_run()");
+   memcpy(bk->in, in, bk->n_buf * sizeof(float));
+   bk->step(bk);
+   memcpy(out, bk->out, bk->n_buf * sizeof(float));
+}
+
+//
+//	Reinitialise all the streams of a bank, allowing them to start
+//	afresh
+//
+
+void
+fid_bank_zap(void *bank) {
+   RunBank *bk= bank;
+   memset(bk->buf, 0, bk->siz * bk->n_pad * (bk->flt ? sizeof(float) : sizeof(double)));
+}
+
+//
+//	Delete a bank
+//
+
+void
+fid_bank_free(void *bank) {
+   RunBank *bk= bank;
+   free(bk->mem);
+   free(bk);
+}
+
 // END //
@@ -112,13 +112,42 @@ fid_run_newbuf(void *run) {
    return rb;
 }
 
+//
+//	Find the size of the buffer made by fid_run_newbuf()
+//
+
+int 
+fid_run_bufsize(void *run) {
+   Run *rr= run;
+
+   if (rr->magic != 0x64966325)
+      error("Bad handle passed to fid_run_bufsize()");
+   return sizeof(RunBuf) + rr->n_buf * sizeof(double);
+}
+
+//
+//	Initialise a buffer of fid_run_bufsize() bytes allocated
+//	separately
+//
+
+void 
+fid_run_initbuf(void *run, void *buf) {
+   Run *rr= run;
+   RunBuf *rb= buf;
+
+   if (rr->magic != 0x64966325)
+      error("Bad handle passed to fid_run_initbuf()");
+   rb->run= rr;
+   memset(rb->buf, 0, rr->n_buf * sizeof(double));
+}
+
 //
 //	Reinitialise an instance ready to start afresh
 //
 
 void
 fid_run_zapbuf(void *buf) {
-   RunBuf *rb;
+   RunBuf *rb= buf;
    Run *rr= rb->run;
    memset(rb->buf, 0, rr->n_buf * sizeof(double));
 }
@@ -143,4 +172,157 @@ fid_run_free(void *run) {
    free(rr);
 }
 
+//
+//	Run a block of samples through the filter.  There is nothing to
+//	gain from blocks here, so this just steps through them.  in[]
+//	and out[] may be the same array.
+//
+
+void 
+fid_run_block(void *runbuf, const double *in, double *out, int n) {
+   int a;
+   for (a= 0; a<n; a++) 
+      out[a]= filter_step(runbuf, in[a]);
+}
+
+//
+//	Run a block through the filter keeping only every dec-th
+//	output, packed at the start of out[], and return how many
+//	there are.  'phase' is the number of samples since the last
+//	output, as for the command-list version.  Every sample still
+//	has to be stepped through to keep the filter state right.
+//
+
+int 
+fid_run_block_dec(void *runbuf, const double *in, double *out, int n, 
+		  int dec, int phase) {
+   int a, k= 0;
+   double val;
+
+   if (n <= 0) return 0;
+   if (dec < 1 || phase < 0 || phase >= dec)
+      error("Bad decimation passed to fid_run_block_dec(): %d/%d", phase, dec);
+   for (a= 0; a<n; a++) {
+      val= filter_step(runbuf, in[a]);
+      if (++phase == dec) { phase= 0; out[k++]= val; }
+   }
+   return k;
+}
+
+//
+//	Arenas: the buffers for a set of filters placed one after
+//	another in a single aligned block, as for the command-list
+//	version.  Buffers made this way are released all together with
+//	fid_arena_free(), not with fid_run_freebuf().
+//
+
+typedef struct RunArena {
+   int magic;		// Magic: 0x64966327
+   char *mem;		// Allocated memory, for free()
+   char *pos;		// Where the next buffer goes
+   char *end;		// End of the space
+} RunArena;
+
+#define ARENA_ALIGN 64		// Alignment of the arena (a cache line)
+#define ARENA_BUF_ALIGN 16	// Alignment of each buffer within it
+
+int 
+fid_arena_bufsize(void *run) {
+   return (fid_run_bufsize(run) + ARENA_BUF_ALIGN-1) & ~(ARENA_BUF_ALIGN-1);
+}
+
+void *
+fid_arena_new(int size) {
+   RunArena *ar= ALLOC(RunArena);
+   size_t adj;
+
+   ar->magic= 0x64966327;
+   ar->mem= Alloc(size + ARENA_ALIGN);
+   adj= (size_t)ar->mem & (ARENA_ALIGN-1);
+   ar->pos= ar->mem + (adj ? ARENA_ALIGN - adj : 0);
+   ar->end= ar->pos + size;
+   return ar;
+}
+
+void *
+fid_arena_newbuf(void *arena, void *run) {
+   RunArena *ar= arena;
+   int siz= fid_arena_bufsize(run);
+   void *rv;
+
+   if (ar->magic != 0x64966327)
+      error("Bad handle passed to fid_arena_newbuf()");
+   if (ar->pos + siz > ar->end)
+      error("fid_arena_newbuf(): arena is full");
+
+   rv= ar->pos;
+   ar->pos += siz;
+   fid_run_initbuf(run, rv);
+   return rv;
+}
+
+void 
+fid_arena_free(void *arena) {
+   RunArena *ar= arena;
+   free(ar->mem);
+   free(ar);
+}
+
+//
+//	Filter banks.  There is no vector code here, so a bank is just
+//	a separate buffer for each stream, stepped one after another.
+//	Only double precision is supported (there is no fid_run_new_f()
+//	in this version).
+//
+
+typedef struct RunBank {
+   int magic;		// Magic: 0x64966326
+   int n_buf;		// Number of streams
+   RunBuf *buf[0];	// Buffer for each stream
+} RunBank;
+
+void *
+fid_bank_new(void *run, int n_buf) {
+   Run *rr= run;
+   RunBank *bk;
+   int a;
+
+   if (rr->magic != 0x64966325)
+      error("Bad handle passed to fid_bank_new()");
+   if (n_buf < 1)
+      error("fid_bank_new() needs at least one stream");
+
+   bk= Alloc(sizeof(RunBank) + n_buf * sizeof(RunBuf*));
+   bk->magic= 0x64966326;
+   bk->n_buf= n_buf;
+   for (a= 0; a<n_buf; a++) 
+      bk->buf[a]= fid_run_newbuf(run);
+   return bk;
+}
+
+void
+fid_bank_run(void *bank, double *in, double *out) {
+   RunBank *bk= bank;
+   int a;
+   for (a= 0; a<bk->n_buf; a++) 
+      out[a]= filter_step(bk->buf[a], in[a]);
+}
+
+void
+fid_bank_zap(void *bank) {
+   RunBank *bk= bank;
+   int a;
+   for (a= 0; a<bk->n_buf; a++) 
+      fid_run_zapbuf(bk->buf[a]);
+}
+
+void
+fid_bank_free(void *bank) {
+   RunBank *bk= bank;
+   int a;
+   for (a= 0; a<bk->n_buf; a++) 
+      fid_run_freebuf(bk->buf[a]);
+   free(bk);
+}
+
 // END //
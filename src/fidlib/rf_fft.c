@@ -0,0 +1,177 @@
+//
+//	FFT convolution of long FIR stages for the command-list code.
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.  This
+//        file is released under the GNU Lesser General Public License
+//        (LGPL) version 2.1 as published by the Free Software
+//        Foundation.  See the file COPYING_LIB for details, or visit
+//        <http://www.fsf.org/licenses/licenses.html>.
+//
+//	This is included by rf_cmdlist.c.  A long FIR filter (e.g.
+//	LpBl at a low frequency, or a long array from fid_cv_array())
+//	costs a multiply-add per tap for every sample when run step by
+//	step.  When a block of samples is run with fid_run_block(), a
+//	pure FIR stage with at least RUN_FFT_MIN taps is instead
+//	convolved using overlap-save: each chunk of input, together
+//	with the taps-1 samples before it, is transformed with an FFT,
+//	multiplied by the transform of the taps, and transformed back.
+//	This costs O(log(size)) per sample instead of O(taps).
+//
+//	The stage's state is the same as for filter_step() -- the last
+//	taps-1 input samples, oldest first -- so blocks and single
+//	steps may still be mixed on the same buffer.  However, the
+//	results are no longer bit-identical to running the filter step
+//	by step: they differ by rounding errors, typically around 1e-15
+//	of the output for doubles (see test-accuracy).  Compile with
+//	-DRUN_FFT_MIN=0 to keep all stages direct.
+//
+//	Two chunks are done together in each FFT, one as the real part
+//	and the next as the imaginary part.  As the taps are real, the
+//	two results come back separately in the real and imaginary
+//	parts of the inverse.  The FFT is a plain radix-2 one, which
+//	is good enough here, and needs nothing outside of this file.
+//
+
+#ifndef RUN_FFT_MIN
+#define RUN_FFT_MIN 32		// Fewest taps to do by FFT, or 0 for never
+#endif
+
+typedef struct RunFft RunFft;
+struct RunFft {
+   RunFft *nxt;		// Next FFT stage in the filter, or 0
+   int pos;		// Offset of this stage in the Run's command list
+   int n_tap;		// Number of taps
+   int size;		// FFT size, a power of 2
+   int chunk;		// Outputs from each chunk: size - n_tap + 1
+   int min_n;		// Blocks shorter than this are done directly
+   int n_tmp;		// Doubles of scratch space needed by block_fft()
+   int *rev;		// Bit-reversal permutation
+   double *tw;		// Twiddle factors for each pass from the third on
+   double *hh;		// Conjugate of the transform of the taps, divided by size
+};
+
+//
+//	In-place complex FFT of ft->size values in xx[] (re/im pairs)
+//
+
+static void
+fft_run(RunFft *ft, double *xx) {
+   int nn= ft->size;
+   int *rev= ft->rev;
+   double *ww= ft->tw;
+   int a, b, len;
+
+   for (a= 0; a<nn; a++) {
+      b= rev[a];
+      if (b > a) {
+	 double t0= xx[2*a], t1= xx[2*a+1];
+	 xx[2*a]= xx[2*b]; xx[2*a+1]= xx[2*b+1];
+	 xx[2*b]= t0; xx[2*b+1]= t1;
+      }
+   }
+
+   // The first two passes together, where the twiddles are 1 and -i
+   for (a= 0; a<2*nn; a += 8) {
+      double *pp= xx + a;
+      double r0= pp[0] + pp[2], i0= pp[1] + pp[3];
+      double r1= pp[0] - pp[2], i1= pp[1] - pp[3];
+      double r2= pp[4] + pp[6], i2= pp[5] + pp[7];
+      double r3= pp[4] - pp[6], i3= pp[5] - pp[7];
+      pp[0]= r0 + r2; pp[1]= i0 + i2;
+      pp[4]= r0 - r2; pp[5]= i0 - i2;
+      pp[2]= r1 + i3; pp[3]= i1 - r3;
+      pp[6]= r1 - i3; pp[7]= i1 + r3;
+   }
+
+   // The rest, with the twiddles for each pass stored in order
+   for (len= 4; len < nn; ww += 2*len, len *= 2) {
+      for (a= 0; a<nn; a += 2*len) {
+	 double *pp= xx + 2*a, *qq= pp + 2*len, *tw= ww;
+	 for (b= 0; b<len; b++, pp += 2, qq += 2, tw += 2) {
+	    double tr= qq[0] * tw[0] - qq[1] * tw[1];
+	    double ti= qq[0] * tw[1] + qq[1] * tw[0];
+	    qq[0]= pp[0] - tr; qq[1]= pp[1] - ti;
+	    pp[0] += tr; pp[1] += ti;
+	 }
+      }
+   }
+}
+
+//
+//	Set up the FFT for a stage with the given taps, most recent
+//	first (as in a FidFilter).  The size is the smallest power of
+//	2 that gives chunks of at least as many outputs as taps.
+//	Bigger sizes do a little less work per output, but only for
+//	very long blocks, and they need longer blocks to pay off.
+//
+
+static RunFft *
+fft_new(double *tap, int n_tap) {
+   RunFft *ft;
+   double *ww;
+   int size, a, b, bits, len;
+
+   for (size= 8; size < 2*n_tap; size *= 2) ;
+   for (bits= 0; (1<<bits) < size; bits++) ;
+
+   ft= Alloc(sizeof(RunFft) + size * sizeof(int) +
+	     (2*size + 2*size) * sizeof(double));
+   ft->n_tap= n_tap;
+   ft->size= size;
+   ft->chunk= size - n_tap + 1;
+   ft->n_tmp= 2*size + n_tap-1 + 2*ft->chunk;
+   ft->tw= (double*)(ft+1);
+   ft->hh= ft->tw + 2*size;
+   ft->rev= (int*)(ft->hh + 2*size);
+
+   // A pair of chunks costs about the same as size*log2(size)*3.5
+   // multiply-adds done directly (measured on x86-64 with gcc -O3),
+   // and each sample done directly costs n_tap of them
+   ft->min_n= (int)(3.5 * size * bits / n_tap) + 1;
+
+   for (a= 0; a<size; a++) {
+      int rr= 0;
+      for (b= 0; b<bits; b++)
+	 if (a & (1<<b)) rr |= 1<<(bits-1-b);
+      ft->rev[a]= rr;
+   }
+   for (len= 4, ww= ft->tw; len < size; ww += 2*len, len *= 2) {
+      for (a= 0; a<len; a++) {
+	 ww[2*a]= cos(M_PI * a / len);
+	 ww[2*a+1]= -sin(M_PI * a / len);
+      }
+   }
+
+   for (a= 0; a<n_tap; a++) ft->hh[2*a]= tap[a];
+   fft_run(ft, ft->hh);
+   for (a= 0; a<size; a++) {
+      ft->hh[2*a] /= size;
+      ft->hh[2*a+1] /= -size;
+   }
+   return ft;
+}
+
+//
+//	Convolve a pair of chunks loaded into the real and imaginary
+//	parts of xx[].  The inverse transform is done as the conjugate
+//	of the forward transform of the conjugate, with the scaling and
+//	the first conjugation folded into ft->hh, and the last one left
+//	to the caller: the first chunk's result is in the real parts,
+//	and the second's is minus the imaginary parts.
+//
+
+static void
+fft_convolve(RunFft *ft, double *xx) {
+   double *hh= ft->hh;
+   int a;
+
+   fft_run(ft, xx);
+   for (a= 0; a<ft->size; a++, xx += 2, hh += 2) {
+      double re= xx[0] * hh[0] + xx[1] * hh[1];
+      double im= xx[0] * hh[1] - xx[1] * hh[0];
+      xx[0]= re; xx[1]= im;
+   }
+   fft_run(ft, xx - 2*ft->size);
+}
+
+// END //
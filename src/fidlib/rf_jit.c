@@ -1,7 +1,5 @@
-#error "JIT code is no longer maintained -- cmdlist is almost as fast on ix86"
-
 //
-//	JIT-compiled filter-running code.  
+//	JIT-compiled filter-running code for x86-64.
 //
 //        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.  This
 //        file is released under the GNU Lesser General Public License
@@ -9,49 +7,40 @@
 //        Foundation.  See the file COPYING_LIB for details, or visit
 //	  <http://www.fsf.org/licenses/licenses.html>.
 //
-//	The aim of this version of the filter-running code is to go as
-//	fast as possible (without flattening the sub-filters together)
-//	by generating the necessary code at run-time.
-//
-//	This runs the filter exactly as specified, without convolving
-//	the sub-filters together or changing their order.  The only
-//	rearrangement performed is making the IIR first coefficient
-//	1.0, and gathering any lone 1-coefficient FIR filters together
-//	into a single initial gain adjustment.  For this reason, the
-//	routine runs fastest if IIR and FIR sub-filters are grouped
-//	together in IIR/FIR pairs, as these can then share common
-//	working buffers.
-//
-//	The generated code is cached, and is reused for more than one
-//	filter if possible.  This means that a bank of 1000s of
-//	filters of similar types will probably all end up sharing the
-//	same generated routine, which improves processor cache and
-//	memory usage.
-//
-//	Probably the generated code could be improved, but it is not
-//	too bad.  Copying the buffer values using 'rep movsl' turned
-//	out to be much faster than loading and storing the floating
-//	point values individually whilst working through the buffer.
-//
-//	The generated code was tested for speed on a Celeron-900 and
-//	on a Pentium-133.  It always beats the RF_CMDLIST option.  It
-//	can be slightly slower than the RF_COMBINED option, but only
-//	where that option gets a big advantage from flattening the
-//	sub-filters.  For pre-flattened filters, it is faster.
+//	This generates straight-line SSE2 code for each filter at
+//	run-time, specialised for the exact shape of the filter.  It
+//	sits on top of the command-list code (rf_cmdlist.c): the filter
+//	is converted into a command list as usual, and then that list
+//	is compiled into code that works on the same RunBuf.  So
+//	everything else -- fid_run_newbuf(), fid_run_block(), filter
+//	banks and so on -- is shared with RF_CMDLIST.  Where code can't
+//	be generated (not x86-64, the OS won't give us executable
+//	memory, or the filter is very long) fid_run_new() quietly hands
+//	back filter_step() instead.
+//
+//	The generated code does the same operations in the same order
+//	as filter_step(), so the results are identical.  The memmove
+//	is replaced by moving each buffer value along as it is loaded,
+//	and the command decoding is done once, at compile time.
+//
+//	Coefficients are read through the RunBuf, so the code depends
+//	only on the shape of the filter, not on its values.  The
+//	generated code is cached, and is reused for more than one
+//	filter if possible.  This means that a bank of 1000s of filters
+//	of similar types will probably all end up sharing the same
+//	generated routine, which improves processor cache and memory
+//	usage.  The cache is global, so fid_run_new() and
+//	fid_run_free() are not thread-safe (the filters themselves
+//	are).
 //
 //	The generated code can be dumped out at any point in .s format
 //	using fid_run_dump().  This can be assembled using 'gas' and
 //	then disassembled with 'objdump -d' to see all the generated
 //	code.
 //
-//	Things that could be improved:
-//
-//	- Don't keep the fir running total on the stack at all times.
-//	Instead create it at the first FIR operation.  This means
-//	generating about 10 new special-case macros.  This would save
-//	an add for every filter stage, and some of the messing around
-//	at start and end currently done to set up / clean up this
-//	value on the FP stack.
+//	Only SSE2 is used, as all x86-64 CPUs have it.  The work is a
+//	chain of dependent scalar operations, so wider vectors wouldn't
+//	help, and fused multiply-adds would change the results.
 //
 
 typedef struct Routine Routine;
@@ -59,195 +48,133 @@ struct Routine {
    Routine *nxt;	// Next in list, or 0
    int ref;		// Reference count
    int hash;		// Hash of routine
-   char *code;		// Routine itself
+   char *code;		// Routine itself, in executable memory
    int len;		// Length of code in bytes
+   int size;		// Size of executable memory allocated
 };   
 
-typedef struct Run {
-   int magic;		// Magic: 0x64966325
-   int n_buf;		// Length of working buffer required in doubles	
-   double *coef;	// Coefficient list
-   Routine *rout;	// Routine used
-} Run;
-
-typedef struct RunBuf {
-   double *coef;	// Coefficient array
-   int mov_cnt;		// Number of 4-byte chunks to copy from &buf[1] to &buf[0]
-   double buf[0];	// Buffer itself
-} RunBuf;
+#include <stddef.h>
 
 static unsigned long int do_hash(unsigned char *, unsigned long int, unsigned long int);
 #define HASH(p,len) ((int)do_hash((unsigned char *)p, (unsigned long int)len, 0))
 
+#define JIT_MAX_BUF 1024	// Longest filter buffer to compile; longer ones
+				//   spend their time in the loops of filter_step()
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#ifdef T_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+#endif
+
+static Routine *r_list;	// List of routines or 0
+
+#ifdef JIT_X64
 
 //	Code generation
 //
-//	%edx is the working buffer pointer
-//	%eax is the coefficient pointer
-//	%ecx is the loop counter
-//	floating point stack contains working values at the top, then
-//	  previous buffer value, then running iir total, then running
-//	  fir total
-//
-//	Codes in the add() string:
-//
-//	  %C  4-byte long value count for loop
-//	  %L  Label -- remember this address for looping back to
-//	  %R  1-byte relative jump back to %L address
-//	  %D  1-byte relative address of buffer value.  If zero, this adjusts the 
-//		previous byte by ^=0x40 to make it a pure (%edx) form instead of 0(%edx)
-//	  %D+ 1-byte relative address of buffer value as above, plus increment %edx 
-//		if we are getting close to the end of the range
-//	  %A  1-byte relative address of coefficient value.  If zero does same as for %D.
-//	  %A+ 1-byte relative address of coefficient value, plus %eax inc 
-//		if necessary
-//	  %=  Insert code to update %edx and %eax to point to the given offsets
-//	
+//	%rdi is the RunBuf pointer (%rcx on Win64)
+//	%rax is the coefficient pointer
+//	%rdx is the working buffer pointer (&buf[0])
+//	%xmm0 is the running iir value (the argument and return value)
+//	%xmm1 is the running fir total
+//	%xmm2 is 'tmp', the buffer value being worked on
+//	%xmm3 is used for products
+//
+//	Codes in the add() string are hex bytes, plus:
+//
+//	  %b  1-byte value
+//	  %d  4-byte value
+//
 //	Startup code
 //
-//	  pushl %ebp
-//	  movl %esp,%ebp
-//	  movl 8(%ebp),%edx
-//	  movl (%edx),%eax
-//	  movl 4(%edx),%ecx
-//	  fldz
-//	  fldl 12(%ebp)
-//	  fldl 8(%edx)
-//	  fmull (%eax)
-//	  leal 8(%edx),%edi
-//	  leal 16(%edx),%esi
-//	  cld
-//        rep movsl
-
-#define STARTUP add("55 89E5 8B5508 8B02 8B4A04 D9EE DD450C DD4208 DC08 8D7A08 8D7210 FC F3A5")
+//	  movq coef(%rdi),%rax
+//	  leaq buf(%rdi),%rdx
+//	  xorpd %xmm1,%xmm1
+//
+//	or on Win64, where the arguments come in %rcx and %xmm1:
+//
+//	  movq coef(%rcx),%rax
+//	  leaq buf(%rcx),%rdx
+//	  movapd %xmm1,%xmm0
+//	  xorpd %xmm1,%xmm1
+
+#ifdef _WIN64
+#define STARTUP add("488B41%b 488D51%b 660F28C1 660F57C9", \
+		    (int)offsetof(RunBuf, coef), (int)offsetof(RunBuf, buf))
+#else
+#define STARTUP add("488B47%b 488D57%b 660F57C9", \
+		    (int)offsetof(RunBuf, coef), (int)offsetof(RunBuf, buf))
+#endif
 
 //	Return
 //
-//	  fstp %st(0)	// pop
-//	  fstp %st(1)
-//	  leave
 //	  ret
 
-#define RETURN add("DDD8 DDD9 C9 C3")
+#define RETURN add("C3")
 
-//	Looping
+//	Fetching/storing buffer values
 //
-//	  movl $100,%ecx
-//	.LXX
-//	  ...
-//	  loop .LXX
+//	tmp= buf[nn];
+//	  movsd nn(%rdx),%xmm2
+//
+//	buf[nn]= tmp;
+//	  movsd %xmm2,nn(%rdx)
 //
-//	//WAS  decl %ecx
-//	//WAS  testl %ecx,%ecx
-//	//WAS  jg .LXX
-
-#define FOR(xx, nnd, nna) add("B9%C %= %L", xx, (nnd)*8, (nna)*8)
-//WAS #define NEXT(nnd, nna) add("%= 49 85C9 7F%R", (nnd)*8, (nna)*8)
-#define NEXT(nnd, nna) add("%= E2%R", (nnd)*8, (nna)*8)
-
-//	Fetching/storing buffer values
-//	
-//	tmp= buf[n];
-//	  fldl nn(%edx)
-//	
 //	buf[nn]= iir;
-//	  fld %st(1)
-//	  fstpl nn(%edx)
-
-#define GETB(nn) add("DD42%D+", (nn)*8)
-#define PUTB(nn) add("D9C1 DD5A%D+", (nn)*8)
-
-//	FIR element with following IIR element
-//	
-//	fir -= 2 * tmp;
-//	  fsub %st(0),%st(2)
-//	  fsub %st(0),%st(2)
-//	fir -= tmp;
-//	  fsub %st(0),%st(2)
-//	fir += tmp;
-//	  fadd %st(0),%st(2)
-//	fir += 2 * tmp;
-//	  fadd %st(0),%st(2)
-//	  fadd %st(0),%st(2)
-//	fir += coef[nn] * tmp;
-//	  fld %st(0)
-//	  fmull nn(%eax)
-//	  faddp %st(0),%st(3)
-
-#define FIRc_M2 add("DCEA DCEA")
-#define FIRc_M1 add("DCEA")
-#define FIRc_P1 add("DCC2")
-#define FIRc_P2 add("DCC2 DCC2")
-#define FIRc(nn) add("D9C0 DC48%A+ DEC3", (nn)*8)
-
-//	FIR element with no following IIR element
-//	
-//	fir -= 2 * tmp;
-//	  fsub %st(0),%st(2)
-//	  fsubp %st(0),%st(2)
-//	fir -= tmp;
-//	  fsubp %st(0),%st(2)
-//	fir += 0 * tmp;
-//	  fstp %st(0),%st(0)	// Really I just want to pop the top value
-//	fir += tmp;
-//	  faddp %st(0),%st(2)
-//	fir += 2 * tmp;
-//	  fadd %st(0),%st(2)
-//	  faddp %st(0),%st(2)
-//	fir += coef[0] * tmp;
-//	  fmull nn(%eax)
-//	  faddp %st(0),%st(2)
-
-#define FIR_M2 add("DCEA DEEA")
-#define FIR_M1 add("DEEA")
-#define FIR_0 add("DDD8")
-#define FIR_P1 add("DEC2")
-#define FIR_P2 add("DCC2 DEC2")
-#define FIR(nn) add("DC48%A+ DEC2", (nn)*8)
+//	  movsd %xmm0,nn(%rdx)
+
+#define GETB(nn) add("F20F1092%d", (nn)*8)
+#define MOVB(nn) add("F20F1192%d", (nn)*8)
+#define PUTB(nn) add("F20F1182%d", (nn)*8)
 
 //	IIR element
-//	
+//
 //	iir -= coef[nn] * tmp;
-//	  fmull nn(%eax)
-//	  fsubp %st(0),%st(1)
+//	  movapd %xmm2,%xmm3
+//	  mulsd nn(%rax),%xmm3
+//	  subsd %xmm3,%xmm0
 
-#define IIR(nn) add("DC48%A+ DEE9", (nn)*8)
+#define IIR(nn) add("660F28DA F20F5998%d F20F5CC3", (nn)*8)
+
+//	FIR element
+//
+//	fir += coef[nn] * tmp;
+//	  movapd %xmm2,%xmm3
+//	  mulsd nn(%rax),%xmm3
+//	  addsd %xmm3,%xmm1
+
+#define FIR(nn) add("660F28DA F20F5998%d F20F58CB", (nn)*8)
 
 //	Final FIR element of pure-FIR or mixed FIR-IIR stage
-//	
+//
 //	iir= fir + coef[nn] * iir; fir= 0;
-//	  fxch
-//	  fmull nn(%eax)
-//	  faddp %st(2)
-//	  fldz
-//	  fstp %st(3)
-//	iir= fir + 1.0 * iir; fir= 0;
-//	  fxch
-//	  faddp %st(2)
-//	  fldz
-//	  fstp %st(3)
-//	iir= fir - 1.0 * iir; fir= 0;
-//	  fxch
-//	  fsubp %st(2)
-//	  fldz
-//	  fstp %st(3)
-
-#define FIREND(nn) add("D9C9 DC48%A+ DEC2 D9EE DDDB", (nn)*8)
-#define FIREND_P1 add("D9C9 DEC2 D9EE DDDB")
-#define FIREND_M1 add("D9C9 DEEA D9EE DDDB")
-
-//
-//	Globals for handling routines
+//	  movapd %xmm0,%xmm3
+//	  mulsd nn(%rax),%xmm3
+//	  addsd %xmm3,%xmm1
+//	  movapd %xmm1,%xmm0
+//	  xorpd %xmm1,%xmm1
+
+#define FIREND(nn) add("660F28D8 F20F5998%d F20F58CB 660F28C1 660F57C9", (nn)*8)
+
+//	Gain
+//
+//	iir *= coef[nn];
+//	  mulsd nn(%rax),%xmm0
+
+#define GAIN(nn) add("F20F5980%d", (nn)*8)
+
+//
+//	Globals for generating routines
 //
 
 static char *r_buf;	// Buffer address
 static char *r_end;	// Curent end of buffer
 static char *r_cp;	// Current write-position
-static char *r_lab;	// Current loop-back label, or 0
-static int r_loop;	// Loop count
-static int r_edx;	// %edx offset relative to initial position
-static int r_eax;	// %eax offset relative to initial position
-static Routine *r_list;	// List of routines or 0
 
 //
 //	Add code to the current routine.  This uses global variables,
@@ -260,7 +187,7 @@ add(char *fmt, ...) {
    int ch, val;
    va_start(ap, fmt);
 
-   if (r_end - r_cp < 32) 
+   if (r_end - r_cp < 64) 
       error("JIT error: routine buffer exceeded");
 
    while ((ch= *fmt++)) {
@@ -277,364 +204,210 @@ add(char *fmt, ...) {
       if (ch != '%') 
 	 error("JIT error: add() routine bad format string");
       switch (ch= *fmt++) {
-       case 'C':
+       case 'b':
+	  val= va_arg(ap, int);
+	  if (val < -128 || val >= 128) error("JIT error: %%b value out of range");
+	  *r_cp++= val;
+	  break;
+       case 'd':
 	  val= va_arg(ap, int);
-	  r_loop= val;
 	  *r_cp++= val;
 	  *r_cp++= val>>8;
 	  *r_cp++= val>>16;
 	  *r_cp++= val>>24;
 	  break;
-       case 'L':
-	  if (r_lab) error("JIT error: two stacked %L formats");
-	  r_lab= r_cp;
-	  break;
-       case 'R':
-	  if (!r_lab) error("JIT error: %R without matching %L");
-	  val= r_lab - (r_cp+1);
-	  if (val < -128) error("JIT error: %R too far from %L");
-	  *r_cp++= val;
-	  r_lab= 0;
-	  break;
-       case 'D':
-	  val= va_arg(ap, int) - r_edx;
-	  if (val < -128 || val >= 128) error("JIT error: %%edx offset out of range");
-	  if (val == 0) 
-	     r_cp[-1] ^= 0x40;
-	  else 
-	     *r_cp++= val;
-	  if (*fmt == '+') {
-	     fmt++; 
-	     if (val >= 120) {
-		*r_cp++= 0x83;	// addl $120,%edx
-		*r_cp++= 0xC2;
-		*r_cp++= 0x78;
-		r_edx += 120;
-	     }
-	  }
-	  break;
-       case 'A':
-	  val= va_arg(ap, int) - r_eax;
-	  if (val < -128 || val >= 128) error("JIT error: %%eax offset out of range");
-	  if (val == 0) 
-	     r_cp[-1] ^= 0x40;
-	  else 
-	     *r_cp++= val;
-	  if (*fmt == '+') {
-	     fmt++; 
-	     if (val >= 120) {
-		*r_cp++= 0x83;	// addl $120,%eax
-		*r_cp++= 0xC0;
-		*r_cp++= 0x78;
-		r_eax += 120;
-	     }
-	  }
-	  break;
-       case '=':
-	  val= va_arg(ap, int) - r_edx;
-	  if (val != 0) {
-	     if (val < -128 || val >= 128)
-		error("JIT error: %%= adjust for %%edx is out of range");
-	     *r_cp++= 0x83;	// addl $120,%edx
-	     *r_cp++= 0xC2;
-	     *r_cp++= val;
-	     r_edx += val * (r_lab ? r_loop : 1);
-	  }	     
-	  val= va_arg(ap, int) - r_eax;
-	  if (val != 0) {
-	     if (val < -128 || val >= 128)
-		error("JIT error: %%= adjust for %%edx is out of range");
-	     *r_cp++= 0x83;	// addl $120,%edx
-	     *r_cp++= 0xC0;
-	     *r_cp++= val;
-	     r_eax += val * (r_lab ? r_loop : 1);
-	  }	     
-	  break;
        default:
 	  error("JIT error: bad format for add()");
       }
    }      
-}	  
-      
-
-//
-//	Create an instance of a filter, ready to run.  This returns a
-//	void* handle, and a JIT-compiled function to call to execute
-//	the filter.  (The functions are cached, so if several versions
-//	of the same filter are generated with different parameters, it
-//	is likely that the same routine will end up servicing all of
-//	them).
-//
-//	Working buffers for the filter instances must be allocated
-//	separately using fid_run_newbuf().  This allows many
-//	simultaneous instances of the same filter to be run.
-//
-//	The sub-filters are executed in the precise order that they
-//	are given.  This may lead to some inefficiency, because
-//	normally when an IIR filter is followed by an FIR filter, the
-//	buffers can be shared.  So, if the sub-filters are not in
-//	IIR/FIR pairs, then extra memory accesses are required.
-//
-//	In any case, factors are extracted from IIR filters (so that
-//	the first coefficient is 1), and single-element FIR filters
-//	are merged into the global gain factor, and are ignored.
-//
-//	The returned handle must be released using fid_run_free().
-//
-
-// Loop the generated code above LOOP repeats (8)
-#define LOOP 8
-
-void *
-fid_run_new(FidFilter *filt, double (**funcpp)(void *,double)) {
-   FidFilter *ff;
-   double *dp;
-   double gain= 1.0;
-   int a, val;
-   double *coef_tmp;
-   char *rout_tmp;
-   int coef_cnt, coef_max;
-   int rout_cnt, rout_max;
-   int filt_cnt= 0;
-   Run *rr;
-   int o_buf= 1;	// Current offset into working buffer
-   int o_coef= 1;	// Current offset into coefficient array
-   int hash;
-   Routine *rout;
+   va_end(ap);
+}
 
-   for (ff= filt; ff->len; ff= FFNEXT(ff))
-      filt_cnt += ff->len;
-
-   // Allocate rough worst-case sizes for temporary arrays
-   coef_tmp= ALLOC_ARR(coef_max= filt_cnt+1, double);
-   rout_tmp= ALLOC_ARR(rout_max= filt_cnt * 16 + 20 + 32, char);
-   dp= coef_tmp+o_coef;	// Leave space to put gain back in later
-
-   // Setup JIT globals
-   r_buf= rout_tmp;
-   r_end= rout_tmp + rout_max;
-   r_cp= r_buf;
-   r_lab= 0;
-   r_loop= 0;
-   r_edx= 0;
-   r_eax= 0;
-
-   STARTUP;	// Setup iir/fir running totals on stack, apply gain 
-
-   // Generate command and coefficient lists
-   while (filt->len) {
-      int n_iir, n_fir, cnt;
-      double *iir, *fir;
-      double adj;
-      if (filt->typ == 'F' && filt->len == 1) {
-	 gain *= filt->val[0];
-	 filt= FFNEXT(filt);
-	 continue;
-      }
-      if (filt->typ == 'F') {
-	 iir= 0; n_iir= 0;
-	 fir= filt->val; n_fir= filt->len;
-	 filt= FFNEXT(filt);
-      } else if (filt->typ == 'I') {
-         iir= filt->val; n_iir= filt->len;
-         fir= 0; n_fir= 0;
-         filt= FFNEXT(filt);
-         while (filt->typ == 'F' && filt->len == 1) {
-            gain *= filt->val[0];
-            filt= FFNEXT(filt);
-         }
-         if (filt->typ == 'F') {
-            fir= filt->val; n_fir= filt->len;
-            filt= FFNEXT(filt);
-         }
-      } else
-         error("Internal error: fid_run_new can only handle IIR + FIR types");
-      
-      // Okay, we now have an IIR/FIR pair to process, possibly with
-      // n_iir or n_fir == 0 if one half is missing
-      cnt= n_iir > n_fir ? n_iir : n_fir;
-      if (n_iir) {
-	 adj= 1.0 / iir[0];
-	 gain *= adj;
-      }
+//
+//	Generate the code for a Run's command list into r_buf.  Each
+//	element of a stage loads its buffer value, moves it down one
+//	place (unless it is the first of the stage, as that place
+//	belongs to the previous stage), and applies the IIR and/or FIR
+//	coefficients according to 'typ' (1 IIR, 2 FIR, 3 both).  An
+//	end-stage element then stores the new iir value, and finishes
+//	the FIR sum if there is one.  This mirrors filter_step() with
+//	the memmove done on the way.
+//
 
-      // Sort out any trailing IIR coefficients where there are more
-      // IIR than FIR
-      if (cnt > n_fir) {
-	 a= cnt - (n_fir ? n_fir : 1);
-	 if (a >= LOOP) {
-	    FOR(a, o_buf, o_coef);
-	    IIR(o_coef); o_coef++; 
-	    GETB(o_buf); o_buf++;
-	    NEXT(o_buf, o_coef);
-	    o_buf += (a-1);
-	    o_coef += (a-1);
-	    while (a-- > 0) *dp++= iir[--cnt] * adj;
-	 } else while (a-- > 0) {
-	    *dp++= iir[--cnt] * adj;
-	    IIR(o_coef); o_coef++; 
-	    GETB(o_buf); o_buf++;
-	 }
-      }
+#define ELEM(typ) { \
+   GETB(o_buf); if (o_buf > o_stage) MOVB(o_buf-1); \
+   if ((typ) & 1) { IIR(o_coef); o_coef++; } \
+   if ((typ) & 2) { FIR(o_coef); o_coef++; } \
+   o_buf++; }
+#define END(typ) { \
+   ELEM(typ); PUTB(o_buf-1); \
+   if ((typ) & 2) { FIREND(o_coef); o_coef++; } \
+   o_stage= o_buf; }
 
-      // Sort out any trailing FIR coefficients where there are more
-      // FIR than IIR
-      if (cnt > n_iir) {
-	 a= cnt - (n_iir ? n_iir : 1);
-	 if (a >= LOOP) {
-	    FOR(a, o_buf, o_coef);
-	    FIR(o_coef); o_coef++; 
-	    GETB(o_buf); o_buf++;
-	    NEXT(o_buf, o_coef);
-	    o_buf += (a-1);
-	    o_coef += (a-1);
-	    while (a-- > 0) *dp++= fir[--cnt];
-	 } else while (a-- > 0) {
-	    val= fir[--cnt];
-	    if (val == -2.0) FIR_M2;
-	    else if (val == -1.0) FIR_M1;
-	    else if (val == 0.0) FIR_0;
-	    else if (val == 1.0) FIR_P1;
-	    else if (val == 2.0) FIR_P2;
-	    else { *dp++= val; FIR(o_coef); o_coef++; }
-	    GETB(o_buf); o_buf++; 
-	 }
-      }
+static void 
+jit_gen(Run *rr) {
+   uchar *cmd= (uchar*)rr->cmd;
+   int o_buf= 0;	// Current offset into working buffer
+   int o_stage= 0;	// Offset of first element of current stage
+   int o_coef= 0;	// Current offset into coefficient array
+   int ch, cnt;
+
+   STARTUP;
+   while ((ch= *cmd++)) switch (ch) {
+    case 1: case 2: case 3: case 4:
+    case 5: case 6: case 7: case 8:
+    case 9: case 10: case 11: case 12:
+       cnt= (ch & 3) ? (ch & 3) : 4 * *cmd++;
+       while (cnt-- > 0) ELEM((ch-1)/4 + 1);
+       break;
+    case 13: case 14: case 15:
+       END(ch-12);
+       break;
+    case 16: case 17: case 18:
+       ELEM(ch-15); END(ch-15);
+       break;
+    case 19: case 20: case 21:
+       cnt= *cmd++;
+       while (cnt-- > 0) { ELEM(ch-18); END(ch-18); }
+       break;
+    case 22:
+       GAIN(o_coef); o_coef++;
+       break;
+    default:
+       error("JIT error: unknown command %d", ch);
+   }
+   RETURN;
 
-      // Sort out any common IIR/FIR coefficients remaining
-      if (cnt > 1) {
-	 a= cnt - 1;
-	 if (a >= LOOP) {
-	    FOR(a, o_buf, o_coef);
-	    FIRc(o_coef); o_coef++; 
-	    IIR(o_coef); o_coef++; 
-	    GETB(o_buf); o_buf++;
-	    NEXT(o_buf, o_coef);
-	    o_buf += (a-1);
-	    o_coef += 2 * (a-1);
-	    while (a-- > 0) {
-	       *dp++= fir[--cnt] * adj;
-	       *dp++= iir[cnt] * adj;
-	    }
-	 } else while (a-- > 0) {
-	    val= fir[--cnt];
-	    if (val == -2.0) FIRc_M2;
-	    else if (val == -1.0) FIRc_M1;
-	    else if (val == 0.0) ; 
-	    else if (val == 1.0) FIRc_P1;
-	    else if (val == 2.0) FIRc_P2;
-	    else { *dp++= val; FIRc(o_coef); o_coef++; }
-	    
-	    *dp++= iir[cnt] * adj;
-	    IIR(o_coef); o_coef++;
-	    GETB(o_buf); o_buf++;
-	 }
-      }
+   if (o_buf != rr->buf_size)
+      error("JIT error: buffer size mismatch");
+}
 
-      // Handle the final element, according to whether there was any
-      // FIR activity in this filter stage
-      PUTB(o_buf-1);
-      if (n_fir) {
-	 if (fir[0] == 1.0) { FIREND_P1; }
-	 else if (fir[0] == -1.0) { FIREND_M1; }
-	 else { *dp++= fir[0]; FIREND(o_coef); o_coef++; }
-      }
+#undef ELEM
+#undef END
+
+//
+//	Copy a routine into executable memory.  Returns 0 if the OS
+//	won't allow it.
+//
+
+static char *
+jit_exec(char *code, int len, int *sizep) {
+#ifdef T_LINUX
+   size_t pg= sysconf(_SC_PAGESIZE);
+   size_t siz= (len + pg-1) / pg * pg;
+   char *mem= mmap(0, siz, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (mem == MAP_FAILED) return 0;
+   memcpy(mem, code, len);
+   if (0 != mprotect(mem, siz, PROT_READ|PROT_EXEC)) {
+      munmap(mem, siz);
+      return 0;
+   }
+#else
+   size_t siz= len;
+   DWORD old;
+   char *mem= VirtualAlloc(0, siz, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+   if (!mem) return 0;
+   memcpy(mem, code, len);
+   if (!VirtualProtect(mem, siz, PAGE_EXECUTE_READ, &old)) {
+      VirtualFree(mem, 0, MEM_RELEASE);
+      return 0;
    }
+   FlushInstructionCache(GetCurrentProcess(), mem, siz);
+#endif
+   *sizep= (int)siz;
+   return mem;
+}
 
-   coef_tmp[0]= gain;
-   RETURN;
+static void
+jit_unexec(Routine *rout) {
+#ifdef T_LINUX
+   munmap(rout->code, rout->size);
+#else
+   VirtualFree(rout->code, 0, MEM_RELEASE);
+#endif
+}
+
+//
+//	Compile the filter set up by fid_run_new() in rf_cmdlist.c,
+//	replacing *funcpp if successful.  The routines are cached, so
+//	if several versions of the same filter are generated with
+//	different parameters, it is likely that the same routine will
+//	end up servicing all of them.
+//
 
-   // Sanity checks
-   coef_cnt= dp-coef_tmp;
-   rout_cnt= r_cp-r_buf;
-   if (coef_cnt > coef_max ||
-       rout_cnt > rout_max) 
-      error("fid_run_new internal error; arrays exceeded");
+static void 
+jit_new(Run *rr, FidFunc **funcpp) {
+   Routine *rout;
+   int rout_max, rout_cnt, hash;
 
-   // Now generate a hash of the code we've created, and see if we've
-   // already got a cached version of that routine
-   hash= HASH(rout_tmp, rout_cnt);
+   if (rr->buf_size > JIT_MAX_BUF) return;
+
+   // Worst case is a load, move, IIR+FIR, store and FIR end for
+   // each element, plus startup, gain and return
+   rout_max= rr->buf_size * 80 + 128;
+   r_buf= r_cp= ALLOC_ARR(rout_max, char);
+   r_end= r_buf + rout_max;
+   jit_gen(rr);
+   rout_cnt= r_cp - r_buf;
+
+   // See if we've already got a cached version of this routine
+   hash= HASH(r_buf, rout_cnt);
    for (rout= r_list; rout; rout= rout->nxt) {
       if (rout->hash == hash &&
 	  rout->len == rout_cnt &&
-	  0 == memcmp(rout->code, rout_tmp, rout_cnt)) 
+	  0 == memcmp(rout->code, r_buf, rout_cnt)) 
 	 break;
    }
    if (!rout) {
-      rout= Alloc(sizeof(Routine) + rout_cnt);
+      rout= ALLOC(Routine);
+      if (!(rout->code= jit_exec(r_buf, rout_cnt, &rout->size))) {
+	 // No executable memory; stick with filter_step()
+	 free(rout);
+	 free(r_buf);
+	 return;
+      }
       rout->nxt= r_list; r_list= rout;
-      rout->ref= 0;
       rout->hash= hash;
-      rout->code= (char*)(rout+1);
       rout->len= rout_cnt;
-      memcpy(rout->code, rout_tmp, rout_cnt);
-      // Maybe flush caches at this point on processors other than x86
    }
-   free(rout_tmp);
-
-   // Allocate the final Run structure to return
-   rr= (Run*)Alloc(sizeof(Run) +
-		   coef_cnt*sizeof(double));
-   rr->magic= 0x64966325;
-   rr->n_buf= o_buf;
-   rr->coef= (double*)(rr+1);
-   memcpy(rr->coef, coef_tmp, coef_cnt*sizeof(double));
-   rr->rout= rout; 
-   rout->ref++;
-   
-   free(coef_tmp);
+   free(r_buf);
 
-   *funcpp= (void*)rout->code;
-   return rr;
+   rr->jit= rout;
+   rout->ref++;
+   *funcpp= (FidFunc*)rout->code;
 }
 
-//
-//	Create a new instance of the given filter
-//
+#else
 
-void *
-fid_run_newbuf(void *run) {
-   Run *rr= run;
-   RunBuf *rb;
+// Not x86-64, so always use filter_step()
+static void 
+jit_new(Run *rr, FidFunc **funcpp) {}
 
-   if (rr->magic != 0x64966325)
-      error("Bad handle passed to fid_run_newbuf()");
-   
-   rb= (RunBuf*)ALLOC_ARR(rr->n_buf, double);
-   rb->coef= rr->coef;
-   rb->mov_cnt= (rr->n_buf-1) * sizeof(double) / 4;
+static void
+jit_unexec(Routine *rout) {}
 
-   return rb;
-}
+#endif
 
 //
-//	Delete an instance
+//	Release a filter's routine, deleting it from the cache if no
+//	longer used
 //
 
-void 
-fid_run_freebuf(void *runbuf) {
-   free(runbuf);
-}
-
-//
-//	Delete the filter
-//
-
-void 
-fid_run_free(void *run) {
-   Routine *rout= ((Run*)run)->rout;
+static void
+jit_free(Run *rr) {
+   Routine *rout= rr->jit;
+   if (!rout) return;
    rout->ref--;
    if (!rout->ref) {
-      // Delete the routine out of the cache
       Routine *p, **prvp;
       for (prvp= &r_list; (p= *prvp); prvp= &p->nxt) 
 	 if (p == rout) {
 	    *prvp= p->nxt;
 	    break;
 	 }
+      jit_unexec(rout);
       free(rout);
    }
-   free(run);
 }
 
 //
@@ -647,9 +420,8 @@ fid_run_dump(FILE *out) {
    int a, cnt= 0;
    fprintf(out, 
 	   "	.file	\"fid_run_dump.s\"\n"
-	   "	.version	\"01.01\"\n"
-	   ".text\n"
-	   "	.align 4\n");
+	   "	.text\n"
+	   "	.align 16\n");
    for (rr= r_list; rr; rr= rr->nxt, cnt++) {
       fprintf(out, 
 	      ".globl	process_%d\n"
@@ -770,17 +542,17 @@ do_hash(register ub1 *k,        /* the key */
    c += length;
    switch(len)              /* all the case statements fall through */
       {
-       case 11: c+=((ub4)k[10]<<24);
-       case 10: c+=((ub4)k[9]<<16);
-       case 9 : c+=((ub4)k[8]<<8);
+       case 11: c+=((ub4)k[10]<<24);	/* fall through */
+       case 10: c+=((ub4)k[9]<<16);	/* fall through */
+       case 9 : c+=((ub4)k[8]<<8);	/* fall through */
 	  /* the first byte of c is reserved for the length */
-       case 8 : b+=((ub4)k[7]<<24);
-       case 7 : b+=((ub4)k[6]<<16);
-       case 6 : b+=((ub4)k[5]<<8);
-       case 5 : b+=k[4];
-       case 4 : a+=((ub4)k[3]<<24);
-       case 3 : a+=((ub4)k[2]<<16);
-       case 2 : a+=((ub4)k[1]<<8);
+       case 8 : b+=((ub4)k[7]<<24);	/* fall through */
+       case 7 : b+=((ub4)k[6]<<16);	/* fall through */
+       case 6 : b+=((ub4)k[5]<<8);	/* fall through */
+       case 5 : b+=k[4];		/* fall through */
+       case 4 : a+=((ub4)k[3]<<24);	/* fall through */
+       case 3 : a+=((ub4)k[2]<<16);	/* fall through */
+       case 2 : a+=((ub4)k[1]<<8);	/* fall through */
        case 1 : a+=k[0];
 	  /* case 0: nothing left to add */
       }
@@ -0,0 +1,485 @@
+//
+//	Step and block routines for the command-list code.
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.  This
+//        file is released under the GNU Lesser General Public License
+//        (LGPL) version 2.1 as published by the Free Software
+//        Foundation.  See the file COPYING_LIB for details, or visit
+//        <http://www.fsf.org/licenses/licenses.html>.
+//
+//	This is included twice by rf_cmdlist.c, once for double
+//	precision and once for single precision, with these macros
+//	set:
+//
+//	  RT		Type of values: double or float
+//	  RTBUF		Buffer structure: RunBuf or RunBufF
+//	  RFN(name)	Name for a routine of this precision
+//
+
+
+static RT 
+RFN(filter_step)(void *fbuf, RT iir) {
+   RT *coef= ((RTBUF*)fbuf)->coef;
+   uchar *cmd= ((RTBUF*)fbuf)->cmd;
+   RT *buf= &((RTBUF*)fbuf)->buf[0];
+   uchar ch;
+   RT fir= 0;
+   RT tmp= buf[0];
+   int cnt;
+
+   // Using a memmove first is faster on gcc -O6 / ix86 than moving
+   // the values whilst working through the buffers.
+   memmove(buf, buf+1, ((RTBUF*)fbuf)->mov_cnt);
+
+#define IIR \
+       iir -= *coef++ * tmp; \
+       tmp= *buf++;
+#define FIR \
+       fir += *coef++ * tmp; \
+       tmp= *buf++;
+#define BOTH \
+       iir -= *coef++ * tmp; \
+       fir += *coef++ * tmp; \
+       tmp= *buf++;
+#define ENDIIR \
+       iir -= *coef++ * tmp; \
+       tmp= *buf++; \
+       buf[-1]= iir;
+#define ENDFIR \
+       fir += *coef++ * tmp; \
+       tmp= *buf++; \
+       buf[-1]= iir; \
+       iir= fir + *coef++ * iir; \
+       fir= 0
+#define ENDBOTH \
+       iir -= *coef++ * tmp; \
+       fir += *coef++ * tmp; \
+       tmp= *buf++; \
+       buf[-1]= iir; \
+       iir= fir + *coef++ * iir; \
+       fir= 0
+#define GAIN \
+       iir *= *coef++
+
+   while ((ch= *cmd++)) switch (ch) {
+    case 1:
+       IIR; break;
+    case 2:
+       IIR; IIR; break;
+    case 3:
+       IIR; IIR; IIR; break;
+    case 4:
+       cnt= *cmd++; 
+       do { IIR; IIR; IIR; IIR; } while (--cnt > 0);
+       break;
+    case 5:
+       FIR; break;
+    case 6:
+       FIR; FIR; break;
+    case 7:
+       FIR; FIR; FIR; break;
+    case 8:
+       cnt= *cmd++; 
+       do { FIR; FIR; FIR; FIR; } while (--cnt > 0);
+       break;
+    case 9:
+       BOTH; break;
+    case 10:
+       BOTH; BOTH; break;
+    case 11:
+       BOTH; BOTH; BOTH; break;
+    case 12:
+       cnt= *cmd++; 
+       do { BOTH; BOTH; BOTH; BOTH; } while (--cnt > 0);
+       break;
+    case 13:
+       ENDIIR; break;
+    case 14:
+       ENDFIR; break;
+    case 15:
+       ENDBOTH; break;
+    case 16:
+       IIR; ENDIIR; break;
+    case 17:
+       FIR; ENDFIR; break;
+    case 18:
+       BOTH; ENDBOTH; break;
+    case 19:
+       cnt= *cmd++; 
+       do { IIR; ENDIIR; } while (--cnt > 0);
+       break;
+    case 20:
+       cnt= *cmd++; 
+       do { FIR; ENDFIR; } while (--cnt > 0);
+       break;
+    case 21:
+       cnt= *cmd++; 
+       do { BOTH; ENDBOTH; } while (--cnt > 0);
+       break;
+    case 22:
+       GAIN; break;
+   }
+
+#undef IIR
+#undef FIR
+#undef BOTH
+#undef ENDIIR
+#undef ENDFIR
+#undef ENDBOTH
+#undef GAIN
+
+   return iir;
+}
+
+
+
+//
+//	Block processing.  Instead of going through the whole command
+//	list for every sample, this goes through it once for the
+//	block, running all the samples through each stage in turn.
+//	Each stage's coefficients and state are kept in local
+//	variables for the whole block.  The 2x2 stages that most
+//	filters are made of (commands 16-21) get loops of their own,
+//	and anything else goes through block_stage().
+//
+//	The state is laid out just as for filter_step(), with each
+//	stage's elements oldest first, and the operations are done in
+//	the same order, so the results are exactly the same as calling
+//	filter_step() for each sample.  Blocks and single steps may be
+//	mixed freely on the same buffer.  The exception is that long
+//	FIR stages are done by FFT when the block is big enough (see
+//	rf_fft.c), and those only agree to within rounding errors.
+//
+
+static void 
+RFN(block_2x2)(int typ, RT *coef, RT *st, RT *dp, int n) {
+   RT s0= st[0], s1= st[1];
+   RT iir, fir;
+   int a;
+
+   if (typ == 16) {
+      RT c0= coef[0], c1= coef[1];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 iir -= c0 * s0;
+	 iir -= c1 * s1;
+	 s0= s1; s1= iir;
+	 dp[a]= iir;
+      }
+   } else if (typ == 17) {
+      RT c0= coef[0], c1= coef[1], c2= coef[2];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 fir= 0;
+	 fir += c0 * s0;
+	 fir += c1 * s1;
+	 s0= s1; s1= iir;
+	 dp[a]= fir + c2 * iir;
+      }
+   } else {
+      RT c0= coef[0], c1= coef[1], c2= coef[2], c3= coef[3], c4= coef[4];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 fir= 0;
+	 iir -= c0 * s0;
+	 fir += c1 * s0;
+	 iir -= c2 * s1;
+	 fir += c3 * s1;
+	 s0= s1; s1= iir;
+	 dp[a]= fir + c4 * iir;
+      }
+   }
+   st[0]= s0; st[1]= s1;
+}
+
+//
+//	Any other stage: n_iir IIR-only, n_fir FIR-only and n_both
+//	IIR+FIR elements followed by end-stage command 'end' (13-15)
+//
+
+static void 
+RFN(block_stage)(int end, int n_iir, int n_fir, int n_both, 
+	    RT *coef, RT *st, RT *dp, int n) {
+   int len= n_iir + n_fir + n_both;
+   int a, b;
+
+   for (a= 0; a<n; a++) {
+      RT iir= dp[a], fir= 0;
+      RT *cp= coef, *sp= st;
+      for (b= 0; b<n_iir; b++) { iir -= *cp++ * *sp++; }
+      for (b= 0; b<n_fir; b++) { fir += *cp++ * *sp++; }
+      for (b= 0; b<n_both; b++) { 
+	 iir -= *cp++ * *sp; 
+	 fir += *cp++ * *sp++; 
+      }
+      if (end != 14) iir -= *cp++ * *sp;
+      if (end != 13) fir += *cp++ * *sp;
+      memmove(st, st+1, len * sizeof(RT));
+      st[len]= iir;
+      if (end != 13) iir= fir + *cp * iir;
+      dp[a]= iir;
+   }
+}
+
+//
+//	Decimating versions of the above, for the last stage of a
+//	filter.  The state is still updated for every sample, but the
+//	output is only worked out for every dec-th sample, which are
+//	packed at the start of dp[].  The kept samples are those where
+//	'ph' counts up to 'dec', starting from the given 'ph'.  Returns
+//	the number of outputs.
+//
+
+static int 
+RFN(block_2x2_dec)(int typ, RT *coef, RT *st, RT *dp, int n, int dec, int ph) {
+   RT s0= st[0], s1= st[1];
+   RT iir, fir;
+   int a, k= 0;
+
+   if (typ == 16) {
+      RT c0= coef[0], c1= coef[1];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 iir -= c0 * s0;
+	 iir -= c1 * s1;
+	 s0= s1; s1= iir;
+	 if (++ph == dec) { ph= 0; dp[k++]= iir; }
+      }
+   } else if (typ == 17) {
+      RT c0= coef[0], c1= coef[1], c2= coef[2];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 if (++ph == dec) {
+	    ph= 0;
+	    fir= 0;
+	    fir += c0 * s0;
+	    fir += c1 * s1;
+	    dp[k++]= fir + c2 * iir;
+	 }
+	 s0= s1; s1= iir;
+      }
+   } else {
+      RT c0= coef[0], c1= coef[1], c2= coef[2], c3= coef[3], c4= coef[4];
+      for (a= 0; a<n; a++) {
+	 iir= dp[a];
+	 iir -= c0 * s0;
+	 iir -= c2 * s1;
+	 if (++ph == dec) {
+	    ph= 0;
+	    fir= 0;
+	    fir += c1 * s0;
+	    fir += c3 * s1;
+	    dp[k++]= fir + c4 * iir;
+	 }
+	 s0= s1; s1= iir;
+      }
+   }
+   st[0]= s0; st[1]= s1;
+   return k;
+}
+
+static int 
+RFN(block_stage_dec)(int end, int n_iir, int n_fir, int n_both, 
+		     RT *coef, RT *st, RT *dp, int n, int dec, int ph) {
+   int len= n_iir + n_fir + n_both;
+   int a, b, k= 0;
+
+   for (a= 0; a<n; a++) {
+      RT iir= dp[a], fir= 0;
+      RT *cp= coef, *sp= st;
+      int keep= (++ph == dec);
+      if (keep) ph= 0;
+      for (b= 0; b<n_iir; b++) { iir -= *cp++ * *sp++; }
+      if (keep) {
+	 for (b= 0; b<n_fir; b++) { fir += *cp++ * *sp++; }
+	 for (b= 0; b<n_both; b++) { 
+	    iir -= *cp++ * *sp; 
+	    fir += *cp++ * *sp++; 
+	 }
+	 if (end != 14) iir -= *cp++ * *sp;
+	 if (end != 13) fir += *cp++ * *sp;
+      } else {
+	 cp += n_fir; sp += n_fir;
+	 for (b= 0; b<n_both; b++) { iir -= *cp * *sp++; cp += 2; }
+	 if (end != 14) iir -= *cp * *sp;
+      }
+      memmove(st, st+1, len * sizeof(RT));
+      st[len]= iir;
+      if (keep) {
+	 if (end != 13) iir= fir + *cp * iir;
+	 dp[k++]= iir;
+      }
+   }
+   return k;
+}
+
+//
+//	A long FIR stage done by FFT (see rf_fft.c), two chunks at a
+//	time.  'st' holds the last n_tap-1 inputs, oldest first, as
+//	for block_stage().  'xx' is the buffer's scratch space, with
+//	room for ft->n_tmp doubles.
+//
+
+static void 
+RFN(block_fft)(RunFft *ft, double *xx, RT *st, RT *dp, int n) {
+   int n_hist= ft->n_tap - 1;
+   int chunk= ft->chunk;
+   double *tt= xx + 2*ft->size;
+   int a, m0, m1;
+
+   while (n > 0) {
+      m0= n < chunk ? n : chunk;
+      m1= n-m0 < chunk ? n-m0 : chunk;
+
+      // tt[] is the history followed by the input for both chunks,
+      // and the new history is the end of it
+      for (a= 0; a<n_hist; a++) tt[a]= st[a];
+      for (a= 0; a<m0+m1; a++) tt[n_hist+a]= dp[a];
+      for (a= 0; a<n_hist; a++) st[a]= (RT)tt[m0+m1+a];
+
+      memset(xx, 0, 2*ft->size * sizeof(double));
+      for (a= 0; a<n_hist+m0; a++) xx[2*a]= tt[a];
+      for (a= 0; a<n_hist+m1; a++) xx[2*a+1]= tt[m0+a];
+      fft_convolve(ft, xx);
+      for (a= 0; a<m0; a++) dp[a]= (RT)xx[2*(n_hist+a)];
+      for (a= 0; a<m1; a++) dp[m0+a]= (RT)-xx[2*(n_hist+a)+1];
+
+      dp += m0+m1; n -= m0+m1;
+   }
+}
+
+//
+//	Keep every dec-th sample in dp[], packed at the start, as the
+//	decimating routines do, and return how many there are
+//
+
+static int 
+RFN(block_pick)(RT *dp, int n, int dec, int ph) {
+   int a, k= 0;
+   for (a= 0; a<n; a++)
+      if (++ph == dec) { ph= 0; dp[k++]= dp[a]; }
+   return k;
+}
+
+//
+//	Run the 'n' samples in dp[] through the filter in place.  If
+//	'dec' is more than 1, then the last stage decimates as above
+//	and the number of outputs is returned, else 'n'.
+//
+
+static int 
+RFN(run_block)(void *fbuf, RT *dp, int n, int dec, int ph) {
+   RT *coef= ((RTBUF*)fbuf)->coef;
+   uchar *cmd= (uchar*)((RTBUF*)fbuf)->cmd;
+   RT *buf= &((RTBUF*)fbuf)->buf[0];
+   RunFft *ft= ((RTBUF*)fbuf)->fft, *ft1;
+   uchar *cmd0= cmd;
+   int n_iir, n_fir, n_both;
+   uchar ch, *cp;
+   int a, cnt, last;
+
+   while ((ch= *cmd++)) {
+      if (ch == 22) {
+	 RT gain= *coef++;
+	 for (a= 0; a<n; a++) dp[a] *= gain;
+	 continue;
+      }
+      if (ch >= 16) {
+	 cnt= 1;
+	 if (ch >= 19) { cnt= *cmd++; ch -= 3; }
+	 for (cp= cmd; *cp == 22; cp++) ;
+	 last= dec > 1 && !*cp;
+	 while (cnt-- > 0) {
+	    if (last && !cnt) {
+	       n= RFN(block_2x2_dec)(ch, coef, buf, dp, n, dec, ph);
+	       dec= 1;
+	    } else 
+	       RFN(block_2x2)(ch, coef, buf, dp, n);
+	    coef += ch == 16 ? 2 : ch == 17 ? 3 : 5;
+	    buf += 2;
+	 }
+	 continue;
+      }
+
+      // A general stage: see if it is one that can be done by FFT,
+      // then count up the elements until the end-stage
+      ft1= 0;
+      if (ft && cmd-1 == cmd0 + ft->pos) {
+	 ft1= ft;
+	 ft= ft->nxt;
+      }
+      n_iir= n_fir= n_both= 0;
+      while (ch < 13) {
+	 cnt= (ch & 3) ? (ch & 3) : 4 * *cmd++;
+	 if (ch <= 4) n_iir += cnt;
+	 else if (ch <= 8) n_fir += cnt;
+	 else n_both += cnt;
+	 if (!(ch= *cmd++)) 
+	    error("Internal error: fid_run_block found a stage without an end");
+      }
+      if (ch > 15) 
+	 error("Internal error: fid_run_block found a stage without an end");
+      for (cp= cmd; *cp == 22; cp++) ;
+      last= dec > 1 && !*cp;
+
+      // The FFT has to work out every output, so when decimating it
+      // is only worth it if there are still plenty of taps for each
+      // output kept
+      if (ft1 && n >= ft1->min_n && !(last && dec * 8 > ft1->n_tap)) {
+	 RFN(block_fft)(ft1, ((RTBUF*)fbuf)->tmp, buf, dp, n);
+	 if (last) { n= RFN(block_pick)(dp, n, dec, ph); dec= 1; }
+      } else if (last) {
+	 n= RFN(block_stage_dec)(ch, n_iir, n_fir, n_both, coef, buf, dp, n, dec, ph);
+	 dec= 1;
+      } else 
+	 RFN(block_stage)(ch, n_iir, n_fir, n_both, coef, buf, dp, n);
+      coef += n_iir + n_fir + 2*n_both + (ch == 13 ? 1 : ch == 14 ? 2 : 3);
+      buf += n_iir + n_fir + n_both + 1;
+   }
+
+   // A filter with no stages still has to be decimated
+   if (dec > 1) n= RFN(block_pick)(dp, n, dec, ph);
+   return n;
+}
+
+//
+//	Run a block of 'n' samples from in[] through the filter,
+//	writing the results to out[].  in[] and out[] may be the same
+//	array.
+//
+
+void 
+RFN(fid_run_block)(void *fbuf, const RT *in, RT *out, int n) {
+   if (n <= 0) return;
+   if (out != in) memcpy(out, in, n * sizeof(RT));
+   RFN(run_block)(fbuf, out, n, 1, 0);
+}
+
+//
+//	Run a block of 'n' samples from in[] through the filter, but
+//	only produce every dec-th output, packed at the start of
+//	out[], and return how many there are.  out[] must still have
+//	room for 'n' values, as it is used as workspace; in[] and out[]
+//	may be the same array.  'phase' (0 to dec-1) is the number of
+//	samples that have gone through since the last output; it should
+//	be advanced by 'n' modulo 'dec' for the next call.  This is for
+//	filters with a narrow output, such as low-pass filters well
+//	below the Nyquist frequency, so that whatever follows can run
+//	at the lower rate.
+//
+//	The results are exactly the same as the outputs picked out of
+//	a call to fid_run_block(), but the last stage of the filter
+//	only works out the outputs that are needed.  For an FIR
+//	filter this saves most of the work.
+//
+
+int 
+RFN(fid_run_block_dec)(void *fbuf, const RT *in, RT *out, int n, int dec, int phase) {
+   if (n <= 0) return 0;
+   if (dec < 1 || phase < 0 || phase >= dec)
+      error("Bad decimation passed to fid_run_block_dec(): %d/%d", phase, dec);
+   if (out != in) memcpy(out, in, n * sizeof(RT));
+   return RFN(run_block)(fbuf, out, n, dec, phase);
+}
+
+// END //
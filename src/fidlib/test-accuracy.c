@@ -1,10 +1,30 @@
 //
-//	This is a little test to compare how combined filters compare
-//	to evaluating filters in their natural stages.
+//	Tests of filter accuracy.
 //
+//	With filter-specs on the command line (or a default set if
+//	none are given), this runs noise and an impulse through each
+//	filter in single precision (fid_run_new_f()) and reports the
+//	error against the double-precision version, which is taken as
+//	the reference.  The float block and bank routines are checked
+//	to give the same results as the float step routine, except
+//	where the block routine does a long FIR stage by FFT, in which
+//	case its largest difference from the step routine is reported.
+//
+//	With '-c', this instead does the original little test to
+//	compare how combined filters compare to evaluating filters in
+//	their natural stages.  This is all that RF_COMBINED builds can
+//	do, as they have no single-precision routines.
+//
+
+// We're including it to make compiling different versions easier
+#include "fidlib.c"
 
-#include <stdio.h>
-#include <stdlib.h>
+#define NL "\n"
+
+// Float, block and bank routines are only all in the command-list code
+#if defined(RF_CMDLIST) || defined(RF_JIT)
+#define HAVE_FLOAT
+#endif
 
 double
 process3(double val) {
@@ -84,11 +104,16 @@ process2(double in) {
 }
 
 
-int 
-main(int ac, char **av) {
+//
+//	Compare combined and staged versions of the same filter, in
+//	double and float, printing the impulse responses side by side
+//
+
+static void
+compare_comb(int cnt) {
    double  in= 1.0;
 
-   while (1) {
+   while (cnt-- > 0) {
       printf("%-16.6g%-16.6g%-16.6g%-16.6g\n",
 	     process1(in),
 	     process2(in),
@@ -96,6 +121,178 @@ main(int ac, char **av) {
 	     process4(in));
       in= 0.0;
    }
+}
+
+#ifdef HAVE_FLOAT
+
+//
+//	Run 'in' through the filter in double and in float, and
+//	report the error of the float version.  Returns the number of
+//	mismatches between the float step, block and bank routines.
+//
+
+static int
+report(char *what, FidFilter *filt, double *in, int len) {
+   FidFunc *funcp;
+   FidFuncF *funcpf;
+   void *run, *buf, *run_f, *buf_f, *bank;
+   double *ref= ALLOC_ARR(len, double);
+   float *in_f= ALLOC_ARR(len, float);
+   float *out_f= ALLOC_ARR(len, float);
+   float *blk_f= ALLOC_ARR(len, float);
+   float *bk_in= ALLOC_ARR(4, float);
+   float *bk_out= ALLOC_ARR(4, float);
+   double sum_ref= 0, sum_err= 0, max_ref= 0, max_err= 0, max_blk= 0;
+   int a, b, bad= 0, fft= 0;
+
+   run= fid_run_new(filt, &funcp);
+   buf= fid_run_newbuf(run);
+   run_f= fid_run_new_f(filt, &funcpf);
+   buf_f= fid_run_newbuf(run_f);
+
+   for (a= 0; a<len; a++) {
+      ref[a]= funcp(buf, in[a]);
+      in_f[a]= in[a];
+      out_f[a]= funcpf(buf_f, in_f[a]);
+   }
+
+   // Float block and bank versions should match float step exactly,
+   // unless the block version uses an FFT
+#ifdef RUN_FFT_MIN
+   fft= ((Run*)run_f)->fft != 0;
+#endif
+   fid_run_zapbuf(buf_f);
+   fid_run_block_f(buf_f, in_f, blk_f, len);
+   bank= fid_bank_new(run_f, 4);
+   for (a= 0; a<len; a++) {
+      if (fft) {
+	 double err= fabs(blk_f[a] - out_f[a]);
+	 if (err > max_blk) max_blk= err;
+      } else if (memcmp(&blk_f[a], &out_f[a], sizeof(float))) bad++;
+      for (b= 0; b<4; b++) bk_in[b]= in_f[a];
+      fid_bank_run_f(bank, bk_in, bk_out);
+      for (b= 0; b<4; b++)
+	 if (memcmp(&bk_out[b], &out_f[a], sizeof(float))) bad++;
+   }
+
+   for (a= 0; a<len; a++) {
+      double err= out_f[a] - ref[a];
+      sum_ref += ref[a] * ref[a];
+      sum_err += err * err;
+      if (fabs(ref[a]) > max_ref) max_ref= fabs(ref[a]);
+      if (fabs(err) > max_err) max_err= fabs(err);
+   }
+
+   printf("  %-8s rms-ref %-10.4g rms-err %-10.4g SNR %6.1f dB  "
+	  "max-err %-10.4g (%.1f dB)%s\n",
+	  what, sqrt(sum_ref / len), sqrt(sum_err / len),
+	  sum_err ? 10 * log10(sum_ref / sum_err) : 999.9,
+	  max_err, max_err ? 20 * log10(max_ref / max_err) : 999.9,
+	  bad ? "  BLOCK/BANK MISMATCH" : "");
+   if (fft)
+      printf("  %-8s block by FFT: max-diff from step %-10.4g (%.1f dB)\n",
+	     what, max_blk, max_blk ? 20 * log10(max_ref / max_blk) : 999.9);
+
+   fid_bank_free(bank);
+   fid_run_freebuf(buf_f);
+   fid_run_free(run_f);
+   fid_run_freebuf(buf);
+   fid_run_free(run);
+   free(bk_out); free(bk_in);
+   free(blk_f); free(out_f); free(in_f); free(ref);
+   return bad;
+}
+
+//
+//	Report on each of the given filters with noise and an impulse
+//
+
+static void
+report_all(char **spec, int len) {
+   double *noise, *imp;
+   unsigned int seed= 1;
+   int a, bad= 0;
+
+   // Inputs: uniform noise in -1..+1, and a unit impulse
+   noise= ALLOC_ARR(len, double);
+   imp= ALLOC_ARR(len, double);
+   for (a= 0; a<len; a++) {
+      seed= seed * 1103515245 + 12345;
+      noise[a]= (int)seed * (1.0 / 2147483648.0);
+   }
+   imp[0]= 1.0;
+
+   for (; *spec; spec++) {
+      FidFilter *filt= fid_design(*spec, 1.0, -1.0, -1.0, 0, 0);
+      printf("%s\n", *spec);
+      bad += report("noise", filt, noise, len);
+      bad += report("impulse", filt, imp, len);
+      free(filt);
+   }
+   free(imp); free(noise);
+
+   if (bad) error("Float block/bank routines don't match float step");
+}
+
+#endif
+
+void 
+usage() {
+   error(NL "test-accuracy: Measure the error of single-precision filters"
+	 NL "      against the double-precision versions."
+	 NL 
+	 NL "Usage:  test-accuracy [-n <len>] [<immediate-filter-spec> ...]"
+	 NL "        test-accuracy -c [<count>]"
+	 NL "Option '-n' sets the number of samples to run (default 100000)"
+	 NL "Option '-c' compares combined and staged filters instead"
+	 NL "  (the only test available in an RF_COMBINED build)"
+	 NL "Frequencies are relative to a sampling rate of 1.0.  With no"
+	 NL "filter-specs, a default set of low-order filters is tested."
+	 );
+}
+
+#ifdef HAVE_FLOAT
+// Default filters, at frequencies typical of EEG bands at 256Hz
+static char *def_spec[]= {
+   "LpBe2/0.004", "LpBe2/0.04", "LpBe4/0.004", "LpBe4/0.04",
+   "LpBu4/0.004", "LpBu4/0.04", "LpBu4/0.2",
+   "BpBu4/0.037-0.045", "BpBu4/0.004-0.008", "BpBu4/0.16-0.18",
+   "HpBu2/0.002", 0
+};
+#endif
+
+int 
+main(int ac, char **av) {
+   char dmy;
+   int len= 100000;
+
+   // Process arguments
+   ac--; av++;
+   while (ac > 0 && av[0][0] == '-' && av[0][1]) {
+      char ch, *p= *av++ + 1; 
+      ac--;
+      while ((ch= *p++)) switch (ch) {
+       case 'c':
+	  if (ac > 1 || (ac == 1 && 1 != sscanf(av[0], "%d %c", &len, &dmy)))
+	     usage();
+	  compare_comb(ac ? len : 1000);
+	  return 0;
+       case 'n':
+	  if (ac < 1 || 1 != sscanf(av[0], "%d %c", &len, &dmy) || len < 1)
+	     usage();
+	  ac--; av++;
+	  break;
+       default:
+	  usage();
+      }
+   }
+
+#ifdef HAVE_FLOAT
+   report_all(ac ? av : def_spec, len);
+#else
+   error("Only '-c' is available with RF_COMBINED, which has no float routines");
+#endif
    return 0;
 }
-	     
+
+// END //
@@ -18,9 +18,12 @@ usage() {
    error(NL "test: Simple application to test speed of filter implementations"
 	 NL "      by calculating an impulse response."
 	 NL 
-	 NL "Usage:  test [-cd] <count> <immediate-filter-spec> ..."
+	 NL "Usage:  test [-cd] [-b <n>] [-k <len>] <count> <immediate-filter-spec> ..."
 	 NL "Option '-c' combines all the sub-filters into just one filter."
 	 NL "Option '-d' dumps output values to STDERR"
+	 NL "Option '-b' runs <n> streams together through a filter bank"
+	 NL "  (the dump shows the first stream)"
+	 NL "Option '-k' runs the filter in blocks of <len> samples"
 	 );
 }
 
@@ -29,6 +32,8 @@ main(int ac, char **av) {
    char dmy;
    int f_comb= 0;
    int f_dump= 0;
+   int n_bank= 0;
+   int blk= 0;
    int cnt;
    FidFilter *filt;
    void *run;
@@ -48,6 +53,16 @@ main(int ac, char **av) {
        case 'd':
 	  f_dump= 1;
 	  break;
+       case 'b':
+	  if (ac < 1 || 1 != sscanf(av[0], "%d %c", &n_bank, &dmy) || n_bank < 1)
+	     usage();
+	  ac--; av++;
+	  break;
+       case 'k':
+	  if (ac < 1 || 1 != sscanf(av[0], "%d %c", &blk, &dmy) || blk < 1)
+	     usage();
+	  ac--; av++;
+	  break;
        default:
 	  usage();
       }
@@ -62,6 +77,38 @@ main(int ac, char **av) {
    run= fid_run_new(filt, &funcp);
    buf= fid_run_newbuf(run);
 
+   // Do the impulse response through a bank
+   if (n_bank) {
+      void *bank= fid_bank_new(run, n_bank);
+      double *in= ALLOC_ARR(n_bank, double);
+      double *out= ALLOC_ARR(n_bank, double);
+      int a;
+      for (a= 0; a<n_bank; a++) in[a]= 1.0;
+      while (cnt-- > 0) {
+	 fid_bank_run(bank, in, out);
+	 if (f_dump) fprintf(stderr, "%g\n", out[0]);
+	 for (a= 0; a<n_bank; a++) in[a]= 0.0;
+      }
+      fid_bank_free(bank);
+      return 0;
+   }
+
+   // Do the impulse response in blocks
+   if (blk) {
+      double *in= ALLOC_ARR(blk, double);
+      double *out= ALLOC_ARR(blk, double);
+      int a, len;
+      in[0]= 1.0;
+      while (cnt > 0) {
+	 len= cnt < blk ? cnt : blk;
+	 fid_run_block(buf, in, out, len);
+	 if (f_dump) for (a= 0; a<len; a++) fprintf(stderr, "%g\n", out[a]);
+	 in[0]= 0.0;
+	 cnt -= len;
+      }
+      return 0;
+   }
+
    // Do the impulse response
    if (!f_dump) {
       funcp(buf, 1.0);
@@ -37,7 +37,7 @@ Uint32 main_threadid;	// ID of main thread
 
 // Server
 int server;		// Server mode? (0 no, 1 yes)
-int server_rd;		// Server read position in sample buffer
+Cursor *server_cur;	// Server read cursor in sample buffer, or 0
 int server_out= -1;	// Server output FD if active, or -1
 
 // Hacks
@@ -75,6 +75,18 @@ usage() {
 	 NL "  -S    Run in TCP server mode, faking a minimal 'OpenEEG server' on port"
 	 NL "        8336 for just one client, and relaying samples to that client."
 	 NL "        The config file should be called \"eegmir-server.cfg\"."
+	 NL "  -B <fmt> <file>"
+	 NL "        Benchmark the decoder for serial format <fmt> (e.g. modEEG-P2) by"
+	 NL "        replaying a raw capture such as \"dump.raw\" through it, and report"
+	 NL "        the throughput."
+	 NL "  -A <in> <out>"
+	 NL "        Batch analysis: load \"eegmir.cfg\" without any display, and run the"
+	 NL "        analysis of every bands page over the recording <in> (e.g. a"
+	 NL "        \"dump.raw\") as fast as possible, in place of the configured input."
+	 NL "        Each frame-interval of data gives a row of mag/magsm values for"
+	 NL "        each bar and channel, written to <out> as CSV if it ends in \".csv\","
+	 NL "        else as 4-byte floats.  With several bands pages, the page is added"
+	 NL "        to the name, e.g. \"out-F2.csv\"."
 	 );
 }
 
@@ -112,6 +124,14 @@ main(int ac, char **av) {
        case 'S':
 	  server= 1;
 	  break;
+       case 'B':
+	  if ((ac -= 2) < 0) usage();
+	  decode_benchmark(av[0], av[1]);
+	  return 0;
+       case 'A':
+	  if ((ac -= 2) < 0) usage();
+	  batch_run(av[0], av[1]);
+	  return 0;
        default:	
 	  error("Unknown option '%c'", ch);
       }
@@ -58,7 +58,7 @@ trim(char *p, int len) {
 //
 
 int 
-setup_server_connection(char *serv, int port, Parse *pp) {
+setup_server_connection(Device *dev, char *serv, int port, Parse *pp) {
    int fd;
    char buf[260], *tmp;
    struct sockaddr_in sv_addr;
@@ -188,7 +188,7 @@ setup_server_connection(char *serv, int port, Parse *pp) {
 	 
 	 if (first) {
 	    dev->min= min;
-	    dev->max= min;
+	    dev->max= max;
 	    spr= cnt;
 	    first= 0;
 	 } else {
@@ -211,6 +211,8 @@ setup_server_connection(char *serv, int port, Parse *pp) {
 
       dev->n_chan= n_chan;
       dev->handler= nsd_handler;
+      if (!dev->width) 
+	 dev->width= (dev->min < -0x8000 || dev->max > 0x7FFF) ? 4 : 2;
       dev->n_flag= 0;
       dev->fd= fd;
    }
@@ -360,7 +362,7 @@ readLine(char *buf, int len) {
 //
 
 void 
-nsd_handler() {
+nsd_handler(Device *dev) {
    int avail;
    int rd= dev->ird;
    int wr= dev->iwr;
@@ -375,7 +377,8 @@ nsd_handler() {
 #define INC_pp { pp++; pp &= mask; }
 
    pplim= (rd + sizeof(line)-8) & mask;
-   if (pp < 0) pp= rd;
+   if (pp < 0 || ((pp-rd) & mask) > ((wr-rd) & mask)) 
+      pp= rd;		// Restart scan; bytes were dropped on overflow
 
    while (pp != wr) {
       if (pp == pplim) {
@@ -417,7 +420,7 @@ nsd_handler() {
       pplim= (rd + sizeof(line)-8) & mask;
 
       // Handle the line
-      nsd_line(line);
+      nsd_line(dev, line);
    }
 
    // Save the scanning position
@@ -432,7 +435,7 @@ nsd_handler() {
 //
 
 void 
-nsd_line(char *line) {
+nsd_line(Device *dev, char *line) {
    Sample *ss;
    int cn, pc, nc, okay;
    int prev= dev->hdata[1];
@@ -448,7 +451,7 @@ nsd_line(char *line) {
    }
 
    // Write a new Sample entry
-   if (!dev->now) dev->now= time_now_ms();
+   if (!dev->now) dev->now= time_now_us();
    ss= SAMPLE(dev->wr);
    memset(ss, 0, dev->s_smp);
    ss->stamp= dev->now;
@@ -467,9 +470,17 @@ nsd_line(char *line) {
 	       applog("NeuroServer input line with wrong number of channels:\n %s", line);
 	       return;
 	    }
-	    for (a= 0; a<nc; a++) {
-	       ss->val[a]= strtol(p= q, &q, 10);
-	       if (!VALID) break;
+	    if (dev->width == 4) {
+	       int *vp= ((Sample32*)ss)->val;
+	       for (a= 0; a<nc; a++) {
+		  vp[a]= strtol(p= q, &q, 10);
+		  if (!VALID) break;
+	       }
+	    } else {
+	       for (a= 0; a<nc; a++) {
+		  ss->val[a]= strtol(p= q, &q, 10);
+		  if (!VALID) break;
+	       }
 	    }
 	    if (a == nc) {
 	       okay= 1;
@@ -500,14 +511,13 @@ nsd_line(char *line) {
    while (pc != next) {
       // Duplicate the current packet data into the next slot
       Sample *ss2;
-      int wr2= ((dev->wr + 1) & dev->mask);
-      ss2= SAMPLE(wr2);
+      ss2= SAMPLE(dev->wr + 1);	// (within SAMPLE_GUARD)
       memcpy(ss2, ss, dev->s_smp);
 
       // Set up an error packet and output
       ss->err= 1;
-      for (a= 0; a<dev->n_chan; a++) ss->val[a]= 0;
-      SAMPLE_INC(dev->wr);
+      memset(ss->val, 0, dev->n_chan * dev->width);
+      SAMPLE_PUBLISH(dev);
 
       ss= ss2;
       prev= next;
@@ -518,7 +528,7 @@ nsd_line(char *line) {
       applog("NeuroServer packet counter indicates %d missing packets", cnt);
 
    // Output the original packet
-   SAMPLE_INC(dev->wr);
+   SAMPLE_PUBLISH(dev);
    prev= pc;
 
    dev->hdata[1]= prev;
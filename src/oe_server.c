@@ -191,7 +191,7 @@ send_edf_header(int fd) {
    char *dat;
    int len;
 
-   if (n_chan > 240) 
+   if (n_chan > 9999) 	// Limit of 4-character EDF field
       error("Too many channels for server to handle: %d", n_chan);
    
    wrEDF_n_chan= n_chan;
@@ -250,34 +250,45 @@ send_edf_header(int fd) {
    
 
 //
-//	Handle any new incoming data samples
+//	Handle any new incoming data samples.  This is called from the
+//	input thread just after the samples are published, so there is
+//	no danger of them being overwritten whilst we read them.
 //
 
-//#define SAMPLE(nn) (Sample*)(dev->smp + (nn) * dev->s_smp)
-//#define SAMPLE_INC(nn) nn= (nn+1) & dev->mask
-
 void 
 server_handler() {
    static int counter= 0;
    
    // Ignore if we're not ready to output yet
    if (server_out < 0) {
-      server_rd= dev->wr;
+      server_cur->rd= dev->wr;
       return;
    }
 
    // Output all we can
    {
-      char buf[512];
-      char *end= &buf[512];
-      char *p;
+      static char *buf= 0;
+      static int buflen= 0;
+      char *end, *p;
 
       int n_chan= dev->n_chan;
+      int w32= (dev->width == 4);
+      Sint64 wr;
       int a;
 
-      while (server_rd != dev->wr) {
+      // Room for the header plus " -2147483648" for each channel
+      if (buflen < 32 + 12 * n_chan) {
+	 free(buf);
+	 buflen= 32 + 12 * n_chan;
+	 buf= Alloc(buflen);
+      }
+      end= buf + buflen;
+
+      wr= cursor_check(server_cur);
+
+      while (server_cur->rd != wr) {
 	 // Add given sample to buffer
-	 Sample *ss= SAMPLE(server_rd);
+	 Sample *ss= SAMPLE(server_cur->rd);
 
 	 counter++;
 	 counter &= 255;
@@ -285,12 +296,18 @@ server_handler() {
 	 if (!ss->err) {
 	    p= buf;
 	    p += snprintf(p, end-p, "! 0 %d %d", counter, n_chan);
-	    for (a= 0; a<n_chan; a++) 
-	       p += snprintf(p, end-p, " %d", ss->val[a]);
+	    if (w32) {
+	       int *vp= ((Sample32*)ss)->val;
+	       for (a= 0; a<n_chan; a++) 
+		  p += snprintf(p, end-p, " %d", vp[a]);
+	    } else {
+	       for (a= 0; a<n_chan; a++) 
+		  p += snprintf(p, end-p, " %d", ss->val[a]);
+	    }
 	    p += snprintf(p, end-p, "\r\n");
 	    writeData(server_out, (void*)buf, (p-buf));
 	 }
-	 SAMPLE_INC(server_rd);
+	 server_cur->rd++;
       }
    }
 }
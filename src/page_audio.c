@@ -41,8 +41,8 @@ struct PageAudio {
    //   AudioFB *typarr[10];	// List of loaded feedback types, or 0 if slot is free
 
    // Just for testing ...
-   int fmrd;                  // Read-offset in sample buffer
-   int fmdelay;               // Delay (ms/65536)
+   Cursor *fmcur;             // Read cursor in sample buffer
+   Sint64 fmdelay;            // Delay (us/65536)
    Uint32 fmosc0, fmosc1;     // Oscillators (<<SINTAB_FBC)
    int fmincmin, fmincwid;    // Carrier/width expressed as min+wid oscillator increments
    int fmamp;                 // Amplitude
@@ -66,6 +66,7 @@ Page *
 p_audio_init(Parse *pp) {
    PageAudio *pg= ALLOC(PageAudio);
    double v0, v1, v2;
+   int ival;
 
    pg->pg.event= event;
 
@@ -74,9 +75,10 @@ p_audio_init(Parse *pp) {
       
 
       if (parse(pp, "test-fmsig %dms %f+%f/%f;", 
-		&pg->fmdelay, &v0, &v1, &v2)) {
-	 pg->fmdelay *= 65536;
-	 pg->fmrd= (dev->wr - 2) & dev->mask;
+		&ival, &v0, &v1, &v2)) {
+	 pg->fmdelay= ival * (Sint64)65536000;
+	 pg->fmcur= cursor_new("audio fm", CUR_SKIP, 0, 0);
+	 pg->fmcur->rd -= 2;
 	 pg->fmincmin= (int)((65536*65536.0) * (v0-v1) / audio_rate);
 	 pg->fmincwid= (int)((65536*65536.0) * (2*v1) / audio_rate);
 	 pg->fmamp= (int)(SINTAB_HRM * v2 / 100.0);
@@ -143,52 +145,61 @@ event(Event *ev) {
 static void
 fm_handler(void *vp, short *buf, int cnt) {
    PageAudio *pg= vp;
-   int now= audio_clock.clock - pg->fmdelay;
-   int nowinc= audio_clock.clockinc / cnt;
+   Sint64 now= audio_clock.clock - pg->fmdelay;
+   Sint64 nowinc= audio_clock.clockinc / cnt;
    int smpsmp;		// Audio samples per data sample
    int smpcnt;
    Sample *ss0, *ss1;
-   int rd0, rd1, rd2;
+   Sint64 rd0, rd1, rd2;
+   Sint64 wr= cursor_check(pg->fmcur);
    int inc0, inc1;
    int incinc0, incinc1;
    Uint32 osc0, osc1;
    int devmin= dev->min;
    double mul= 1.0 * pg->fmincwid / (dev->max - dev->min);
 
+   // (Only a few samples are read per audio block)
+#define V0(ss) SAMPLE_VAL(dev, ss, 0)
+#define V1(ss) SAMPLE_VAL(dev, ss, 1)
+
    osc0= pg->fmosc0;
    osc1= pg->fmosc1;
 
-   rd0= pg->fmrd;
-   rd1= (rd0+1) & dev->mask;
-   rd2= (rd0+2) & dev->mask;
+   // If we stalled for so long that we were lapped, cursor_check()
+   // has skipped us to the latest data, but we need two samples
+   rd0= pg->fmcur->rd;
+   if (wr - rd0 < 2) 
+      rd0= wr - 2;
+   rd1= rd0+1;
+   rd2= rd0+2;
 
    //   {
-   //      Sample *ss= SAMPLE((dev->wr-1) & dev->mask);
+   //      Sample *ss= SAMPLE(wr-1);
    //      warn("Block-start at time %d, last sample read at %d", now, ss->time);
    //   }
 
    ss0= SAMPLE(rd0);
    ss1= SAMPLE(rd1);
 
-   smpsmp= (ss1->time-ss0->time) / nowinc;
-   inc0= pg->fmincmin + (int)(mul * (ss0->val[0] - devmin));
-   incinc0= (int)(mul * (ss1->val[0] - ss0->val[0]) / smpsmp);
-   inc1= pg->fmincmin + (int)(mul * (ss0->val[1] - devmin));
-   incinc1= (int)(mul * (ss1->val[1] - ss0->val[1]) / smpsmp);
+   smpsmp= (int)((ss1->time-ss0->time) / nowinc);
+   inc0= pg->fmincmin + (int)(mul * (V0(ss0) - devmin));
+   incinc0= (int)(mul * (V0(ss1) - V0(ss0)) / smpsmp);
+   inc1= pg->fmincmin + (int)(mul * (V1(ss0) - devmin));
+   incinc1= (int)(mul * (V1(ss1) - V1(ss0)) / smpsmp);
 
-   smpcnt= (now-ss0->time) / nowinc;
+   smpcnt= (int)((now-ss0->time) / nowinc);
    inc0 += incinc0 * smpcnt;
    inc1 += incinc1 * smpcnt;
 
    for (; cnt-- > 0; now += nowinc) {
-      while (rd2 != dev->wr && now-ss1->time > 0) {
-	 rd0= rd1; rd1= rd2; SAMPLE_INC(rd2);
+      while (rd2 != wr && now-ss1->time > 0) {
+	 rd0= rd1; rd1= rd2; rd2++;
 	 ss0= ss1; ss1= SAMPLE(rd1);
-	 smpsmp= (ss1->time-ss0->time) / nowinc;
-	 inc0= pg->fmincmin + (int)(mul * (ss0->val[0] - devmin));
-	 incinc0= (int)(mul * (ss1->val[0] - ss0->val[0]) / smpsmp);
-	 inc1= pg->fmincmin + (int)(mul * (ss0->val[1] - devmin));
-	 incinc1= (int)(mul * (ss1->val[1] - ss0->val[1]) / smpsmp);
+	 smpsmp= (int)((ss1->time-ss0->time) / nowinc);
+	 inc0= pg->fmincmin + (int)(mul * (V0(ss0) - devmin));
+	 incinc0= (int)(mul * (V0(ss1) - V0(ss0)) / smpsmp);
+	 inc1= pg->fmincmin + (int)(mul * (V1(ss0) - devmin));
+	 incinc1= (int)(mul * (V1(ss1) - V1(ss0)) / smpsmp);
 	 //	 warn("Read-pos %d, time %d, sample-time %d, count %d", rd0, now, ss0->time, cnt);
       }
 
@@ -202,7 +213,10 @@ fm_handler(void *vp, short *buf, int cnt) {
 
    pg->fmosc0= osc0;
    pg->fmosc1= osc1;
-   pg->fmrd= rd0;
+   pg->fmcur->rd= rd0;
+
+#undef V0
+#undef V1
 }
 
 #endif
@@ -15,6 +15,14 @@
 //	trace.  It is also filtered by a user-supplied low-pass filter
 //	to give a slower reacting trace (a bar).
 //
+//	The output of the band-limit filter is narrowband, so it is
+//	decimated, and the amplitude and smoothing are worked out at
+//	the lower rate.  The factor is chosen for each bar from where
+//	its band-limit and smoothing filters are down by 40dB, so that
+//	the lower rate is at least four times that, unless it is fixed
+//	for the page with 'decimate'.  The smoothing filter is designed
+//	for the lower rate.
+//
 //	The phase could also be output on both sides symmetrically to
 //	give a sense of the connection between the sides.  @@@ One day.
 //
@@ -30,15 +38,15 @@ struct PB_Bar {
    int col;		// Colour value
    double freq;		// Centre frequency
    FidFilter *lp;	// Lowpass band-limit filter
-   FidFilter *sm;	// Smoothing low-pass
+   FidFilter *sm;	// Smoothing low-pass, at the decimated rate
+   int dec;		// Decimation after the band-limit filter
 
    // Runtime stuff
    FidRun *lp_run;
-   FidFunc *lp_func;
    FidRun *sm_run;
-   FidFunc *sm_func;
 
    double osc[4];	// Complex oscillator
+   int ph;		// Samples since the last decimated output (0..dec-1)
    struct {
       void *lp0;	// Real part of band-limit filter
       void *lp1;	// Imaginary part of band-limit filter
@@ -56,7 +64,14 @@ struct PageBands {
    int fps;		// Frames per second for display update
    int fms;		// Frame interval in ms (1000 / fps)
    int n_bar;		// Number of bars on this display
-   int rd;		// Current read-offset into dev->smp[]
+   Cursor *cur;		// Read cursor in dev->smp[]
+   int catchup;		// Catch-up policy for cursor (CUR_*), or -1 for device default
+   int decimate;	// Decimation for all bars ('decimate'), or 0 to choose for each
+   int kept;		// Set whilst hidden: the analysis is valid up to cur->rd
+   double *osc0, *osc1;	// Oscillator values for the current block (PB_BLOCK)
+   double *re, *im;	// Band-limit filter values for one channel's block (PB_BLOCK)
+   double *mag;		// Magnitudes for one channel's block (PB_BLOCK)
+   FidArena *arena;	// Holds all the bars' filter buffers
    PB_Bar *bar;		// Chain of bars
    int label_max;	// Maximum length of a label
    double gain;		// Gain for bar displays
@@ -75,6 +90,15 @@ struct PageBands {
    int font_cx, font_cy; // Font cell size
    int tow_sx;		// Width of tower in pixels
    Settings *set;	// Settings for display
+
+   // Batch analysis (see batch.c)
+   FILE *out;		// Output for rows of mag/magsm values, or 0
+   int csv;		// Output as CSV text rather than binary floats
+   int row_len;		// Samples per output row
+   int row_cnt;		// Samples since the last row
+   Sint64 rd0;		// Read position at the start of the run
+   PB_Bar **bars;	// Bars in display order
+   float *row;		// Row buffer for binary output
 };
 
 #else
@@ -88,6 +112,30 @@ struct PageBands {
 //
 
 static void event(Event *ev);
+static void resync(void *vp);
+static void write_row(PageBands *pg);
+
+#define RESYNC_SEC 2	// Seconds of data to rerun through the filters on resync
+#define PB_BLOCK 256	// Maximum samples processed in one block
+#define PB_DEC_MAX 32	// Maximum decimation chosen automatically
+
+//
+//	Find the highest frequency (relative to the rate) at which the
+//	filter's response is within 40dB of its peak
+//
+
+static double 
+filter_width(FidFilter *ff) {
+   double peak= 0, resp, wid= 0;
+   int a;
+   for (a= 0; a<=1000; a++) {
+      resp= fid_response(ff, a * 0.0005);
+      if (resp > peak) peak= resp;
+   }
+   for (a= 0; a<=1000; a++)
+      if (fid_response(ff, a * 0.0005) > peak * 0.01) wid= a * 0.0005;
+   return wid;
+}
 
 Page *
 p_bands_init(Parse *pp) {
@@ -95,6 +143,7 @@ p_bands_init(Parse *pp) {
    PB_Bar *bb;
    int ival, a;
    char *p0, *p1;
+   char *sm0, *sm1, *sm_rew;
    char *err;
 
    pg->pg.event= event;
@@ -102,6 +151,7 @@ p_bands_init(Parse *pp) {
    pg->gain= 1.0;
    pg->sgain= 1.0;
    pg->chan= 0;
+   pg->catchup= -1;
    pg->c_bg= map_rgb(0x000000);
    pg->c_fg= map_rgb(0xFFFFFF);
    //pg->c_sig0= map_rgb(0x80A080);
@@ -119,6 +169,15 @@ p_bands_init(Parse *pp) {
       if (parse(pp, "sgain %f;", &pg->sgain)) continue;
       if (parse(pp, "spots;")) { pg->spots= 1; continue; }
       if (parse(pp, "title %Q;", &pg->title)) continue;
+      if (parse(pp, "catchup skip;")) { pg->catchup= CUR_SKIP; continue; }
+      if (parse(pp, "catchup resync;")) { pg->catchup= CUR_RESYNC; continue; }
+      if (parse(pp, "decimate %d;", &pg->decimate)) {
+	 if (pg->decimate < 1 || pg->decimate > PB_BLOCK) {
+	    line_error(pp, pp->rew, "Bad 'decimate' factor; expecting 1 to %d", PB_BLOCK);
+	    return 0;
+	 }
+	 continue;
+      }
       break;
    }
 
@@ -136,6 +195,7 @@ p_bands_init(Parse *pp) {
       bb->label_wid= p1-p0;
       bb->col= map_rgb(ival);
       if (p1-p0 > pg->label_max) pg->label_max= p1-p0;
+      sm0= sm1= sm_rew= 0;
       while (1) {
 	 if (parse(pp, "filter %f, %r;", &bb->freq, &p0, &p1)) {
 	    err= fid_parse(dev->rate, &p0, &bb->lp);
@@ -151,17 +211,9 @@ p_bands_init(Parse *pp) {
 	    continue;
 	 }
 
-	 if (parse(pp, "smooth %r;", &p0, &p1)) {
-	    err= fid_parse(dev->rate, &p0, &bb->sm);
-	    if (err) {
-	       line_error(pp, pp->rew, "Bad filter-spec: %s", err);
-	       free(err);
-	       return 0;
-	    }
-	    if (p0 != p1) {
-	       line_error(pp, p0, "Junk following filter-spec");
-	       return 0;
-	    }
+	 // Designed below, once the decimation is known
+	 if (parse(pp, "smooth %r;", &sm0, &sm1)) {
+	    sm_rew= pp->rew;
 	    continue;
 	 }
 	 break;
@@ -171,6 +223,38 @@ p_bands_init(Parse *pp) {
 	 line_error(pp, pp->pos, "Please specify a 'filter' for this 'bar' section");
 	 return 0;
       }
+
+      // Choose the decimation, and design the smoothing filter for
+      // the decimated rate
+      bb->dec= pg->decimate;
+      if (!bb->dec) {
+	 double wid= filter_width(bb->lp);
+	 if (sm0) {
+	    p0= sm0;
+	    err= fid_parse(dev->rate, &p0, &bb->sm);
+	    if (!err) {
+	       double wid2= filter_width(bb->sm);
+	       if (wid2 > wid) wid= wid2;
+	       free(bb->sm); bb->sm= 0;
+	    } else 
+	       free(err);
+	 }
+	 bb->dec= wid > 0.25 / PB_DEC_MAX ? (int)(0.25 / wid) : PB_DEC_MAX;
+	 if (bb->dec < 1) bb->dec= 1;
+      }
+      if (sm0) {
+	 p0= sm0;
+	 err= fid_parse(dev->rate / bb->dec, &p0, &bb->sm);
+	 if (err) {
+	    line_error(pp, sm_rew, "Bad filter-spec: %s", err);
+	    free(err);
+	    return 0;
+	 }
+	 if (p0 != sm1) {
+	    line_error(pp, p0, "Junk following filter-spec");
+	    return 0;
+	 }
+      }
    }
 
    if (!parseEOF(pp)) {
@@ -179,16 +263,38 @@ p_bands_init(Parse *pp) {
    }
 
    // Setup run-time data
-   pg->rd= dev->wr;
+   {
+      char name[64];
+      sprintf(name, "%.50s bands", pp->sect);
+      pg->cur= cursor_new(name, pg->catchup, resync, pg);
+      pg->cur->idle= 1;
+   }
+   pg->osc0= ALLOC_ARR(PB_BLOCK, double);
+   pg->osc1= ALLOC_ARR(PB_BLOCK, double);
+   pg->re= ALLOC_ARR(PB_BLOCK, double);
+   pg->im= ALLOC_ARR(PB_BLOCK, double);
+   pg->mag= ALLOC_ARR(PB_BLOCK, double);
+   // The filter buffers all go in one arena, laid out in the order
+   // process_data() runs through them: bar by bar, as each bar's
+   // oscillator block is shared by its channels, and then lp0, lp1
+   // and sm for each channel
+   {
+      int size= 0;
+      for (bb= pg->bar; bb; bb= bb->nxt) {
+	 FidFunc *func;
+	 sincos_init(bb->osc, bb->freq / dev->rate);
+	 bb->lp_run= fid_run_new(bb->lp, &func);
+	 if (bb->sm) bb->sm_run= fid_run_new(bb->sm, &func);
+	 size += dev->n_chan * 2 * fid_arena_bufsize(bb->lp_run);
+	 if (bb->sm_run) size += dev->n_chan * fid_arena_bufsize(bb->sm_run);
+      }
+      pg->arena= fid_arena_new(size);
+   }
    for (bb= pg->bar; bb; bb= bb->nxt) {
-      sincos_init(bb->osc, bb->freq / dev->rate);
-      bb->lp_run= fid_run_new(bb->lp, &bb->lp_func);
-      if (bb->sm) bb->sm_run= fid_run_new(bb->sm, &bb->sm_func);
-
       for (a= 0; a<dev->n_chan; a++) {
-	 bb->chan[a].lp0= fid_run_newbuf(bb->lp_run);
-	 bb->chan[a].lp1= fid_run_newbuf(bb->lp_run);
-	 bb->chan[a].sm= bb->sm_run ? fid_run_newbuf(bb->sm_run) : 0;
+	 bb->chan[a].lp0= fid_arena_newbuf(pg->arena, bb->lp_run);
+	 bb->chan[a].lp1= fid_arena_newbuf(pg->arena, bb->lp_run);
+	 bb->chan[a].sm= bb->sm_run ? fid_arena_newbuf(pg->arena, bb->sm_run) : 0;
       }
    }
 
@@ -210,48 +316,94 @@ p_bands_init(Parse *pp) {
 }
 
 //
-//	Process all data since the last time we were called
+//	Process all data since the last time we were called.  This
+//	works through the data in blocks, running each channel of each
+//	bar along its normalised plane (see DEV_PLANE) a block at a
+//	time with fid_run_block_dec().  The oscillator values for the
+//	block are worked out once per bar and shared by all the
+//	channels.  The magnitude and smoothing are only worked out for
+//	the decimated samples.
 //
 
 static void 
 process_data(PageBands *pg) {
    PB_Bar *bb;
-   int wr= dev->wr;		// Make sure we have a static target!
    int n_chan= dev->n_chan;
-   int off= -((dev->min + dev->max + 1)/2);
-   double mul= 2.0/(dev->max+1-dev->min);
-   int a;
+   Sint64 wr= cursor_check(pg->cur);	// Make sure we have a static target!
+   double *o0= pg->osc0, *o1= pg->osc1;
+   double *re= pg->re, *im= pg->im, *mag= pg->mag;
+   int a, b, cnt, off, k;
+
+   // A resync in the middle of this loop processes data itself, so
+   // the read position may end up past the old target
+   while (pg->cur->rd < wr) {
+      Sint64 rd= pg->cur->rd;
+
+      // Block must not wrap round the end of the planes
+      off= (int)(rd & dev->mask);
+      cnt= dev->n_smp - off;
+      if (cnt > wr - rd) cnt= (int)(wr - rd);
+      if (cnt > PB_BLOCK) cnt= PB_BLOCK;
+      if (pg->out && cnt > pg->row_len - pg->row_cnt) 
+	 cnt= pg->row_len - pg->row_cnt;
 
-   while (pg->rd != wr) {
-      int last;
-      Sample *ss= SAMPLE(pg->rd);
-      SAMPLE_INC(pg->rd);
-      last= (pg->rd == wr);	// Do extra calculations if this is the last one
-      
       for (bb= pg->bar; bb; bb= bb->nxt) {
-	 sincos_step(bb->osc);
+	 for (b= 0; b<cnt; b++) {
+	    sincos_step(bb->osc);
+	    o0[b]= bb->osc[0];
+	    o1[b]= bb->osc[1];
+	 }
 	 for (a= 0; a<n_chan; a++) {
-	    double val= (ss->val[a] + off) * mul;
-	    double out0= bb->lp_func(bb->chan[a].lp0, val * bb->osc[0]);
-	    double out1= bb->lp_func(bb->chan[a].lp1, val * bb->osc[1]);
-	    double out= hypot(out0, out1);
-	    double outsm= bb->sm_func ? bb->sm_func(bb->chan[a].sm, out) : out;
-	    bb->chan[a].mag= out;
-	    //bb->chan[a].pha= last ? atan2(out1, out0) : 0;
-	    bb->chan[a].magsm= outsm;
+	    float *vp= DEV_PLANE(dev, a) + off;
+	    for (b= 0; b<cnt; b++) {
+	       re[b]= vp[b] * o0[b];
+	       im[b]= vp[b] * o1[b];
+	    }
+	    k= fid_run_block_dec(bb->chan[a].lp0, re, re, cnt, bb->dec, bb->ph);
+	    fid_run_block_dec(bb->chan[a].lp1, im, im, cnt, bb->dec, bb->ph);
+	    if (!k) continue;
+	    for (b= 0; b<k; b++)
+	       mag[b]= hypot(re[b], im[b]);
+	    bb->chan[a].mag= mag[k-1];
+	    //bb->chan[a].pha= atan2(im[k-1], re[k-1]);
+	    if (bb->sm) fid_run_block(bb->chan[a].sm, mag, mag, k);
+	    bb->chan[a].magsm= mag[k-1];
 	 }
+	 bb->ph= (bb->ph + cnt) % bb->dec;
+      }
+
+      if (!SAMPLE_OK(dev, rd)) {
+	 // Overwritten whilst we were reading it; catch up
+	 cursor_lapped(pg->cur);
+	 wr= DEV_WR(dev);
+	 continue;
       }
+      pg->cur->rd= rd + cnt;
+
+      if (pg->out && (pg->row_cnt += cnt) >= pg->row_len)
+	 write_row(pg);
    }
 }
 
+//
+//	Number of samples to rewind to restart the analysis the given
+//	number of seconds ago, limited to what the buffer holds
+//
+
+static int 
+rewind_len(double rew_sec) {
+   int rew= rew_sec * dev->rate;
+   if (rew >= dev->n_smp / 10 * 9) rew= dev->n_smp / 10 * 9;
+   return rew;
+}
+
 //
 //	Restart the analysis
 //
 //	This zaps all the filter buffers, and rewinds the read point
 //	to the given number of seconds ago, and recalculates
-//	everything up to this point.  This is necessary when switching
-//	to this page because our analysis data and filter buffers may
-//	be completely out of date.
+//	everything up to this point.  This is necessary when our
+//	analysis data and filter buffers are completely out of date.
 //
 
 static void 
@@ -259,13 +411,11 @@ restart_analysis(PageBands *pg, double rew_sec) {
    PB_Bar *bb;
    int a;
    int n_chan= dev->n_chan;
-   int rew= rew_sec * dev->rate;
-   if (rew >= dev->n_smp * 9 / 10) rew= dev->n_smp * 9 / 10;
-   pg->rd= dev->wr - rew;
-   if (pg->rd < 0) pg->rd += dev->n_smp;
+   pg->cur->rd= DEV_WR(dev) - rewind_len(rew_sec);
    
    // Go through zapping all the buffers
    for (bb= pg->bar; bb; bb= bb->nxt) {
+      bb->ph= 0;
       for (a= 0; a<n_chan; a++) {
 	 fid_run_zapbuf(bb->chan[a].lp0);
 	 fid_run_zapbuf(bb->chan[a].lp1);
@@ -278,6 +428,110 @@ restart_analysis(PageBands *pg, double rew_sec) {
    process_data(pg);
 }
 
+//
+//	Resume the analysis when the page is shown again.  Nothing
+//	touches the filter buffers, oscillators or cursor whilst the
+//	page is hidden, so they still hold the state as it was up to
+//	cur->rd, and only the gap since then needs running through.
+//	If the gap is longer than a restart would rewind, a restart
+//	is quicker, and gives settled filters just the same.
+//
+
+static void 
+resume_analysis(PageBands *pg, double rew_sec) {
+   if (pg->kept && DEV_WR(dev) - pg->cur->rd <= rewind_len(rew_sec))
+      process_data(pg);
+   else 
+      restart_analysis(pg, rew_sec);
+   pg->kept= 0;
+}
+
+//
+//	Resync after our cursor has been lapped: the filters have
+//	missed data, so start them again from a little way back
+//
+
+static void 
+resync(void *vp) {
+   restart_analysis((PageBands*)vp, RESYNC_SEC);
+}
+
+//
+//	Batch analysis support.  Instead of being displayed, the
+//	analysis is run over the whole input, and one row of
+//	mag/magsm values is written out for each frame-interval of
+//	data.  The row starts with the time in seconds from the start
+//	of the input, and then has mag and magsm for each channel of
+//	each bar in turn, in display order.  Binary output has each of
+//	these as a native 4-byte float.
+//
+
+int 
+p_bands_is(Page *pp) {
+   return pp->event == event;
+}
+
+void 
+p_bands_batch_init(Page *pp, FILE *out, int csv) {
+   PageBands *pg= (PageBands*)pp;
+   PB_Bar *bb;
+   int a;
+
+   pg->out= out;
+   pg->csv= csv;
+   pg->row_len= (int)(dev->rate / pg->fps + 0.5);
+   if (pg->row_len < 1) pg->row_len= 1;
+   pg->row_cnt= 0;
+   pg->bars= ALLOC_ARR(pg->n_bar, PB_Bar*);
+   for (bb= pg->bar; bb; bb= bb->nxt) 
+      pg->bars[bb->num]= bb;
+   pg->row= ALLOC_ARR(1 + 2 * pg->n_bar * dev->n_chan, float);
+
+   pg->cur->idle= 0;
+   pg->cur->rd= pg->rd0= DEV_WR(dev);
+
+   if (csv) {
+      fprintf(out, "time");
+      for (a= 0; a<pg->n_bar * dev->n_chan; a++) {
+	 bb= pg->bars[a / dev->n_chan];
+	 fprintf(out, ",%gHz-%d-mag,%gHz-%d-magsm", 
+		 bb->freq, a % dev->n_chan, bb->freq, a % dev->n_chan);
+      }
+      fprintf(out, "\n");
+   }
+}
+
+void 
+p_bands_batch_run(Page *pp) {
+   process_data((PageBands*)pp);
+}
+
+static void 
+write_row(PageBands *pg) {
+   int n_chan= dev->n_chan;
+   double tim= (pg->cur->rd - pg->rd0) / dev->rate;
+   int a, b;
+
+   pg->row_cnt= 0;
+   if (pg->csv) {
+      fprintf(pg->out, "%.4f", tim);
+      for (a= 0; a<pg->n_bar; a++) 
+	 for (b= 0; b<n_chan; b++)
+	    fprintf(pg->out, ",%.6g,%.6g", 
+		    pg->bars[a]->chan[b].mag, pg->bars[a]->chan[b].magsm);
+      fputc('\n', pg->out);
+   } else {
+      float *fp= pg->row;
+      *fp++= (float)tim;
+      for (a= 0; a<pg->n_bar; a++) 
+	 for (b= 0; b<n_chan; b++) {
+	    *fp++= (float)pg->bars[a]->chan[b].mag;
+	    *fp++= (float)pg->bars[a]->chan[b].magsm;
+	 }
+      fwrite(pg->row, sizeof(float), fp - pg->row, pg->out);
+   }
+}
+
 //
 //	Draw the signal area
 //
@@ -286,10 +540,8 @@ static void
 draw_signal(PageBands *pg, int xx, int yy, int sx, int sy, int tsx) {
    int tb= 1;	// Timebase -- samples/pixel
    int a, b;
-   int off= -((dev->min + dev->max + 1)/2);
-   int wr= dev->wr;		// Static target, please!
-   double mul= 2.0/(dev->max+1-dev->min);
-   mul *= pg->sgain;
+   Sint64 wr= DEV_WR(dev);	// Static target, please!
+   double mul= pg->sgain;
 
    clear_rect(xx, yy, sx, sy, pg->c_bg);
    
@@ -297,20 +549,23 @@ draw_signal(PageBands *pg, int xx, int yy, int sx, int sy, int tsx) {
       int chan= pg->chan + a;
       int inc= a ? 1 : -1;
       int ox= (sx/2) + inc * (tsx/2) - (inc < 0);
-      int rd= pg->rd;
-      Sample *ss;
+      Sint64 rd= pg->cur->rd;
+      float *vp;
       if (chan >= dev->n_chan) continue;
+      vp= DEV_PLANE(dev, chan);
       for (; ox < sx && ox >= 0; ox += inc) {
 	 double min= 2.0, max= -2.0, val;
 	 int oy0, oy1, oyz, err= 0;
 	 for (b= 0; b<tb; b++) {
-	    SAMPLE_DEC(rd);
-	    if (rd == wr) goto no_more_data;
-	    ss= SAMPLE(rd);
-	    val= (ss->val[chan] + off) * mul;
+	    int e;
+	    rd--;
+	    if (wr - rd > dev->n_smp - SAMPLE_GUARD) goto no_more_data;
+	    val= vp[rd & dev->mask] * mul;
+	    e= SAMPLE(rd)->err;
+	    if (!SAMPLE_OK(dev, rd)) goto no_more_data;
 	    if (val < min) min= val;
 	    if (val > max) max= val;
-	    if (ss->err) err++;
+	    if (e) err++;
 	 }
 	 oy0= (int)floor((1.0 - max) * 0.4999 * sy);
 	 oy1= (int)floor((1.0 - min) * 0.4999 * sy);
@@ -446,10 +701,13 @@ event(Event *ev) {
        }
        break;
     case 'SHOW':	// Show
-       restart_analysis(pg, 10);
+       pg->cur->idle= 0;
+       resume_analysis(pg, 10);
        tick_timer(pg->fms);
        break;
     case 'HIDE':	// Hide
+       pg->cur->idle= 1;
+       pg->kept= 1;
        break;
     case 'SET':		// Settings change
        if (ev->sym == 'b')
@@ -86,8 +86,9 @@ applog(char *fmt, ...) {
       *--p= last_col;
    }
 
-   // In server mode, we dump it out to STDERR, less the colours
-   if (server) {
+   // In server or batch mode, we dump it out to STDERR, less the
+   // colours
+   if (server || batch_in) {
       while (hist_rd != hist_wr) {
 	 for (p= history[hist_rd++]; *p; p++)
 	    if (*p >= 32) 
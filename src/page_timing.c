@@ -23,13 +23,14 @@ typedef struct PageTiming PageTiming;
 struct PageTiming {
    Page pg;
    int n_tim;		// Number of time-samples taken
-   int *tim;		// List of time-samples in ms
+   double *tim;		// List of time-samples in ms, relative to the first
    char *flag;		// List of error flags corresponding to tim[]
    double rate;		// Calculated sampling rate
    double j_max;	// Maximum jitter, ms
    double j_ave;	// Average jitter, ms
    double off, inc;	// Straight line representing last call to find_min_off()
    int err;
+   short *font;		// Font used for the text lines at the top, or 0 if not drawn
 };
 
 #else
@@ -43,6 +44,7 @@ struct PageTiming {
 //
 
 static void event(Event *ev);
+static void draw_cursors(short *font, int yy);
 
 Page *
 p_timing_init(Parse *pp) {
@@ -105,36 +107,43 @@ find_min_off(PageTiming *pg, double rate) {
 static void 
 analyse_data(PageTiming *pg, double per) {
    int n_tim= per * dev->rate;
-   int *tim;
+   double *tim;
    char *flag;
-   int n_smp= dev->n_smp * 9 / 10;
-   int wr, rd, a;
+   Sint64 stamp0;
+   int n_smp= dev->n_smp / 10 * 9;
+   Sint64 wr, rd;
+   int a;
    int midp;	// Midpoint (n_tim/2)
    double r0, r1, r2;
    int cnt;
-   int adj;
 
    pg->err= 0;
 
    // Setup a buffer for the time-stamp values
    if (n_tim > n_smp) n_tim= n_smp;
    if (pg->tim) free(pg->tim);
-   pg->tim= tim= ALLOC_ARR(n_tim, int);
+   pg->tim= tim= ALLOC_ARR(n_tim, double);
    pg->flag= flag= ALLOC_ARR(n_tim, char);
    pg->n_tim= n_tim;
 
    // Take a copy of the timestamps (so they don't change whilst we
    // are analysing)
-   wr= dev->wr;
-   rd= wr - n_tim; SAMPLE_WRAP(rd);
+   wr= DEV_WR(dev);
+   rd= wr - n_tim;
+   stamp0= SAMPLE(rd)->stamp;
    for (a= 0; a<n_tim; a++) {
       Sample *ss= SAMPLE(rd);
-      tim[a]= ss->stamp;
+      tim[a]= (ss->stamp - stamp0) * 0.001;
       flag[a]= (ss->err != 0);
-      SAMPLE_INC(rd);
+      rd++;
+   }
+
+   // If the oldest has been overwritten whilst copying, mark the
+   // ones that might have been affected as errors
+   if (!SAMPLE_OK(dev, wr - n_tim)) {
+      int cnt= (int)(DEV_WR(dev) - wr) + SAMPLE_GUARD;
+      for (a= 0; a<cnt && a<n_tim; a++) flag[a]= 1;
    }
-   adj= -tim[0];
-   for (a= 0; a<n_tim; a++) tim[a] += adj;
 
    // Look for the accurate sampling rate
    midp= n_tim/2;
@@ -200,13 +209,19 @@ event(Event *ev) {
     case 'RESZ':	// Resize (sx,sy)
        break;
     case 'SHOW':	// Show
+       tick_timer(500);		// Update cursor lags twice a second
        break;
     case 'HIDE':	// Hide
        if (pg->tim) { free(pg->tim); pg->tim= 0; }
+       pg->font= 0;
        break;
     case 'SET':		// Settings change
        break;
     case 'TICK':	// New frame
+       if (pg->font) {
+	  draw_cursors(pg->font, 2*pg->font[1]);
+	  update(0, 2*pg->font[1], disp_sx, pg->font[1]);
+       }
        break;
     case 'DRAW':	// Redraw
        // Do a full analysis of the last 9 seconds and display it
@@ -229,7 +244,7 @@ event(Event *ev) {
 	     p++;	// After the NUL
 	  } else {
 	     p= txt + sprintf(txt, "\x84Sampling rate: %.5gHz (%gHz),  "
-			      "Jitter: max %.1fms, average %.1fms,  "
+			      "Jitter: max %.3fms, average %.3fms,  "
 			      "Column width: ",
 			      pg->rate, dev->rate, pg->j_max, pg->j_ave);
 	  }
@@ -238,7 +253,8 @@ event(Event *ev) {
 	     font= (a==2) ? font10x20 : (a==1) ? font8x16 : font6x12;
 	     if (len * font[0] <= disp_sx) break;
 	  }
-	  yy= font[1]; sy= disp_sy - yy;
+	  yy= 3*font[1]; sy= disp_sy - yy;	// Three lines of text at top
+	  pg->font= font;
 
 	  n_col= ((pg->n_tim - 1) / sy) + 1;
 	  wid= disp_sx / n_col;
@@ -249,6 +265,32 @@ event(Event *ev) {
 	  sprintf(p, "%.1fms", widms);
 	  drawtext(font, 0, 0, txt);
 
+	  // Input buffer statistics on a second line, for each
+	  // sub-device if there are several
+	  if (!dev->subs) {
+	     p= txt + sprintf(txt, "\x84Input: %.0f bytes,  dropped %.0f,  "
+			      "peak fill %d of %d bytes (%s)",
+			      dev->in_bytes, dev->in_drop, dev->in_peak, dev->imask, 
+			      dev->overflow ? "drop" : "block");
+	     if (dev->rawdump) 
+		sprintf(p, ",  rawdump %.0f bytes, dropped %.0f",
+			dev->rawdump->bytes, rawdump_dropped(dev->rawdump));
+	  } else {
+	     Device *dd;
+	     p= txt + sprintf(txt, "\x84");
+	     for (a= 1, dd= dev->subs; dd && p-txt < sizeof(txt)-120; a++, dd= dd->nxt) {
+		p += sprintf(p, "Dev %d: %.0f bytes, drop %.0f, peak %d/%d, "
+			     "merge dup %d drop %d", a,
+			     dd->in_bytes, dd->in_drop, dd->in_peak, dd->imask,
+			     dd->m_dup, dd->m_drop);
+		if (dd->rawdump) 
+		   p += sprintf(p, ", dump drop %.0f", rawdump_dropped(dd->rawdump));
+		p += sprintf(p, ";  ");
+	     }
+	  }
+	  drawtext(font, 0, font[1], txt);
+	  draw_cursors(font, 2*font[1]);
+
 	  off= pg->off;
 	  inc= pg->inc;
 	  for (a= 0; a<pg->n_tim; a++) {
@@ -297,6 +339,52 @@ event(Event *ev) {
    }
 }
 
+//
+//	Write a length of time in seconds, minutes or hours, whichever
+//	is most readable, and return the end of the text
+//
+
+static char *
+fmt_secs(char *p, double sec) {
+   if (sec >= 7200) return p + sprintf(p, "%.1fh", sec / 3600);
+   if (sec >= 120) return p + sprintf(p, "%.1fmin", sec / 60);
+   return p + sprintf(p, "%.1fs", sec);
+}
+
+//
+//	Draw a line showing how much history is held, and how far each
+//	registered cursor lags the writer, so that a consumer that
+//	can't keep up can be spotted
+//
+
+static void 
+draw_cursors(short *font, int yy) {
+   char txt[512];
+   char *p, *end= txt + sizeof(txt);
+   Sint64 wr= DEV_WR(dev);
+   Cursor *cc;
+
+   p= txt + sprintf(txt, "\x84History: ");
+   p= fmt_secs(p, (wr < dev->n_smp ? wr : dev->n_smp) / dev->rate);
+   p += sprintf(p, " of ");
+   p= fmt_secs(p, dev->n_smp / dev->rate);
+   p += sprintf(p, "%s;  Lag: ", dev->hist_fp ? " (mapped)" : "");
+   if (!cursors) 
+      p += sprintf(p, "no readers");
+   for (cc= cursors; cc && end-p > 100; cc= cc->nxt) {
+      if (cc->idle) 
+	 p += sprintf(p, "%s idle", cc->name);
+      else 
+	 p += sprintf(p, "%s %d (max %d)", cc->name, (int)(wr - cc->rd), cc->lag_max);
+      if (cc->lapped) 
+	 p += sprintf(p, " \x82 lapped %d \x84", cc->lapped);
+      if (cc->nxt) 
+	 p += sprintf(p, ",  ");
+   }
+   clear_rect(0, yy, disp_sx, font[1], colour[0]);
+   drawtext(font, 0, yy, txt);
+}
+
 #endif
 
 // END //
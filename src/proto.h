@@ -6,8 +6,10 @@ extern Clock audio_clock;
 extern void audio_add(AudioHandler *fn, void *vp) ;
 extern int audio_del(AudioHandler *fn, void *vp) ;
 extern int handle_audio_setup(Parse *pp) ;
-extern void clock_setup(Clock *ck, double rate, int now) ;
-extern int clock_inc(Clock *ck, int now) ;
+extern char *batch_in;
+extern void batch_run(char *inp, char *outnam) ;
+extern void clock_setup(Clock *ck, double rate, Sint64 now) ;
+extern Sint64 clock_inc(Clock *ck, Sint64 now) ;
 extern int colour_data[];
 extern inline void sincos_init(double *buf, double freq) ;
 extern inline void sincos_step(double *buf) ;
@@ -18,13 +20,24 @@ extern int parse(Parse *pp, char *fmt0, ...) ;
 extern int parseEOF(Parse *pp) ;
 extern int handle_page_setup(Parse *pp, int fn) ;
 extern Device *dev;
+extern Cursor *cursors;
 extern int handle_dev_setup(Parse *pp) ;
+extern int dev_started() ;
+extern int dev_start() ;
+extern Cursor *cursor_new(char *name, int policy, void (*resync)(void*), void *vp) ;
+extern Sint64 cursor_check(Cursor *cc) ;
+extern void cursor_lapped(Cursor *cc) ;
+extern void sample_planes(Device *dev, Sint64 seq) ;
 extern int serial_thread(void *vp) ;
+extern int file_tick(Device *dev) ;
 extern int file_thread(void *vp) ;
-extern void serial_audio_callback(int now) ;
-extern void modEEGold_handler() ;
-extern void modEEG_handler() ;
-extern void jm_handler() ;
+extern int merge_thread(void *vp) ;
+extern void serial_audio_callback(Sint64 now) ;
+extern void modEEGold_handler(Device *dev) ;
+extern void modEEG_handler(Device *dev) ;
+extern void jm_handler(Device *dev) ;
+extern void openbci_handler(Device *dev) ;
+extern void decode_benchmark(char *fmtname, char *fname) ;
 extern SDL_Surface *disp;
 extern Uint32 *disp_pix32;
 extern Uint16 *disp_pix16;
@@ -40,25 +53,31 @@ extern int tick_inc;
 extern int tick_targ;
 extern Uint32 main_threadid;
 extern int server;
-extern int server_rd;
+extern Cursor *server_cur;
 extern int server_out;
 extern double nan_global;
 extern Page *p_fn[] ;
 extern void usage() ;
 extern int main(int ac, char **av) ;
-extern int setup_server_connection(char *serv, int port, Parse *pp) ;
-extern void nsd_handler() ;
-extern void nsd_line(char *line) ;
+extern int setup_server_connection(Device *dev, char *serv, int port, Parse *pp) ;
+extern void nsd_handler(Device *dev) ;
+extern void nsd_line(Device *dev, char *line) ;
 extern void server_loop() ;
 extern void send_edf_header(int fd) ;
 extern void server_handler() ;
 extern Page * p_audio_init(Parse *pp) ;
 extern Page * p_bands_init(Parse *pp) ;
+extern int p_bands_is(Page *pp) ;
+extern void p_bands_batch_init(Page *pp, FILE *out, int csv) ;
+extern void p_bands_batch_run(Page *pp) ;
 extern Page * p_bands_init(Parse *pp) ;
 extern int applog_force_update;
 extern int applog(char *fmt, ...) ;
 extern Page * p_console_init() ;
 extern Page * p_timing_init(Parse *pp) ;
+extern RawDump *rawdump_open(char *name, int rotate_mb) ;
+extern void rawdump_put(RawDump *rd, char *dat, int len) ;
+extern double rawdump_dropped(RawDump *rd) ;
 extern Settings * set_new(char *spec) ;
 extern void set_delete(Settings *ss) ;
 extern void set_load_presets(Settings *ss, char *txt) ;
@@ -66,6 +85,11 @@ extern int set_rearrange(Settings *ss, short *font, int sx) ;
 extern void set_position(Settings *ss, int ox, int oy) ;
 extern void set_draw(Settings *ss) ;
 extern int set_event(Settings *ss, Event *ev) ;
+extern Synth *synth_get(Device *dev) ;
+extern void synth_add(Device *dev, double freq, double amp, double per, double dur) ;
+extern char *synth_setup(Device *dev) ;
+extern int synth_tick(Device *dev) ;
+extern int synth_thread(void *vp) ;
 extern short font6x8[];
 extern short font6x12[];
 extern short font8x16[];
@@ -130,6 +154,8 @@ extern void scr_wrD(double dval) ;
 extern void scr_wrI(int ival) ;
 extern StrStream * strstream_open(int maxsiz) ;
 extern char * strstream_close(StrStream *ss) ;
+extern Sint64 time_now_us() ;
+extern Sint64 time_now_us() ;
 extern int time_now_ms() ;
 extern int time_now_ms() ;
 extern void time_hhmmss(char *dst) ;
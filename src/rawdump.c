@@ -0,0 +1,244 @@
+//
+//	Raw input capture ('rawdump')
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.
+//        Released under the GNU GPL version 2 as published by the
+//        Free Software Foundation.  See the file COPYING for details,
+//        or visit <http://www.gnu.org/copyleft/gpl.html>.
+//
+//	The input thread hands incoming bytes over to a writer thread
+//	through a lock-free single-producer, single-consumer ring, so
+//	a disk stall can never hold up input or skew the timestamps.
+//	The ring is made of two aligned halves: the writer writes out
+//	each half in a single large write as soon as it is full, whilst
+//	the input thread fills the other one.  Data that sits in a
+//	half-filled half for more than RAWDUMP_FLUSH ms is written out
+//	anyway.  If the writer falls so far behind that a chunk of
+//	input won't fit, the whole chunk is dropped and counted.
+//
+//	Output may be rotated to a new numbered file every so many MB,
+//	in which case 'dump.raw' becomes 'dump-001.raw', 'dump-002.raw'
+//	and so on.
+//
+
+#ifdef HEADER
+
+typedef struct RawDump RawDump;
+struct RawDump {
+   RawDump *nxt;	// Next in list of all dumps
+   char *name;		// File name (StrDup'd)
+   FILE *out;		// Current output file, or 0 after a failure
+   int seq;		// Current file number when rotating, else 0
+   double rotate;	// Bytes per file before rotating, or 0
+   double f_bytes;	// Bytes written to the current file
+   char *mem;		// Allocated memory for ring
+   char *buf;		// Ring buffer itself (aligned to RAWDUMP_ALIGN)
+   int len;		// Length of ring (power of 2)
+   int half;		// Length of each half
+   Sint64 wr;		// Bytes handed over so far (only updated by input thread)
+   Sint64 rd;		// Bytes written out so far (only updated by writer thread)
+   double bytes;	// Bytes written to disk in total
+   double dropped;	// Bytes dropped because the writer couldn't keep up (input thread)
+   double w_dropped;	// Bytes dropped after a write error (writer thread)
+   int quit;		// Set to ask the writer to flush everything and stop
+   int done;		// Set by the writer when it has stopped
+};
+
+#define RAWDUMP_HALF (256*1024)	// Bytes in each half of the ring
+#define RAWDUMP_ALIGN 4096	// Alignment of ring (and so of full writes)
+#define RAWDUMP_FLUSH 1000	// Maximum ms that data waits before being written
+
+#else
+
+#ifndef NO_ALL_H
+#include "all.h"
+#endif
+
+#ifdef T_MSVC
+#define RD_LOAD(pp) InterlockedCompareExchange64((pp), 0, 0)
+#define RD_STORE(pp,vv) InterlockedExchange64((pp), (vv))
+#else
+#define RD_LOAD(pp) __atomic_load_n((pp), __ATOMIC_ACQUIRE)
+#define RD_STORE(pp,vv) __atomic_store_n((pp), (vv), __ATOMIC_RELEASE)
+#endif
+
+static RawDump *dumps;		// List of all dumps, for rawdump_atexit()
+
+static int rawdump_thread(void *vp);
+static FILE *rawdump_next(RawDump *rd);
+static void rawdump_atexit();
+
+//
+//	Start a new dump to the given file, rotating every 'rotate_mb'
+//	MB, or never if 0.  Returns 0 if the file couldn't be created
+//	(after logging it).
+//
+
+RawDump *
+rawdump_open(char *name, int rotate_mb) {
+   RawDump *rd= ALLOC(RawDump);
+   size_t adj;
+
+   rd->name= StrDup(name);
+   rd->rotate= rotate_mb * 1048576.0;
+   if (rd->rotate > 0) rd->seq= 1;
+   if (!(rd->out= rawdump_next(rd))) {
+      free(rd->name); free(rd);
+      return 0;
+   }
+
+   rd->half= RAWDUMP_HALF;
+   rd->len= 2 * rd->half;
+   rd->mem= Alloc(rd->len + RAWDUMP_ALIGN);
+   adj= (size_t)rd->mem & (RAWDUMP_ALIGN-1);
+   rd->buf= rd->mem + (adj ? RAWDUMP_ALIGN - adj : 0);
+
+   if (!dumps) atexit(rawdump_atexit);
+   rd->nxt= dumps; dumps= rd;
+
+   if (!SDL_CreateThread(rawdump_thread, rd))
+      errorSDL("Problem starting rawdump writer thread");
+   return rd;
+}
+
+//
+//	Open the next output file, or the only one if not rotating.
+//	Returns 0 on failure, after logging it.
+//
+
+static FILE *
+rawdump_next(RawDump *rd) {
+   char fnam[256];
+   FILE *out;
+
+   if (!rd->seq)
+      snprintf(fnam, sizeof(fnam), "%s", rd->name);
+   else {
+      char *ext= strrchr(rd->name, '.');
+      int pre= ext ? ext - rd->name : strlen(rd->name);
+      snprintf(fnam, sizeof(fnam), "%.*s-%03d%s", pre, rd->name,
+	       rd->seq, ext ? ext : "");
+   }
+
+   if (!(out= fopen(fnam, "wb"))) {
+      applog("\x82 rawdump \x86  Failed to create '%s'", fnam);
+      return 0;
+   }
+   setvbuf(out, 0, _IONBF, 0);	// We write large blocks anyway
+   rd->f_bytes= 0;
+   return out;
+}
+
+//
+//	Hand over a chunk of incoming bytes.  Called from the input
+//	thread; never blocks.
+//
+
+void
+rawdump_put(RawDump *rd, char *dat, int len) {
+   Sint64 wr= rd->wr;
+   int off, cnt;
+
+   if (len > rd->len - (int)(wr - RD_LOAD(&rd->rd))) {
+      // Writer can't keep up, so drop the whole chunk
+      if (!rd->dropped)
+	 applog("\x82 rawdump \x86  Disk is not keeping up; dropping input");
+      rd->dropped += len;
+      return;
+   }
+
+   while (len > 0) {
+      off= (int)(wr & (rd->len-1));
+      cnt= rd->len - off;
+      if (cnt > len) cnt= len;
+      memcpy(rd->buf + off, dat, cnt);
+      dat += cnt; len -= cnt; wr += cnt;
+   }
+   RD_STORE(&rd->wr, wr);
+}
+
+//
+//	Total bytes dropped so far.  Each thread keeps its own count,
+//	so they are only added up here, for display.
+//
+
+double
+rawdump_dropped(RawDump *rd) {
+   return rd->dropped + rd->w_dropped;
+}
+
+//
+//	Writer thread.  Writes out each half of the ring as it fills,
+//	and anything left waiting for too long.
+//
+
+static int
+rawdump_thread(void *vp) {
+   RawDump *rd= vp;
+   int wait= 0;		// ms that data has been waiting
+   int quit, off, cnt;
+   Sint64 wr;
+
+   while (1) {
+      quit= rd->quit;
+      wr= RD_LOAD(&rd->wr);
+
+      // Write up to the end of the current half, if it is full or
+      // if we have waited long enough
+      off= (int)(rd->rd & (rd->len-1));
+      cnt= rd->half - (off & (rd->half-1));
+      if (wr - rd->rd >= cnt ||
+	  (wr != rd->rd && (quit || wait >= RAWDUMP_FLUSH))) {
+	 if (cnt > wr - rd->rd) cnt= (int)(wr - rd->rd);
+	 if (rd->out && 1 != fwrite(rd->buf + off, cnt, 1, rd->out)) {
+	    applog("\x82 rawdump \x86  Write error on '%s': %s",
+		   rd->name, strerror(errno));
+	    fclose(rd->out);
+	    rd->out= 0;
+	 }
+	 if (!rd->out)
+	    rd->w_dropped += cnt;
+	 else {
+	    rd->bytes += cnt;
+	    rd->f_bytes += cnt;
+	 }
+	 RD_STORE(&rd->rd, rd->rd + cnt);
+	 wait= 0;
+
+	 if (rd->out && rd->rotate > 0 && rd->f_bytes >= rd->rotate) {
+	    fclose(rd->out);
+	    rd->seq++;
+	    rd->out= rawdump_next(rd);
+	 }
+	 continue;
+      }
+
+      if (quit) break;
+      SDL_Delay(20);
+      if (wr != rd->rd) wait += 20;
+   }
+
+   if (rd->out) fclose(rd->out);
+   rd->out= 0;
+   rd->done= 1;
+   return 0;
+}
+
+//
+//	Flush out all the dumps on exit
+//
+
+static void
+rawdump_atexit() {
+   RawDump *rd;
+   int cnt;
+
+   for (rd= dumps; rd; rd= rd->nxt) rd->quit= 1;
+   for (rd= dumps; rd; rd= rd->nxt)
+      for (cnt= 0; !rd->done && cnt < 200; cnt++)
+	 SDL_Delay(10);
+}
+
+#endif
+
+// END //
@@ -0,0 +1,263 @@
+//
+//	Synthetic input device ('synth')
+//
+//        Copyright (c) 2002-2003 Jim Peters <http://uazu.net/>.
+//        Released under the GNU GPL version 2 as published by the
+//        Free Software Foundation.  See the file COPYING for details,
+//        or visit <http://www.gnu.org/copyleft/gpl.html>.
+//
+//	This generates test signals for load-testing the rest of the
+//	system without any hardware: up to SYNTH_MAX_CHAN channels at
+//	up to SYNTH_MAX_RATE Hz, made up of sines, gated sine bursts
+//	and white noise, with sync errors injected at random.  Each
+//	channel gets the same components but with its phase shifted
+//	round by a fraction of a cycle so that the channels differ.
+//
+//	Samples are written straight into the sample buffer, with
+//	timestamps taken from the ideal schedule rather than the time
+//	they were actually generated.
+//
+
+#ifdef HEADER
+
+typedef struct SynthOsc SynthOsc;
+struct SynthOsc {
+   SynthOsc *nxt;	// Next in list
+   double amp;		// Amplitude as a fraction of full-scale
+   double osc[4];	// sincos generator (see complex.c)
+   int per, dur;	// Bursts: period and on-time in samples, else 0
+};
+
+typedef struct Synth Synth;
+struct Synth {
+   SynthOsc *osc;	// Sine and burst components
+   double noise;	// White noise amplitude as a fraction of full-scale
+   double errs;		// Sync errors to inject per second
+   double *pc, *ps;	// Per-channel phase shift (cos and sin)
+   double *acc;		// Per-channel sum of components for current sample
+   Sint64 t0;		// Time (us) at which sample 0 is due
+   Sint64 n_smp;	// Samples generated so far
+   Uint32 rand;		// Noise generator state
+   Uint32 err_lim;	// Inject a sync error if a random value falls below this
+};
+
+#define SYNTH_MAX_CHAN 256
+#define SYNTH_MAX_RATE 16000
+
+#else
+
+#ifndef NO_ALL_H
+#include "all.h"
+#endif
+
+#define RAND(sy) ((sy)->rand ^= (sy)->rand << 13, \
+		  (sy)->rand ^= (sy)->rand >> 17, \
+		  (sy)->rand ^= (sy)->rand << 5)
+
+//
+//	Get the device's Synth structure, creating it if necessary
+//
+
+Synth *
+synth_get(Device *dev) {
+   if (!dev->synth) {
+      dev->synth= ALLOC(Synth);
+      dev->synth->rand= 0x12345678;
+   }
+   return dev->synth;
+}
+
+//
+//	Add a component: a sine of the given frequency and amplitude,
+//	or a burst of one if 'per' and 'dur' (in seconds) are given.
+//	The burst periods are only known in samples once the rate is
+//	known, so they are kept as ms for now.
+//
+
+void
+synth_add(Device *dev, double freq, double amp, double per, double dur) {
+   Synth *sy= synth_get(dev);
+   SynthOsc *so= ALLOC(SynthOsc), **prvp;
+
+   so->osc[0]= freq;
+   so->amp= amp;
+   so->per= (int)(per * 1000);
+   so->dur= (int)(dur * 1000);
+   for (prvp= &sy->osc; *prvp; prvp= &(*prvp)->nxt) ;
+   *prvp= so;
+}
+
+//
+//	Check the settings once all of the [*-dev] section has been
+//	read, and finish setting up.  Returns 0 on success, or an error
+//	message.
+//
+
+char *
+synth_setup(Device *dev) {
+   static char msg[160];
+   Synth *sy= synth_get(dev);
+   SynthOsc *so;
+   double sum;
+   int a;
+
+   if (dev->n_chan <= 0) dev->n_chan= 8;
+   if (!dev->rate) dev->rate= 256;
+   if (!dev->width) dev->width= 2;
+   if (dev->n_chan > SYNTH_MAX_CHAN) {
+      sprintf(msg, "Synth devices have at most %d channels", SYNTH_MAX_CHAN);
+      return msg;
+   }
+   if (dev->rate < 1 || dev->rate > SYNTH_MAX_RATE) {
+      sprintf(msg, "Synth sampling rate should be 1 to %dHz", SYNTH_MAX_RATE);
+      return msg;
+   }
+   dev->min= dev->width == 4 ? -0x800000 : -0x8000;
+   dev->max= dev->width == 4 ? 0x7FFFFF : 0x7FFF;
+   dev->n_flag= 0;
+
+   // A 10Hz sine if nothing else was asked for
+   if (!sy->osc && !sy->noise) synth_add(dev, 10, 0.5, 0, 0);
+
+   sum= sy->noise;
+   for (so= sy->osc; so; so= so->nxt) {
+      if (so->osc[0] <= 0 || so->osc[0] >= dev->rate / 2) {
+	 sprintf(msg, "Synth frequency %gHz is out of range for %gHz sampling",
+		 so->osc[0], dev->rate);
+	 return msg;
+      }
+      sincos_init(so->osc, so->osc[0] / dev->rate);
+      so->per= (int)(so->per * 0.001 * dev->rate);
+      so->dur= (int)(so->dur * 0.001 * dev->rate);
+      sum += so->amp;
+   }
+   if (sum > 1.0)
+      applog("    \x98""synth components add up to more than full-scale; they will clip");
+
+   sy->pc= ALLOC_ARR(dev->n_chan, double);
+   sy->ps= ALLOC_ARR(dev->n_chan, double);
+   sy->acc= ALLOC_ARR(dev->n_chan, double);
+   for (a= 0; a<dev->n_chan; a++) {
+      sy->pc[a]= cos(a * 2 * M_PI / dev->n_chan);
+      sy->ps[a]= sin(a * 2 * M_PI / dev->n_chan);
+   }
+   sy->err_lim= (Uint32)(4294967295.0 * (sy->errs / dev->rate < 1 ? sy->errs / dev->rate : 1));
+   return 0;
+}
+
+//
+//	Generate the values for one sample into sy->acc[] and store
+//	them.  Specialised for each sample width.
+//
+
+static ALWAYS_INLINE void
+synth_sample(Device *dev, Synth *sy, Sample *ss, int w32) {
+   int n_chan= dev->n_chan;
+   double mid= (dev->min + dev->max + 1) / 2;
+   double scale= (dev->max - dev->min) / 2;
+   double *acc= sy->acc;
+   SynthOsc *so;
+   int a;
+
+   for (a= 0; a<n_chan; a++) acc[a]= 0;
+
+   for (so= sy->osc; so; so= so->nxt) {
+      sincos_step(so->osc);
+      if (so->per && (int)(sy->n_smp % so->per) >= so->dur)
+	 continue;
+      {
+	 double v0= so->amp * so->osc[0];
+	 double v1= so->amp * so->osc[1];
+	 for (a= 0; a<n_chan; a++)
+	    acc[a] += v0 * sy->pc[a] - v1 * sy->ps[a];
+      }
+   }
+
+   if (sy->noise) {
+      double mul= sy->noise / 2147483648.0;
+      for (a= 0; a<n_chan; a++)
+	 acc[a] += mul * (double)(Sint32)RAND(sy);
+   }
+
+   for (a= 0; a<n_chan; a++) {
+      double val= mid + acc[a] * scale;
+      if (val < dev->min) val= dev->min;
+      if (val > dev->max) val= dev->max;
+      if (w32) ((Sample32*)ss)->val[a]= (int)val;
+      else ss->val[a]= (short)val;
+   }
+}
+
+//
+//	Generate all the samples that are due by now.  If we've fallen
+//	more than half the sample buffer behind, the missing time is
+//	skipped.  Returns the number of samples generated.
+//
+
+static ALWAYS_INLINE int
+synth_run(Device *dev, int w32) {
+   Synth *sy= dev->synth;
+   Sint64 due= (Sint64)((time_now_us() - sy->t0) * 1e-6 * dev->rate);
+   SynthOsc *so;
+   int cnt= 0;
+
+   if (due - sy->n_smp > dev->n_smp / 2)
+      sy->n_smp= due - dev->n_smp / 2;
+
+   while (sy->n_smp < due) {
+      Sample *ss= SAMPLE(dev->wr);
+      ss->stamp= sy->t0 + (Sint64)(sy->n_smp * 1e6 / dev->rate);
+      ss->time= clock_inc(&dev->clock, ss->stamp);
+      ss->flags= 0;
+      ss->err= 0;
+      synth_sample(dev, sy, ss, w32);
+      if (sy->err_lim && RAND(sy) < sy->err_lim) {
+	 // Injected sync error
+	 memset(ss->val, 0, dev->n_chan * dev->width);
+	 ss->err= 1;
+      }
+      SAMPLE_PUBLISH(dev);
+      sy->n_smp++;
+      cnt++;
+   }
+
+   // Keep the oscillators from drifting in amplitude
+   if (cnt) for (so= sy->osc; so; so= so->nxt) {
+      double mag= hypot(so->osc[0], so->osc[1]);
+      so->osc[0] /= mag;
+      so->osc[1] /= mag;
+   }
+   return cnt;
+}
+
+int
+synth_tick(Device *dev) {
+   if (dev->width == 4)
+      return synth_run(dev, 1);
+   else
+      return synth_run(dev, 0);
+}
+
+//
+//	Thread for a synth device on its own, ticking every ms
+//
+
+int
+synth_thread(void *vp) {
+   Device *dev= vp;
+
+   while (1) {
+      synth_tick(dev);
+
+      // Relay new data to client if in server mode
+      if (server_cur && dev->wr != server_cur->rd)
+	 server_handler();
+
+      SDL_Delay(1);
+   }
+   return 0;
+}
+
+#endif
+
+// END //